@@ -0,0 +1,139 @@
+/*
+ * Copyright (c) 2020 Erfan Abdi <erfangplus@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published by
+ * the Free Software Foundation.
+ *
+ */
+
+#include <math.h>
+
+#include <atomic>
+
+#include "change-filter.h"
+
+struct _ChangeFilter {
+	/* Main loop side, as last set */
+	ChangeFilterParams requested;
+	/* Handed over to the reading thread, which owns params */
+	std::atomic<ChangeFilterParams *> pending;
+	ChangeFilterParams params;
+
+	gboolean           has_value;
+	gdouble            value;
+	gint               direction; /* sign of the last accepted change */
+};
+
+ChangeFilter *
+change_filter_new (const ChangeFilterParams *params)
+{
+	ChangeFilter *filter;
+
+	filter = g_new0 (ChangeFilter, 1);
+	filter->requested = *params;
+	filter->pending = nullptr;
+	filter->params = *params;
+
+	return filter;
+}
+
+void
+change_filter_free (ChangeFilter *filter)
+{
+	if (filter == NULL)
+		return;
+
+	g_free (filter->pending.load (std::memory_order_acquire));
+	g_free (filter);
+}
+
+void
+change_filter_get_params (ChangeFilter       *filter,
+			  ChangeFilterParams *params)
+{
+	*params = filter->requested;
+}
+
+void
+change_filter_set_params (ChangeFilter             *filter,
+			  const ChangeFilterParams *params)
+{
+	ChangeFilterParams *copy;
+
+	filter->requested = *params;
+	copy = g_new (ChangeFilterParams, 1);
+	*copy = *params;
+	/* Whatever was still pending was never seen by the reading thread */
+	g_free (filter->pending.exchange (copy, std::memory_order_acq_rel));
+}
+
+static gdouble
+quantize (const ChangeFilterParams *params,
+	  gdouble                   value)
+{
+	if (params->log_buckets > 0) {
+		if (value <= 0)
+			return 0;
+		value = pow (10, round (log10 (value) * params->log_buckets) / params->log_buckets);
+	}
+
+	if (params->quantum > 0) {
+		value = round (value / params->quantum) * params->quantum;
+		if (params->circular) {
+			value = fmod (value, 360.0);
+			if (value < 0)
+				value += 360.0;
+		}
+	}
+
+	return value;
+}
+
+gboolean
+change_filter_accept (ChangeFilter *filter,
+		      gdouble      *value_p)
+{
+	ChangeFilterParams *params;
+	gdouble value, delta, threshold;
+	gint direction;
+	gboolean accept = TRUE;
+
+	params = filter->pending.exchange (nullptr, std::memory_order_acquire);
+	if (params != NULL) {
+		filter->params = *params;
+		g_free (params);
+	}
+
+	value = quantize (&filter->params, *value_p);
+	*value_p = value;
+
+	if (!filter->has_value)
+		goto out;
+
+	delta = value - filter->value;
+	/* Take the short way around, 359 to 1 is 2 degrees */
+	if (filter->params.circular)
+		delta = fmod (delta + 540.0, 360.0) - 180.0;
+
+	threshold = MAX (filter->params.abs_delta,
+			 filter->params.rel_delta * fabs (filter->value));
+	direction = delta > 0 ? 1 : -1;
+	if (filter->direction != 0 && direction != filter->direction)
+		threshold += filter->params.hysteresis;
+
+	if (delta == 0 || fabs (delta) < threshold) {
+		accept = FALSE;
+		goto out;
+	}
+
+	filter->direction = direction;
+
+out:
+	if (accept) {
+		filter->has_value = TRUE;
+		filter->value = value;
+	}
+
+	return accept;
+}
@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2020 Erfan Abdi <erfangplus@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published by
+ * the Free Software Foundation.
+ *
+ */
+
+#pragma once
+
+#include <glib.h>
+
+/*
+ * Decides whether a new reading is significant enough to be published.
+ * Readings are first quantized, to a step and/or to logarithmic buckets,
+ * so that values which would publish the same never count as a change.
+ * A value must then move away from the last accepted one by at least the
+ * absolute or relative delta, plus the hysteresis band when it turns back.
+ *
+ * The dwell time is applied by the emission scheduler, which holds back
+ * accepted values until the last published one was out for that long,
+ * and then publishes the latest of them.
+ */
+
+typedef struct {
+	gdouble  abs_delta;  /* in sensor units */
+	gdouble  rel_delta;  /* fraction of the published value */
+	gdouble  hysteresis; /* in sensor units, added when the direction reverses */
+	guint    dwell_ms;   /* see emission_scheduler_set_dwell() */
+	gboolean circular;   /* values wrap around at 360, for headings */
+	gdouble  quantum;    /* in sensor units, 0 to not round */
+	guint    log_buckets; /* per decade, 0 for a linear scale */
+} ChangeFilterParams;
+
+typedef struct _ChangeFilter ChangeFilter;
+
+ChangeFilter *change_filter_new        (const ChangeFilterParams *params);
+void          change_filter_free       (ChangeFilter             *filter);
+
+/* From the main loop, new parameters apply from the next reading on */
+void          change_filter_get_params (ChangeFilter             *filter,
+					ChangeFilterParams       *params);
+void          change_filter_set_params (ChangeFilter             *filter,
+					const ChangeFilterParams *params);
+
+/* Quantizes @value in place, then returns TRUE, and remembers it,
+ * if it should be published */
+gboolean      change_filter_accept     (ChangeFilter             *filter,
+					gdouble                  *value);
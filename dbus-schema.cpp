@@ -0,0 +1,239 @@
+/*
+ * Copyright (c) 2020 Erfan Abdi <erfangplus@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published by
+ * the Free Software Foundation.
+ *
+ */
+
+#include <string.h>
+
+#include "dbus-schema.h"
+
+/* FNV-1a, names hashing to the same value make duplicate case labels
+ * in the lookups below, so a collision fails the build */
+static constexpr guint32
+schema_hash (const char *s,
+	     guint32     h = 2166136261u)
+{
+	return *s == '\0' ? h : schema_hash (s + 1, (h ^ (guint8) *s) * 16777619u);
+}
+
+/* Introspection data, static so that nothing gets parsed at startup */
+
+#define SCHEMA_ARG_INFO(id, arg_name, signature) \
+	static GDBusArgInfo schema_arg_##id = { -1, (gchar *) arg_name, (gchar *) signature, NULL };
+SCHEMA_ARGS (SCHEMA_ARG_INFO)
+#undef SCHEMA_ARG_INFO
+
+#define SCHEMA_ARG(id) &schema_arg_##id,
+
+#define SCHEMA_METHOD_INFO(iface, id, method_name, in, out) \
+	static GDBusArgInfo *schema_method_##id##_in[] = { in NULL }; \
+	static GDBusArgInfo *schema_method_##id##_out[] = { out NULL }; \
+	static GDBusMethodInfo schema_method_##id = { \
+		-1, (gchar *) method_name, schema_method_##id##_in, schema_method_##id##_out, NULL };
+#define SCHEMA_PROPERTY_INFO(iface, id, property_name, signature) \
+	static GDBusPropertyInfo schema_property_##id = { \
+		-1, (gchar *) property_name, (gchar *) signature, G_DBUS_PROPERTY_INFO_FLAGS_READABLE, NULL };
+#define SCHEMA_SIGNAL_INFO(iface, id, signal_name, args) \
+	static GDBusArgInfo *schema_signal_##id##_args[] = { args NULL }; \
+	static GDBusSignalInfo schema_signal_##id = { \
+		-1, (gchar *) signal_name, schema_signal_##id##_args, NULL };
+#define SCHEMA_METHOD_POINTER(iface, id, method_name, in, out) &schema_method_##id,
+#define SCHEMA_PROPERTY_POINTER(iface, id, property_name, signature) &schema_property_##id,
+#define SCHEMA_SIGNAL_POINTER(iface, id, signal_name, args) &schema_signal_##id,
+#define SCHEMA_INTERFACE_INFO(id, iface_name, path, methods, properties, signals) \
+	methods (SCHEMA_METHOD_INFO, id) \
+	properties (SCHEMA_PROPERTY_INFO, id) \
+	signals (SCHEMA_SIGNAL_INFO, id) \
+	static GDBusMethodInfo *schema_interface_##id##_methods[] = { \
+		methods (SCHEMA_METHOD_POINTER, id) NULL }; \
+	static GDBusPropertyInfo *schema_interface_##id##_properties[] = { \
+		properties (SCHEMA_PROPERTY_POINTER, id) NULL }; \
+	static GDBusSignalInfo *schema_interface_##id##_signals[] = { \
+		signals (SCHEMA_SIGNAL_POINTER, id) NULL }; \
+	static GDBusInterfaceInfo schema_interface_##id = { \
+		-1, (gchar *) iface_name, schema_interface_##id##_methods, \
+		schema_interface_##id##_signals, schema_interface_##id##_properties, NULL };
+SCHEMA_INTERFACES (SCHEMA_INTERFACE_INFO)
+#undef SCHEMA_INTERFACE_INFO
+#undef SCHEMA_SIGNAL_POINTER
+#undef SCHEMA_PROPERTY_POINTER
+#undef SCHEMA_METHOD_POINTER
+#undef SCHEMA_SIGNAL_INFO
+#undef SCHEMA_PROPERTY_INFO
+#undef SCHEMA_METHOD_INFO
+#undef SCHEMA_ARG
+
+static const struct {
+	const char         *name;
+	const char         *path;
+	int                 props;
+	GDBusInterfaceInfo *info;
+} schema_interfaces[] = {
+#define SCHEMA_INTERFACE_ENTRY(id, iface_name, path, methods, properties, signals) \
+	{ iface_name, path, SCHEMA_PROPS_##id, &schema_interface_##id },
+	SCHEMA_INTERFACES (SCHEMA_INTERFACE_ENTRY)
+#undef SCHEMA_INTERFACE_ENTRY
+};
+
+static const struct {
+	SchemaInterface  iface;
+	const char      *name;
+} schema_methods[] = {
+#define SCHEMA_METHOD_ENTRY(iface, id, method_name, in, out) \
+	{ SCHEMA_INTERFACE_##iface, method_name },
+#define SCHEMA_INTERFACE_METHODS(id, iface_name, path, methods, properties, signals) methods (SCHEMA_METHOD_ENTRY, id)
+	SCHEMA_INTERFACES (SCHEMA_INTERFACE_METHODS)
+#undef SCHEMA_INTERFACE_METHODS
+#undef SCHEMA_METHOD_ENTRY
+};
+
+static const struct {
+	SchemaInterface  iface;
+	const char      *name;
+} schema_properties[] = {
+#define SCHEMA_PROPERTY_ENTRY(iface, id, property_name, signature) \
+	{ SCHEMA_INTERFACE_##iface, property_name },
+#define SCHEMA_INTERFACE_PROPERTIES(id, iface_name, path, methods, properties, signals) properties (SCHEMA_PROPERTY_ENTRY, id)
+	SCHEMA_INTERFACES (SCHEMA_INTERFACE_PROPERTIES)
+#undef SCHEMA_INTERFACE_PROPERTIES
+#undef SCHEMA_PROPERTY_ENTRY
+};
+
+static const struct {
+	SchemaInterface  iface;
+	const char      *name;
+} schema_signals[] = {
+#define SCHEMA_SIGNAL_ENTRY(iface, id, signal_name, args) \
+	{ SCHEMA_INTERFACE_##iface, signal_name },
+#define SCHEMA_INTERFACE_SIGNALS(id, iface_name, path, methods, properties, signals) signals (SCHEMA_SIGNAL_ENTRY, id)
+	SCHEMA_INTERFACES (SCHEMA_INTERFACE_SIGNALS)
+#undef SCHEMA_INTERFACE_SIGNALS
+#undef SCHEMA_SIGNAL_ENTRY
+};
+
+/* Any string can hash to a known name, one comparison settles it */
+
+SchemaInterface
+schema_lookup_interface (const char *name)
+{
+	SchemaInterface iface;
+
+	switch (schema_hash (name)) {
+#define SCHEMA_INTERFACE_CASE(id, iface_name, path, methods, properties, signals) \
+	case schema_hash (iface_name): iface = SCHEMA_INTERFACE_##id; break;
+	SCHEMA_INTERFACES (SCHEMA_INTERFACE_CASE)
+#undef SCHEMA_INTERFACE_CASE
+	default:
+		return SCHEMA_INTERFACE_INVALID;
+	}
+
+	if (strcmp (schema_interfaces[iface].name, name) != 0)
+		return SCHEMA_INTERFACE_INVALID;
+	return iface;
+}
+
+SchemaMethod
+schema_lookup_method (SchemaInterface  iface,
+		      const char      *name)
+{
+	SchemaMethod method;
+
+	switch (schema_hash (name)) {
+#define SCHEMA_METHOD_CASE(i, id, method_name, in, out) \
+	case schema_hash (method_name): method = SCHEMA_METHOD_##id; break;
+#define SCHEMA_INTERFACE_METHOD_CASES(id, iface_name, path, methods, properties, signals) methods (SCHEMA_METHOD_CASE, id)
+	SCHEMA_INTERFACES (SCHEMA_INTERFACE_METHOD_CASES)
+#undef SCHEMA_INTERFACE_METHOD_CASES
+#undef SCHEMA_METHOD_CASE
+	default:
+		return SCHEMA_METHOD_INVALID;
+	}
+
+	if (schema_methods[method].iface != iface ||
+	    strcmp (schema_methods[method].name, name) != 0)
+		return SCHEMA_METHOD_INVALID;
+	return method;
+}
+
+SchemaProperty
+schema_lookup_property (SchemaInterface  iface,
+			const char      *name)
+{
+	SchemaProperty property;
+
+	switch (schema_hash (name)) {
+#define SCHEMA_PROPERTY_CASE(i, id, property_name, signature) \
+	case schema_hash (property_name): property = SCHEMA_PROPERTY_##id; break;
+#define SCHEMA_INTERFACE_PROPERTY_CASES(id, iface_name, path, methods, properties, signals) properties (SCHEMA_PROPERTY_CASE, id)
+	SCHEMA_INTERFACES (SCHEMA_INTERFACE_PROPERTY_CASES)
+#undef SCHEMA_INTERFACE_PROPERTY_CASES
+#undef SCHEMA_PROPERTY_CASE
+	default:
+		return SCHEMA_PROPERTY_INVALID;
+	}
+
+	if (schema_properties[property].iface != iface ||
+	    strcmp (schema_properties[property].name, name) != 0)
+		return SCHEMA_PROPERTY_INVALID;
+	return property;
+}
+
+const char *
+schema_interface_name (SchemaInterface iface)
+{
+	g_return_val_if_fail (iface < SCHEMA_N_INTERFACES, NULL);
+	return schema_interfaces[iface].name;
+}
+
+const char *
+schema_interface_path (SchemaInterface iface)
+{
+	g_return_val_if_fail (iface < SCHEMA_N_INTERFACES, NULL);
+	return schema_interfaces[iface].path;
+}
+
+int
+schema_interface_props (SchemaInterface iface)
+{
+	g_return_val_if_fail (iface < SCHEMA_N_INTERFACES, 0);
+	return schema_interfaces[iface].props;
+}
+
+GDBusInterfaceInfo *
+schema_interface_info (SchemaInterface iface)
+{
+	g_return_val_if_fail (iface < SCHEMA_N_INTERFACES, NULL);
+	return schema_interfaces[iface].info;
+}
+
+const char *
+schema_property_name (SchemaProperty property)
+{
+	g_return_val_if_fail (property < SCHEMA_N_PROPERTIES, NULL);
+	return schema_properties[property].name;
+}
+
+SchemaInterface
+schema_property_interface (SchemaProperty property)
+{
+	g_return_val_if_fail (property < SCHEMA_N_PROPERTIES, SCHEMA_INTERFACE_INVALID);
+	return schema_properties[property].iface;
+}
+
+const char *
+schema_signal_name (SchemaSignal signal)
+{
+	g_return_val_if_fail (signal < SCHEMA_N_SIGNALS, NULL);
+	return schema_signals[signal].name;
+}
+
+SchemaInterface
+schema_signal_interface (SchemaSignal signal)
+{
+	g_return_val_if_fail (signal < SCHEMA_N_SIGNALS, SCHEMA_INTERFACE_INVALID);
+	return schema_signals[signal].iface;
+}
@@ -0,0 +1,276 @@
+/*
+ * Copyright (c) 2020 Erfan Abdi <erfangplus@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published by
+ * the Free Software Foundation.
+ *
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+
+/*
+ * The D-Bus API of the proxy, declared once. The introspection data, the
+ * method, property and signal lookups and the PROP_* emission bits are all
+ * generated from the lists below.
+ *
+ * net.hadess.SensorProxy and net.hadess.SensorProxy.Compass follow
+ * iio-sensor-proxy, the other interfaces are specific to this proxy.
+ */
+
+#define SENSOR_PROXY_DBUS_NAME "net.hadess.SensorProxy"
+
+/* X (arg, name, signature) */
+#define SCHEMA_ARGS(X) \
+	X (SENSOR, "sensor", "s") \
+	X (SENSORS, "sensors", "as") \
+	X (RATE, "rate", "u") \
+	X (PARAMS, "params", "a{sv}") \
+	X (VALUES, "values", "a{sv}") \
+	X (FD, "fd", "h") \
+	X (RING, "ring", "h") \
+	X (EVENT, "event", "h") \
+	X (TIMESTAMP, "timestamp", "t") \
+	X (STEPS, "steps", "u") \
+	X (DIRECTION, "direction", "s")
+
+/* Method lists: X (interface, method, name, in args, out args), with
+ * the args spelled SCHEMA_ARG (arg) one after the other.
+ * Property lists: X (interface, property, name, signature), all of them
+ * are read-only and each one gets its PROP_<property> bit.
+ * Signal lists: X (interface, signal, name, args), timestamps are
+ * monotonic, in usecs. */
+
+#define SCHEMA_MAIN_METHODS(X, i) \
+	X (i, CLAIM_ACCELEROMETER, "ClaimAccelerometer", , ) \
+	X (i, RELEASE_ACCELEROMETER, "ReleaseAccelerometer", , ) \
+	X (i, CLAIM_LIGHT, "ClaimLight", , ) \
+	X (i, RELEASE_LIGHT, "ReleaseLight", , ) \
+	X (i, CLAIM_PROXIMITY, "ClaimProximity", , ) \
+	X (i, RELEASE_PROXIMITY, "ReleaseProximity", , )
+
+/* Orientation is one of undefined, normal, bottom-up, left-up, right-up.
+ * The light level unit is "lux" or "vendor", a percentage of the maximum.
+ * The proximity value is the raw, device specific, reading */
+#define SCHEMA_MAIN_PROPERTIES(X, i) \
+	X (i, HAS_ACCELEROMETER, "HasAccelerometer", "b") \
+	X (i, ACCELEROMETER_ORIENTATION, "AccelerometerOrientation", "s") \
+	X (i, HAS_AMBIENT_LIGHT, "HasAmbientLight", "b") \
+	X (i, LIGHT_LEVEL_UNIT, "LightLevelUnit", "s") \
+	X (i, LIGHT_LEVEL, "LightLevel", "d") \
+	X (i, HAS_PROXIMITY, "HasProximity", "b") \
+	X (i, PROXIMITY_NEAR, "ProximityNear", "b") \
+	X (i, PROXIMITY_VALUE, "ProximityValue", "u")
+
+#define SCHEMA_COMPASS_METHODS(X, i) \
+	X (i, CLAIM_COMPASS, "ClaimCompass", , ) \
+	X (i, RELEASE_COMPASS, "ReleaseCompass", , )
+
+/* Heading in degrees clockwise from magnetic North, -1 when unknown */
+#define SCHEMA_COMPASS_PROPERTIES(X, i) \
+	X (i, HAS_COMPASS, "HasCompass", "b") \
+	X (i, COMPASS_HEADING, "CompassHeading", "d")
+
+#define SCHEMA_GYROSCOPE_METHODS(X, i) \
+	X (i, CLAIM_GYROSCOPE, "ClaimGyroscope", , ) \
+	X (i, RELEASE_GYROSCOPE, "ReleaseGyroscope", , )
+
+/* Attitude quaternion fused from the gyroscope and the accelerometer,
+ * see rotation-fusion.h */
+#define SCHEMA_GYROSCOPE_PROPERTIES(X, i) \
+	X (i, HAS_GYROSCOPE, "HasGyroscope", "b") \
+	X (i, ROTATION_VECTOR_W, "RotationVectorW", "d") \
+	X (i, ROTATION_VECTOR_X, "RotationVectorX", "d") \
+	X (i, ROTATION_VECTOR_Y, "RotationVectorY", "d") \
+	X (i, ROTATION_VECTOR_Z, "RotationVectorZ", "d")
+
+/* ResetAltitude makes the current pressure the altitude reference */
+#define SCHEMA_PRESSURE_METHODS(X, i) \
+	X (i, CLAIM_PRESSURE, "ClaimPressure", , ) \
+	X (i, RELEASE_PRESSURE, "ReleasePressure", , ) \
+	X (i, RESET_ALTITUDE, "ResetAltitude", , )
+
+/* Pressure in hPa, altitude in metres above the reference, which is the
+ * first reading unless reset */
+#define SCHEMA_PRESSURE_PROPERTIES(X, i) \
+	X (i, HAS_PRESSURE, "HasPressure", "b") \
+	X (i, PRESSURE, "Pressure", "d") \
+	X (i, ALTITUDE, "Altitude", "d")
+
+#define SCHEMA_TEMPERATURE_METHODS(X, i) \
+	X (i, CLAIM_TEMPERATURE, "ClaimTemperature", , ) \
+	X (i, RELEASE_TEMPERATURE, "ReleaseTemperature", , )
+
+/* Degrees Celsius */
+#define SCHEMA_TEMPERATURE_PROPERTIES(X, i) \
+	X (i, HAS_TEMPERATURE, "HasTemperature", "b") \
+	X (i, TEMPERATURE, "Temperature", "d")
+
+#define SCHEMA_HUMIDITY_METHODS(X, i) \
+	X (i, CLAIM_HUMIDITY, "ClaimHumidity", , ) \
+	X (i, RELEASE_HUMIDITY, "ReleaseHumidity", , )
+
+/* Percent */
+#define SCHEMA_HUMIDITY_PROPERTIES(X, i) \
+	X (i, HAS_HUMIDITY, "HasHumidity", "b") \
+	X (i, RELATIVE_HUMIDITY, "RelativeHumidity", "d")
+
+#define SCHEMA_STEP_COUNTER_METHODS(X, i) \
+	X (i, CLAIM_STEP_COUNTER, "ClaimStepCounter", , ) \
+	X (i, RELEASE_STEP_COUNTER, "ReleaseStepCounter", , )
+
+/* Steps counted since the proxy first read the counter, it never goes
+ * back, not even when the hub starts over */
+#define SCHEMA_STEP_COUNTER_PROPERTIES(X, i) \
+	X (i, HAS_STEP_COUNTER, "HasStepCounter", "b") \
+	X (i, STEP_COUNT, "StepCount", "u")
+
+/* The steps taken since the last signal, and when the last one was.
+ * With batching, one signal covers a whole batch */
+#define SCHEMA_STEP_COUNTER_SIGNALS(X, i) \
+	X (i, STEPS, "Steps", SCHEMA_ARG (TIMESTAMP) SCHEMA_ARG (STEPS))
+
+#define SCHEMA_TAP_METHODS(X, i) \
+	X (i, CLAIM_TAP, "ClaimTap", , ) \
+	X (i, RELEASE_TAP, "ReleaseTap", , )
+
+#define SCHEMA_TAP_PROPERTIES(X, i) \
+	X (i, HAS_TAP, "HasTap", "b")
+
+/* Detected by the hardware. The direction is one of x, y, z, left-right,
+ * right-left, top-bottom, bottom-top, face-back, back-face */
+#define SCHEMA_TAP_SIGNALS(X, i) \
+	X (i, TAP, "Tap", SCHEMA_ARG (TIMESTAMP) SCHEMA_ARG (DIRECTION)) \
+	X (i, DOUBLE_TAP, "DoubleTap", SCHEMA_ARG (TIMESTAMP) SCHEMA_ARG (DIRECTION))
+
+/* Significance filters of change-filter.h */
+#define SCHEMA_TUNING_METHODS(X, i) \
+	X (i, GET_CHANGE_FILTER, "GetChangeFilter", SCHEMA_ARG (SENSOR), SCHEMA_ARG (PARAMS)) \
+	X (i, SET_CHANGE_FILTER, "SetChangeFilter", SCHEMA_ARG (SENSOR) SCHEMA_ARG (PARAMS), )
+
+/* Shared page of sensor-state.h */
+#define SCHEMA_SNAPSHOT_METHODS(X, i) \
+	X (i, OPEN_SNAPSHOT, "OpenSnapshot", , SCHEMA_ARG (FD))
+
+/* Sample rings of sample-stream.h */
+#define SCHEMA_STREAM_METHODS(X, i) \
+	X (i, OPEN_STREAM, "OpenStream", SCHEMA_ARG (SENSOR) SCHEMA_ARG (RATE), SCHEMA_ARG (RING) SCHEMA_ARG (EVENT)) \
+	X (i, CLOSE_STREAM, "CloseStream", SCHEMA_ARG (SENSOR), )
+
+/* Claims several sensors and returns their values in one round trip */
+#define SCHEMA_BATCH_METHODS(X, i) \
+	X (i, CLAIM_MULTIPLE, "ClaimMultiple", SCHEMA_ARG (SENSORS), SCHEMA_ARG (VALUES)) \
+	X (i, RELEASE_MULTIPLE, "ReleaseMultiple", SCHEMA_ARG (SENSORS), )
+
+#define SCHEMA_NO_PROPERTIES(X, i)
+#define SCHEMA_NO_SIGNALS(X, i)
+
+/* X (interface, name, object path, methods, properties, signals) */
+#define SCHEMA_INTERFACES(X) \
+	X (MAIN, SENSOR_PROXY_DBUS_NAME, "/net/hadess/SensorProxy", \
+	   SCHEMA_MAIN_METHODS, SCHEMA_MAIN_PROPERTIES, SCHEMA_NO_SIGNALS) \
+	X (COMPASS, SENSOR_PROXY_DBUS_NAME ".Compass", "/net/hadess/SensorProxy/Compass", \
+	   SCHEMA_COMPASS_METHODS, SCHEMA_COMPASS_PROPERTIES, SCHEMA_NO_SIGNALS) \
+	X (GYROSCOPE, SENSOR_PROXY_DBUS_NAME ".Gyroscope", "/net/hadess/SensorProxy/Gyroscope", \
+	   SCHEMA_GYROSCOPE_METHODS, SCHEMA_GYROSCOPE_PROPERTIES, SCHEMA_NO_SIGNALS) \
+	X (PRESSURE, SENSOR_PROXY_DBUS_NAME ".Pressure", "/net/hadess/SensorProxy/Pressure", \
+	   SCHEMA_PRESSURE_METHODS, SCHEMA_PRESSURE_PROPERTIES, SCHEMA_NO_SIGNALS) \
+	X (TEMPERATURE, SENSOR_PROXY_DBUS_NAME ".Temperature", "/net/hadess/SensorProxy/Temperature", \
+	   SCHEMA_TEMPERATURE_METHODS, SCHEMA_TEMPERATURE_PROPERTIES, SCHEMA_NO_SIGNALS) \
+	X (HUMIDITY, SENSOR_PROXY_DBUS_NAME ".Humidity", "/net/hadess/SensorProxy/Humidity", \
+	   SCHEMA_HUMIDITY_METHODS, SCHEMA_HUMIDITY_PROPERTIES, SCHEMA_NO_SIGNALS) \
+	X (STEP_COUNTER, SENSOR_PROXY_DBUS_NAME ".StepCounter", "/net/hadess/SensorProxy/StepCounter", \
+	   SCHEMA_STEP_COUNTER_METHODS, SCHEMA_STEP_COUNTER_PROPERTIES, SCHEMA_STEP_COUNTER_SIGNALS) \
+	X (TAP, SENSOR_PROXY_DBUS_NAME ".Tap", "/net/hadess/SensorProxy/Tap", \
+	   SCHEMA_TAP_METHODS, SCHEMA_TAP_PROPERTIES, SCHEMA_TAP_SIGNALS) \
+	X (TUNING, SENSOR_PROXY_DBUS_NAME ".Tuning", "/net/hadess/SensorProxy", \
+	   SCHEMA_TUNING_METHODS, SCHEMA_NO_PROPERTIES, SCHEMA_NO_SIGNALS) \
+	X (SNAPSHOT, SENSOR_PROXY_DBUS_NAME ".Snapshot", "/net/hadess/SensorProxy", \
+	   SCHEMA_SNAPSHOT_METHODS, SCHEMA_NO_PROPERTIES, SCHEMA_NO_SIGNALS) \
+	X (STREAM, SENSOR_PROXY_DBUS_NAME ".Stream", "/net/hadess/SensorProxy", \
+	   SCHEMA_STREAM_METHODS, SCHEMA_NO_PROPERTIES, SCHEMA_NO_SIGNALS) \
+	X (BATCH, SENSOR_PROXY_DBUS_NAME ".Batch", "/net/hadess/SensorProxy", \
+	   SCHEMA_BATCH_METHODS, SCHEMA_NO_PROPERTIES, SCHEMA_NO_SIGNALS)
+
+/* Generated from the lists above */
+
+#define SCHEMA_INTERFACE_ENUM(id, name, path, methods, properties, signals) SCHEMA_INTERFACE_##id,
+typedef enum {
+	SCHEMA_INTERFACES (SCHEMA_INTERFACE_ENUM)
+	SCHEMA_N_INTERFACES,
+	SCHEMA_INTERFACE_INVALID = SCHEMA_N_INTERFACES
+} SchemaInterface;
+#undef SCHEMA_INTERFACE_ENUM
+
+#define SCHEMA_METHOD_ENUM(iface, id, name, in, out) SCHEMA_METHOD_##id,
+#define SCHEMA_INTERFACE_METHODS(id, name, path, methods, properties, signals) methods (SCHEMA_METHOD_ENUM, id)
+typedef enum {
+	SCHEMA_INTERFACES (SCHEMA_INTERFACE_METHODS)
+	SCHEMA_N_METHODS,
+	SCHEMA_METHOD_INVALID = SCHEMA_N_METHODS
+} SchemaMethod;
+#undef SCHEMA_INTERFACE_METHODS
+#undef SCHEMA_METHOD_ENUM
+
+#define SCHEMA_PROPERTY_ENUM(iface, id, name, signature) SCHEMA_PROPERTY_##id,
+#define SCHEMA_INTERFACE_PROPERTIES(id, name, path, methods, properties, signals) properties (SCHEMA_PROPERTY_ENUM, id)
+typedef enum {
+	SCHEMA_INTERFACES (SCHEMA_INTERFACE_PROPERTIES)
+	SCHEMA_N_PROPERTIES,
+	SCHEMA_PROPERTY_INVALID = SCHEMA_N_PROPERTIES
+} SchemaProperty;
+#undef SCHEMA_INTERFACE_PROPERTIES
+#undef SCHEMA_PROPERTY_ENUM
+
+#define SCHEMA_SIGNAL_ENUM(iface, id, name, args) SCHEMA_SIGNAL_##id,
+#define SCHEMA_INTERFACE_SIGNALS(id, name, path, methods, properties, signals) signals (SCHEMA_SIGNAL_ENUM, id)
+typedef enum {
+	SCHEMA_INTERFACES (SCHEMA_INTERFACE_SIGNALS)
+	SCHEMA_N_SIGNALS,
+	SCHEMA_SIGNAL_INVALID = SCHEMA_N_SIGNALS
+} SchemaSignal;
+#undef SCHEMA_INTERFACE_SIGNALS
+#undef SCHEMA_SIGNAL_ENUM
+
+#define SCHEMA_PROPERTY_BIT(iface, id, name, signature) PROP_##id = 1 << SCHEMA_PROPERTY_##id,
+#define SCHEMA_INTERFACE_PROPERTY_BITS(id, name, path, methods, properties, signals) properties (SCHEMA_PROPERTY_BIT, id)
+enum {
+	SCHEMA_INTERFACES (SCHEMA_INTERFACE_PROPERTY_BITS)
+};
+#undef SCHEMA_INTERFACE_PROPERTY_BITS
+#undef SCHEMA_PROPERTY_BIT
+
+/* SCHEMA_PROPS_<interface>, all the property bits of an interface, and
+ * SCHEMA_PROPS_ALL, those of every interface */
+#define SCHEMA_PROPERTY_OR_BIT(iface, id, name, signature) | PROP_##id
+#define SCHEMA_INTERFACE_PROPS(id, name, path, methods, properties, signals) \
+	SCHEMA_PROPS_##id = 0 properties (SCHEMA_PROPERTY_OR_BIT, id),
+#define SCHEMA_INTERFACE_OR_PROPS(id, name, path, methods, properties, signals) \
+	properties (SCHEMA_PROPERTY_OR_BIT, id)
+enum {
+	SCHEMA_INTERFACES (SCHEMA_INTERFACE_PROPS)
+	SCHEMA_PROPS_ALL = 0 SCHEMA_INTERFACES (SCHEMA_INTERFACE_OR_PROPS)
+};
+#undef SCHEMA_INTERFACE_OR_PROPS
+#undef SCHEMA_INTERFACE_PROPS
+#undef SCHEMA_PROPERTY_OR_BIT
+
+/* Lookups are O(1), invalid when unknown or not on @iface */
+SchemaInterface     schema_lookup_interface   (const char      *name);
+SchemaMethod        schema_lookup_method      (SchemaInterface  iface,
+					       const char      *name);
+SchemaProperty      schema_lookup_property    (SchemaInterface  iface,
+					       const char      *name);
+
+const char         *schema_interface_name     (SchemaInterface  iface);
+const char         *schema_interface_path     (SchemaInterface  iface);
+int                 schema_interface_props    (SchemaInterface  iface);
+GDBusInterfaceInfo *schema_interface_info     (SchemaInterface  iface);
+
+const char         *schema_property_name      (SchemaProperty   property);
+SchemaInterface     schema_property_interface (SchemaProperty   property);
+
+const char         *schema_signal_name        (SchemaSignal     signal);
+SchemaInterface     schema_signal_interface   (SchemaSignal     signal);
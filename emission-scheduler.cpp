@@ -0,0 +1,209 @@
+/*
+ * Copyright (c) 2020 Erfan Abdi <erfangplus@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published by
+ * the Free Software Foundation.
+ *
+ */
+
+#include <atomic>
+
+#include "emission-scheduler.h"
+
+#define NUM_PROPS 32
+
+typedef struct {
+	GSource            source;
+	EmissionScheduler *scheduler;
+} WakeSource;
+
+struct _EmissionScheduler {
+	/* The only fields the sensor threads touch */
+	std::atomic<guint32> queued;
+	GSource           *wake;
+
+	/* Everything below belongs to the main context */
+	GMainContext      *context;
+	GSource           *source;
+	gint64             source_due;
+
+	guint              window_ms;
+	guint              pending;
+	gint64             min_interval[NUM_PROPS]; /* usecs, 0 when uncapped */
+	gint64             rate_interval[NUM_PROPS];
+	gint64             dwell[NUM_PROPS];
+	gint64             last_emit[NUM_PROPS];
+
+	EmissionFlushFunc  flush;
+	gpointer           user_data;
+};
+
+static gboolean flush_cb (gpointer user_data);
+
+/* An already scheduled flush is only moved earlier, so a rate-capped
+ * property waiting for its slot does not hold back an uncapped one */
+static void
+schedule_flush (EmissionScheduler *scheduler,
+		gint64             now,
+		guint              delay_ms)
+{
+	gint64 due = now + (gint64) delay_ms * 1000;
+
+	if (scheduler->source != NULL) {
+		if (scheduler->source_due <= due)
+			return;
+		g_source_destroy (scheduler->source);
+		g_source_unref (scheduler->source);
+	}
+
+	scheduler->source_due = due;
+	scheduler->source = g_timeout_source_new (delay_ms);
+	g_source_set_callback (scheduler->source, flush_cb, scheduler, NULL);
+	g_source_attach (scheduler->source, scheduler->context);
+}
+
+static gboolean
+flush_cb (gpointer user_data)
+{
+	EmissionScheduler *scheduler = (EmissionScheduler *) user_data;
+	gint64 now, next_due;
+	guint due = 0;
+	guint i;
+
+	now = g_get_monotonic_time ();
+	next_due = G_MAXINT64;
+
+	/* Bits queued from here on wake the main context again */
+	scheduler->pending |= scheduler->queued.exchange (0, std::memory_order_acquire);
+
+	for (i = 0; i < NUM_PROPS; i++) {
+		guint bit = 1u << i;
+		gint64 ready_at;
+
+		if (!(scheduler->pending & bit))
+			continue;
+
+		ready_at = scheduler->last_emit[i] + scheduler->min_interval[i];
+		if (scheduler->min_interval[i] == 0 || ready_at <= now) {
+			due |= bit;
+			scheduler->last_emit[i] = now;
+		} else {
+			next_due = MIN (next_due, ready_at);
+		}
+	}
+
+	scheduler->pending &= ~due;
+	g_source_unref (scheduler->source);
+	scheduler->source = NULL;
+
+	/* Rate-capped properties go out as soon as they are allowed to */
+	if (scheduler->pending != 0)
+		schedule_flush (scheduler, now, (next_due - now + 999) / 1000);
+
+	if (due != 0)
+		scheduler->flush (due, scheduler->user_data);
+
+	return G_SOURCE_REMOVE;
+}
+
+/* Runs on the main context once something was queued while nothing was */
+static gboolean
+wake_dispatch (GSource     *source,
+	       GSourceFunc  callback,
+	       gpointer     user_data)
+{
+	EmissionScheduler *scheduler = ((WakeSource *) source)->scheduler;
+
+	g_source_set_ready_time (source, -1);
+	schedule_flush (scheduler, g_get_monotonic_time (), scheduler->window_ms);
+
+	return G_SOURCE_CONTINUE;
+}
+
+static GSourceFuncs wake_funcs = {
+	NULL,
+	NULL,
+	wake_dispatch,
+	NULL,
+};
+
+EmissionScheduler *
+emission_scheduler_new (guint              window_ms,
+			EmissionFlushFunc  flush,
+			gpointer           user_data)
+{
+	EmissionScheduler *scheduler;
+
+	scheduler = g_new0 (EmissionScheduler, 1);
+	scheduler->queued = 0;
+	scheduler->context = g_main_context_ref (g_main_context_default ());
+	scheduler->window_ms = window_ms;
+	scheduler->flush = flush;
+	scheduler->user_data = user_data;
+
+	scheduler->wake = g_source_new (&wake_funcs, sizeof (WakeSource));
+	((WakeSource *) scheduler->wake)->scheduler = scheduler;
+	g_source_attach (scheduler->wake, scheduler->context);
+
+	return scheduler;
+}
+
+void
+emission_scheduler_free (EmissionScheduler *scheduler)
+{
+	if (scheduler == NULL)
+		return;
+
+	g_source_destroy (scheduler->wake);
+	g_source_unref (scheduler->wake);
+	if (scheduler->source != NULL) {
+		g_source_destroy (scheduler->source);
+		g_source_unref (scheduler->source);
+	}
+	g_main_context_unref (scheduler->context);
+	g_free (scheduler);
+}
+
+void
+emission_scheduler_set_max_rate (EmissionScheduler *scheduler,
+				 guint              mask,
+				 guint              max_hz)
+{
+	guint i;
+
+	for (i = 0; i < NUM_PROPS; i++) {
+		if (!(mask & (1u << i)))
+			continue;
+		scheduler->rate_interval[i] = max_hz ? G_USEC_PER_SEC / max_hz : 0;
+		scheduler->min_interval[i] = MAX (scheduler->rate_interval[i], scheduler->dwell[i]);
+	}
+}
+
+void
+emission_scheduler_set_dwell (EmissionScheduler *scheduler,
+			      guint              mask,
+			      guint              dwell_ms)
+{
+	guint i;
+
+	for (i = 0; i < NUM_PROPS; i++) {
+		if (!(mask & (1u << i)))
+			continue;
+		scheduler->dwell[i] = (gint64) dwell_ms * 1000;
+		scheduler->min_interval[i] = MAX (scheduler->rate_interval[i], scheduler->dwell[i]);
+	}
+}
+
+/* Only the first bits queued after a flush cost a wakeup, the rest is
+ * a single atomic or */
+void
+emission_scheduler_queue (EmissionScheduler *scheduler,
+			  guint              mask)
+{
+	if (mask == 0)
+		return;
+
+	if (scheduler->queued.fetch_or (mask, std::memory_order_release) == 0)
+		g_source_set_ready_time (scheduler->wake, 0);
+}
@@ -0,0 +1,43 @@
+/*
+ * Copyright (c) 2020 Erfan Abdi <erfangplus@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published by
+ * the Free Software Foundation.
+ *
+ */
+
+#pragma once
+
+#include <glib.h>
+
+/*
+ * Collects property dirty bits from any thread, without taking a lock,
+ * and flushes them on the main context, at most once per window.
+ * Properties with a rate cap or a dwell time stay pending until their
+ * minimum interval has elapsed, so the flush callback always ends up
+ * seeing the latest value.
+ */
+
+typedef void (*EmissionFlushFunc) (guint    mask,
+				   gpointer user_data);
+
+typedef struct _EmissionScheduler EmissionScheduler;
+
+EmissionScheduler *emission_scheduler_new          (guint              window_ms,
+						    EmissionFlushFunc  flush,
+						    gpointer           user_data);
+void               emission_scheduler_free         (EmissionScheduler *scheduler);
+
+/* The setters are only called from the main context */
+void               emission_scheduler_set_max_rate (EmissionScheduler *scheduler,
+						    guint              mask,
+						    guint              max_hz);
+/* How long an emitted value is held, see change-filter.h. Whichever
+ * of that and the rate cap is longer applies */
+void               emission_scheduler_set_dwell    (EmissionScheduler *scheduler,
+						    guint              mask,
+						    guint              dwell_ms);
+/* From any thread */
+void               emission_scheduler_queue        (EmissionScheduler *scheduler,
+						    guint              mask);
@@ -1,1118 +0,0 @@
-#include <gio/gio.h>
-
-#if defined (__ELF__) && ( __GNUC__ > 2 || (__GNUC__ == 2 && __GNUC_MINOR__ >= 6))
-# define SECTION __attribute__ ((section (".gresource.iio_sensor_proxy"), aligned (8)))
-#else
-# define SECTION
-#endif
-
-#ifdef _MSC_VER
-static const SECTION union { const guint8 data[7597]; const double alignment; void * const ptr;}  iio_sensor_proxy_resource_data = { {
-  0107, 0126, 0141, 0162, 0151, 0141, 0156, 0164, 0000, 0000, 0000, 0000, 0000, 0000, 0000, 0000, 
-  0030, 0000, 0000, 0000, 0254, 0000, 0000, 0000, 0000, 0000, 0000, 0050, 0005, 0000, 0000, 0000, 
-  0000, 0000, 0000, 0000, 0003, 0000, 0000, 0000, 0003, 0000, 0000, 0000, 0003, 0000, 0000, 0000, 
-  0005, 0000, 0000, 0000, 0324, 0265, 0002, 0000, 0377, 0377, 0377, 0377, 0254, 0000, 0000, 0000, 
-  0001, 0000, 0114, 0000, 0260, 0000, 0000, 0000, 0264, 0000, 0000, 0000, 0112, 0216, 0217, 0013, 
-  0000, 0000, 0000, 0000, 0264, 0000, 0000, 0000, 0004, 0000, 0114, 0000, 0270, 0000, 0000, 0000, 
-  0274, 0000, 0000, 0000, 0322, 0324, 0141, 0114, 0004, 0000, 0000, 0000, 0274, 0000, 0000, 0000, 
-  0032, 0000, 0166, 0000, 0330, 0000, 0000, 0000, 0216, 0035, 0000, 0000, 0121, 0127, 0003, 0223, 
-  0001, 0000, 0000, 0000, 0216, 0035, 0000, 0000, 0007, 0000, 0114, 0000, 0230, 0035, 0000, 0000, 
-  0234, 0035, 0000, 0000, 0034, 0245, 0240, 0240, 0003, 0000, 0000, 0000, 0234, 0035, 0000, 0000, 
-  0014, 0000, 0114, 0000, 0250, 0035, 0000, 0000, 0254, 0035, 0000, 0000, 0057, 0000, 0000, 0000, 
-  0001, 0000, 0000, 0000, 0156, 0145, 0164, 0057, 0003, 0000, 0000, 0000, 0156, 0145, 0164, 0056, 
-  0150, 0141, 0144, 0145, 0163, 0163, 0056, 0123, 0145, 0156, 0163, 0157, 0162, 0120, 0162, 0157, 
-  0170, 0171, 0056, 0170, 0155, 0154, 0000, 0000, 0246, 0034, 0000, 0000, 0000, 0000, 0000, 0000, 
-  0074, 0077, 0170, 0155, 0154, 0040, 0166, 0145, 0162, 0163, 0151, 0157, 0156, 0075, 0042, 0061, 
-  0056, 0060, 0042, 0077, 0076, 0012, 0074, 0041, 0104, 0117, 0103, 0124, 0131, 0120, 0105, 0040, 
-  0156, 0157, 0144, 0145, 0040, 0120, 0125, 0102, 0114, 0111, 0103, 0040, 0042, 0055, 0057, 0057, 
-  0146, 0162, 0145, 0145, 0144, 0145, 0163, 0153, 0164, 0157, 0160, 0057, 0057, 0104, 0124, 0104, 
-  0040, 0104, 0055, 0102, 0125, 0123, 0040, 0117, 0142, 0152, 0145, 0143, 0164, 0040, 0111, 0156, 
-  0164, 0162, 0157, 0163, 0160, 0145, 0143, 0164, 0151, 0157, 0156, 0040, 0061, 0056, 0060, 0057, 
-  0057, 0105, 0116, 0042, 0040, 0042, 0150, 0164, 0164, 0160, 0072, 0057, 0057, 0167, 0167, 0167, 
-  0056, 0146, 0162, 0145, 0145, 0144, 0145, 0163, 0153, 0164, 0157, 0160, 0056, 0157, 0162, 0147, 
-  0057, 0163, 0164, 0141, 0156, 0144, 0141, 0162, 0144, 0163, 0057, 0144, 0142, 0165, 0163, 0057, 
-  0061, 0056, 0060, 0057, 0151, 0156, 0164, 0162, 0157, 0163, 0160, 0145, 0143, 0164, 0056, 0144, 
-  0164, 0144, 0042, 0076, 0012, 0074, 0156, 0157, 0144, 0145, 0076, 0074, 0041, 0055, 0055, 0012, 
-  0040, 0040, 0040, 0040, 0040, 0040, 0156, 0145, 0164, 0056, 0150, 0141, 0144, 0145, 0163, 0163, 
-  0056, 0123, 0145, 0156, 0163, 0157, 0162, 0120, 0162, 0157, 0170, 0171, 0072, 0012, 0040, 0040, 
-  0040, 0040, 0040, 0040, 0100, 0163, 0150, 0157, 0162, 0164, 0137, 0144, 0145, 0163, 0143, 0162, 
-  0151, 0160, 0164, 0151, 0157, 0156, 0072, 0040, 0104, 0055, 0102, 0165, 0163, 0040, 0160, 0162, 
-  0157, 0170, 0171, 0040, 0164, 0157, 0040, 0141, 0143, 0143, 0145, 0163, 0163, 0040, 0150, 0141, 
-  0162, 0144, 0167, 0141, 0162, 0145, 0040, 0163, 0145, 0156, 0163, 0157, 0162, 0163, 0012, 0012, 
-  0040, 0040, 0040, 0040, 0040, 0040, 0101, 0146, 0164, 0145, 0162, 0040, 0143, 0150, 0145, 0143, 
-  0153, 0151, 0156, 0147, 0040, 0164, 0150, 0145, 0040, 0141, 0166, 0141, 0151, 0154, 0141, 0142, 
-  0151, 0154, 0151, 0164, 0171, 0040, 0157, 0146, 0040, 0164, 0150, 0145, 0040, 0163, 0145, 0156, 
-  0163, 0157, 0162, 0040, 0164, 0171, 0160, 0145, 0040, 0171, 0157, 0165, 0040, 0167, 0141, 0156, 
-  0164, 0040, 0164, 0157, 0040, 0155, 0157, 0156, 0151, 0164, 0157, 0162, 0054, 0012, 0040, 0040, 
-  0040, 0040, 0040, 0040, 0143, 0141, 0154, 0154, 0040, 0164, 0150, 0145, 0040, 0156, 0145, 0164, 
-  0056, 0150, 0141, 0144, 0145, 0163, 0163, 0056, 0123, 0145, 0156, 0163, 0157, 0162, 0120, 0162, 
-  0157, 0170, 0171, 0056, 0103, 0154, 0141, 0151, 0155, 0101, 0143, 0143, 0145, 0154, 0145, 0162, 
-  0157, 0155, 0145, 0164, 0145, 0162, 0050, 0051, 0040, 0157, 0162, 0040, 0164, 0150, 0145, 0012, 
-  0040, 0040, 0040, 0040, 0040, 0040, 0156, 0145, 0164, 0056, 0150, 0141, 0144, 0145, 0163, 0163, 
-  0056, 0123, 0145, 0156, 0163, 0157, 0162, 0120, 0162, 0157, 0170, 0171, 0056, 0103, 0154, 0141, 
-  0151, 0155, 0114, 0151, 0147, 0150, 0164, 0050, 0051, 0040, 0155, 0145, 0164, 0150, 0157, 0144, 
-  0040, 0164, 0157, 0040, 0163, 0164, 0141, 0162, 0164, 0040, 0165, 0160, 0144, 0141, 0164, 0151, 
-  0156, 0147, 0040, 0164, 0150, 0145, 0040, 0160, 0162, 0157, 0160, 0145, 0162, 0164, 0151, 0145, 
-  0163, 0012, 0040, 0040, 0040, 0040, 0040, 0040, 0146, 0162, 0157, 0155, 0040, 0164, 0150, 0145, 
-  0040, 0150, 0141, 0162, 0144, 0167, 0141, 0162, 0145, 0040, 0162, 0145, 0141, 0144, 0151, 0156, 
-  0147, 0163, 0056, 0012, 0012, 0040, 0040, 0040, 0040, 0040, 0040, 0124, 0150, 0145, 0040, 0157, 
-  0142, 0152, 0145, 0143, 0164, 0040, 0160, 0141, 0164, 0150, 0040, 0167, 0151, 0154, 0154, 0040, 
-  0142, 0145, 0040, 0042, 0057, 0156, 0145, 0164, 0057, 0150, 0141, 0144, 0145, 0163, 0163, 0057, 
-  0123, 0145, 0156, 0163, 0157, 0162, 0120, 0162, 0157, 0170, 0171, 0042, 0056, 0012, 0040, 0040, 
-  0055, 0055, 0076, 0074, 0151, 0156, 0164, 0145, 0162, 0146, 0141, 0143, 0145, 0040, 0156, 0141, 
-  0155, 0145, 0075, 0042, 0156, 0145, 0164, 0056, 0150, 0141, 0144, 0145, 0163, 0163, 0056, 0123, 
-  0145, 0156, 0163, 0157, 0162, 0120, 0162, 0157, 0170, 0171, 0042, 0076, 0074, 0041, 0055, 0055, 
-  0012, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0110, 0141, 0163, 0101, 0143, 0143, 0145, 
-  0154, 0145, 0162, 0157, 0155, 0145, 0164, 0145, 0162, 0072, 0012, 0012, 0040, 0040, 0040, 0040, 
-  0040, 0040, 0040, 0040, 0127, 0150, 0145, 0164, 0150, 0145, 0162, 0040, 0141, 0040, 0163, 0165, 
-  0160, 0160, 0157, 0162, 0164, 0145, 0144, 0040, 0141, 0143, 0143, 0145, 0154, 0145, 0162, 0157, 
-  0155, 0145, 0164, 0145, 0162, 0040, 0151, 0163, 0040, 0160, 0162, 0145, 0163, 0145, 0156, 0164, 
-  0040, 0157, 0156, 0040, 0164, 0150, 0145, 0040, 0163, 0171, 0163, 0164, 0145, 0155, 0056, 0012, 
-  0040, 0040, 0040, 0040, 0055, 0055, 0076, 0074, 0160, 0162, 0157, 0160, 0145, 0162, 0164, 0171, 
-  0040, 0156, 0141, 0155, 0145, 0075, 0042, 0110, 0141, 0163, 0101, 0143, 0143, 0145, 0154, 0145, 
-  0162, 0157, 0155, 0145, 0164, 0145, 0162, 0042, 0040, 0164, 0171, 0160, 0145, 0075, 0042, 0142, 
-  0042, 0040, 0141, 0143, 0143, 0145, 0163, 0163, 0075, 0042, 0162, 0145, 0141, 0144, 0042, 0057, 
-  0076, 0074, 0041, 0055, 0055, 0012, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0101, 0143, 
-  0143, 0145, 0154, 0145, 0162, 0157, 0155, 0145, 0164, 0145, 0162, 0117, 0162, 0151, 0145, 0156, 
-  0164, 0141, 0164, 0151, 0157, 0156, 0072, 0012, 0012, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 
-  0040, 0124, 0150, 0145, 0040, 0144, 0145, 0164, 0145, 0143, 0164, 0145, 0144, 0040, 0157, 0162, 
-  0151, 0145, 0156, 0164, 0141, 0164, 0151, 0157, 0156, 0040, 0157, 0146, 0040, 0164, 0150, 0145, 
-  0040, 0164, 0141, 0142, 0154, 0145, 0164, 0040, 0157, 0162, 0040, 0154, 0141, 0160, 0164, 0157, 
-  0160, 0056, 0012, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0120, 0157, 0163, 0163, 0151, 
-  0142, 0154, 0145, 0040, 0166, 0141, 0154, 0165, 0145, 0163, 0040, 0141, 0162, 0145, 0072, 0012, 
-  0040, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0055, 0040, 0165, 0156, 0144, 0145, 0146, 0151, 
-  0156, 0145, 0144, 0012, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0055, 0040, 0156, 0157, 
-  0162, 0155, 0141, 0154, 0012, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0055, 0040, 0142, 
-  0157, 0164, 0164, 0157, 0155, 0055, 0165, 0160, 0012, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 
-  0040, 0055, 0040, 0154, 0145, 0146, 0164, 0055, 0165, 0160, 0012, 0040, 0040, 0040, 0040, 0040, 
-  0040, 0040, 0040, 0055, 0040, 0162, 0151, 0147, 0150, 0164, 0055, 0165, 0160, 0012, 0040, 0040, 
-  0040, 0040, 0055, 0055, 0076, 0074, 0160, 0162, 0157, 0160, 0145, 0162, 0164, 0171, 0040, 0156, 
-  0141, 0155, 0145, 0075, 0042, 0101, 0143, 0143, 0145, 0154, 0145, 0162, 0157, 0155, 0145, 0164, 
-  0145, 0162, 0117, 0162, 0151, 0145, 0156, 0164, 0141, 0164, 0151, 0157, 0156, 0042, 0040, 0164, 
-  0171, 0160, 0145, 0075, 0042, 0163, 0042, 0040, 0141, 0143, 0143, 0145, 0163, 0163, 0075, 0042, 
-  0162, 0145, 0141, 0144, 0042, 0057, 0076, 0074, 0041, 0055, 0055, 0012, 0040, 0040, 0040, 0040, 
-  0040, 0040, 0040, 0040, 0110, 0141, 0163, 0101, 0155, 0142, 0151, 0145, 0156, 0164, 0114, 0151, 
-  0147, 0150, 0164, 0072, 0012, 0012, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0127, 0150, 
-  0145, 0164, 0150, 0145, 0162, 0040, 0141, 0040, 0163, 0165, 0160, 0160, 0157, 0162, 0164, 0145, 
-  0144, 0040, 0141, 0155, 0142, 0151, 0145, 0156, 0164, 0040, 0154, 0151, 0147, 0150, 0164, 0040, 
-  0163, 0145, 0156, 0163, 0157, 0162, 0040, 0151, 0163, 0040, 0160, 0162, 0145, 0163, 0145, 0156, 
-  0164, 0040, 0157, 0156, 0040, 0164, 0150, 0145, 0040, 0163, 0171, 0163, 0164, 0145, 0155, 0056, 
-  0012, 0040, 0040, 0040, 0040, 0055, 0055, 0076, 0074, 0160, 0162, 0157, 0160, 0145, 0162, 0164, 
-  0171, 0040, 0156, 0141, 0155, 0145, 0075, 0042, 0110, 0141, 0163, 0101, 0155, 0142, 0151, 0145, 
-  0156, 0164, 0114, 0151, 0147, 0150, 0164, 0042, 0040, 0164, 0171, 0160, 0145, 0075, 0042, 0142, 
-  0042, 0040, 0141, 0143, 0143, 0145, 0163, 0163, 0075, 0042, 0162, 0145, 0141, 0144, 0042, 0057, 
-  0076, 0074, 0041, 0055, 0055, 0012, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0114, 0151, 
-  0147, 0150, 0164, 0114, 0145, 0166, 0145, 0154, 0125, 0156, 0151, 0164, 0072, 0012, 0012, 0040, 
-  0040, 0040, 0040, 0040, 0040, 0040, 0040, 0124, 0150, 0145, 0040, 0165, 0156, 0151, 0164, 0040, 
-  0165, 0163, 0145, 0144, 0040, 0151, 0156, 0040, 0101, 0155, 0142, 0151, 0145, 0156, 0164, 0040, 
-  0114, 0151, 0147, 0150, 0164, 0040, 0123, 0145, 0156, 0163, 0157, 0162, 0040, 0162, 0145, 0141, 
-  0144, 0151, 0156, 0147, 0163, 0056, 0040, 0111, 0164, 0040, 0151, 0163, 0012, 0040, 0040, 0040, 
-  0040, 0040, 0040, 0040, 0040, 0157, 0156, 0145, 0040, 0157, 0146, 0040, 0145, 0151, 0164, 0150, 
-  0145, 0162, 0040, 0042, 0154, 0165, 0170, 0042, 0040, 0157, 0162, 0040, 0042, 0166, 0145, 0156, 
-  0144, 0157, 0162, 0042, 0056, 0012, 0012, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0116, 
-  0157, 0164, 0145, 0040, 0164, 0150, 0141, 0164, 0040, 0144, 0151, 0146, 0146, 0145, 0162, 0145, 
-  0156, 0164, 0040, 0150, 0141, 0162, 0144, 0167, 0141, 0162, 0145, 0040, 0167, 0151, 0154, 0154, 
-  0040, 0150, 0141, 0166, 0145, 0040, 0144, 0151, 0146, 0146, 0145, 0162, 0145, 0156, 0164, 0040, 
-  0162, 0145, 0141, 0144, 0151, 0156, 0147, 0163, 0040, 0151, 0156, 0040, 0164, 0150, 0145, 0012, 
-  0040, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0163, 0141, 0155, 0145, 0040, 0143, 0157, 0156, 
-  0144, 0151, 0164, 0151, 0157, 0156, 0054, 0040, 0163, 0157, 0040, 0166, 0141, 0154, 0165, 0145, 
-  0163, 0040, 0163, 0150, 0157, 0165, 0154, 0144, 0040, 0142, 0145, 0040, 0164, 0141, 0153, 0145, 
-  0156, 0040, 0141, 0163, 0040, 0162, 0145, 0154, 0141, 0164, 0151, 0166, 0145, 0056, 0012, 0012, 
-  0040, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0127, 0150, 0145, 0156, 0040, 0164, 0150, 0145, 
-  0040, 0165, 0156, 0151, 0164, 0040, 0151, 0163, 0040, 0042, 0166, 0145, 0156, 0144, 0157, 0162, 
-  0042, 0054, 0040, 0162, 0145, 0141, 0144, 0151, 0156, 0147, 0163, 0040, 0167, 0151, 0154, 0154, 
-  0040, 0142, 0145, 0040, 0141, 0040, 0160, 0145, 0162, 0143, 0145, 0156, 0164, 0141, 0147, 0145, 
-  0040, 0167, 0151, 0164, 0150, 0040, 0061, 0060, 0060, 0045, 0040, 0142, 0145, 0151, 0156, 0147, 
-  0040, 0164, 0150, 0145, 0012, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0155, 0141, 0170, 
-  0151, 0155, 0165, 0155, 0040, 0162, 0145, 0141, 0144, 0151, 0156, 0147, 0056, 0012, 0040, 0040, 
-  0040, 0040, 0055, 0055, 0076, 0074, 0160, 0162, 0157, 0160, 0145, 0162, 0164, 0171, 0040, 0156, 
-  0141, 0155, 0145, 0075, 0042, 0114, 0151, 0147, 0150, 0164, 0114, 0145, 0166, 0145, 0154, 0125, 
-  0156, 0151, 0164, 0042, 0040, 0164, 0171, 0160, 0145, 0075, 0042, 0163, 0042, 0040, 0141, 0143, 
-  0143, 0145, 0163, 0163, 0075, 0042, 0162, 0145, 0141, 0144, 0042, 0057, 0076, 0074, 0041, 0055, 
-  0055, 0012, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0114, 0151, 0147, 0150, 0164, 0114, 
-  0145, 0166, 0145, 0154, 0072, 0012, 0012, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0124, 
-  0150, 0145, 0040, 0141, 0155, 0142, 0151, 0145, 0156, 0164, 0040, 0154, 0151, 0147, 0150, 0164, 
-  0040, 0163, 0145, 0156, 0163, 0157, 0162, 0040, 0162, 0145, 0141, 0144, 0151, 0156, 0147, 0054, 
-  0040, 0151, 0156, 0040, 0164, 0150, 0145, 0040, 0165, 0156, 0151, 0164, 0040, 0145, 0170, 0160, 
-  0157, 0162, 0164, 0145, 0144, 0040, 0151, 0156, 0040, 0164, 0150, 0145, 0012, 0040, 0040, 0040, 
-  0040, 0040, 0040, 0040, 0040, 0042, 0114, 0151, 0147, 0150, 0164, 0114, 0145, 0166, 0145, 0154, 
-  0125, 0156, 0151, 0164, 0042, 0040, 0160, 0162, 0157, 0160, 0145, 0162, 0164, 0171, 0056, 0012, 
-  0040, 0040, 0040, 0040, 0055, 0055, 0076, 0074, 0160, 0162, 0157, 0160, 0145, 0162, 0164, 0171, 
-  0040, 0156, 0141, 0155, 0145, 0075, 0042, 0114, 0151, 0147, 0150, 0164, 0114, 0145, 0166, 0145, 
-  0154, 0042, 0040, 0164, 0171, 0160, 0145, 0075, 0042, 0144, 0042, 0040, 0141, 0143, 0143, 0145, 
-  0163, 0163, 0075, 0042, 0162, 0145, 0141, 0144, 0042, 0057, 0076, 0074, 0041, 0055, 0055, 0012, 
-  0040, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0110, 0141, 0163, 0120, 0162, 0157, 0170, 0151, 
-  0155, 0151, 0164, 0171, 0072, 0012, 0012, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0127, 
-  0150, 0145, 0164, 0150, 0145, 0162, 0040, 0141, 0040, 0163, 0165, 0160, 0160, 0157, 0162, 0164, 
-  0145, 0144, 0040, 0160, 0162, 0157, 0170, 0151, 0155, 0151, 0164, 0171, 0040, 0163, 0145, 0156, 
-  0163, 0157, 0162, 0040, 0151, 0163, 0040, 0160, 0162, 0145, 0163, 0145, 0156, 0164, 0040, 0157, 
-  0156, 0040, 0164, 0150, 0145, 0040, 0163, 0171, 0163, 0164, 0145, 0155, 0056, 0012, 0040, 0040, 
-  0040, 0040, 0055, 0055, 0076, 0074, 0160, 0162, 0157, 0160, 0145, 0162, 0164, 0171, 0040, 0156, 
-  0141, 0155, 0145, 0075, 0042, 0110, 0141, 0163, 0120, 0162, 0157, 0170, 0151, 0155, 0151, 0164, 
-  0171, 0042, 0040, 0164, 0171, 0160, 0145, 0075, 0042, 0142, 0042, 0040, 0141, 0143, 0143, 0145, 
-  0163, 0163, 0075, 0042, 0162, 0145, 0141, 0144, 0042, 0057, 0076, 0074, 0041, 0055, 0055, 0012, 
-  0040, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0120, 0162, 0157, 0170, 0151, 0155, 0151, 0164, 
-  0171, 0116, 0145, 0141, 0162, 0072, 0012, 0012, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 
-  0127, 0150, 0145, 0164, 0150, 0145, 0162, 0040, 0141, 0156, 0040, 0157, 0142, 0152, 0145, 0143, 
-  0164, 0040, 0151, 0163, 0040, 0156, 0145, 0141, 0162, 0040, 0164, 0157, 0040, 0164, 0150, 0145, 
-  0040, 0160, 0162, 0157, 0170, 0151, 0155, 0151, 0164, 0171, 0040, 0163, 0145, 0156, 0163, 0157, 
-  0162, 0056, 0012, 0040, 0040, 0040, 0040, 0055, 0055, 0076, 0074, 0160, 0162, 0157, 0160, 0145, 
-  0162, 0164, 0171, 0040, 0156, 0141, 0155, 0145, 0075, 0042, 0120, 0162, 0157, 0170, 0151, 0155, 
-  0151, 0164, 0171, 0116, 0145, 0141, 0162, 0042, 0040, 0164, 0171, 0160, 0145, 0075, 0042, 0142, 
-  0042, 0040, 0141, 0143, 0143, 0145, 0163, 0163, 0075, 0042, 0162, 0145, 0141, 0144, 0042, 0057, 
-  0076, 0074, 0041, 0055, 0055, 0012, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0103, 0154, 0141, 
-  0151, 0155, 0101, 0143, 0143, 0145, 0154, 0145, 0162, 0157, 0155, 0145, 0164, 0145, 0162, 0072, 
-  0012, 0012, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0124, 0157, 0040, 0163, 0164, 0141, 0162, 
-  0164, 0040, 0162, 0145, 0143, 0145, 0151, 0166, 0151, 0156, 0147, 0040, 0141, 0143, 0143, 0145, 
-  0154, 0145, 0162, 0157, 0155, 0145, 0164, 0145, 0162, 0040, 0162, 0145, 0141, 0144, 0151, 0156, 
-  0147, 0040, 0165, 0160, 0144, 0141, 0164, 0145, 0163, 0040, 0146, 0162, 0157, 0155, 0040, 0164, 
-  0150, 0145, 0040, 0160, 0162, 0157, 0170, 0171, 0054, 0040, 0164, 0150, 0145, 0040, 0141, 0160, 
-  0160, 0154, 0151, 0143, 0141, 0164, 0151, 0157, 0156, 0012, 0040, 0040, 0040, 0040, 0040, 0040, 
-  0040, 0155, 0165, 0163, 0164, 0040, 0143, 0141, 0154, 0154, 0040, 0164, 0150, 0145, 0040, 0156, 
-  0145, 0164, 0056, 0150, 0141, 0144, 0145, 0163, 0163, 0056, 0123, 0145, 0156, 0163, 0157, 0162, 
-  0120, 0162, 0157, 0170, 0171, 0056, 0103, 0154, 0141, 0151, 0155, 0101, 0143, 0143, 0145, 0154, 
-  0145, 0162, 0157, 0155, 0145, 0164, 0145, 0162, 0050, 0051, 0040, 0155, 0145, 0164, 0150, 0157, 
-  0144, 0056, 0040, 0111, 0164, 0040, 0143, 0141, 0156, 0040, 0144, 0157, 0040, 0163, 0157, 0012, 
-  0040, 0040, 0040, 0040, 0040, 0040, 0040, 0167, 0150, 0145, 0164, 0150, 0145, 0162, 0040, 0141, 
-  0156, 0040, 0141, 0143, 0143, 0145, 0154, 0145, 0162, 0157, 0155, 0145, 0164, 0145, 0162, 0040, 
-  0151, 0163, 0040, 0141, 0166, 0141, 0151, 0154, 0141, 0142, 0154, 0145, 0040, 0157, 0162, 0040, 
-  0156, 0157, 0164, 0054, 0040, 0165, 0160, 0144, 0141, 0164, 0145, 0163, 0040, 0167, 0157, 0165, 
-  0154, 0144, 0040, 0164, 0150, 0145, 0156, 0040, 0142, 0145, 0040, 0163, 0145, 0156, 0164, 0040, 
-  0167, 0150, 0145, 0156, 0040, 0141, 0156, 0012, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0141, 
-  0143, 0143, 0145, 0154, 0145, 0162, 0157, 0155, 0145, 0164, 0145, 0162, 0040, 0141, 0160, 0160, 
-  0145, 0141, 0162, 0163, 0056, 0012, 0012, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0101, 0160, 
-  0160, 0154, 0151, 0143, 0141, 0164, 0151, 0157, 0156, 0163, 0040, 0163, 0150, 0157, 0165, 0154, 
-  0144, 0040, 0143, 0141, 0154, 0154, 0040, 0156, 0145, 0164, 0056, 0150, 0141, 0144, 0145, 0163, 
-  0163, 0056, 0123, 0145, 0156, 0163, 0157, 0162, 0120, 0162, 0157, 0170, 0171, 0056, 0122, 0145, 
-  0154, 0145, 0141, 0163, 0145, 0101, 0143, 0143, 0145, 0154, 0145, 0162, 0157, 0155, 0145, 0164, 
-  0145, 0162, 0050, 0051, 0040, 0167, 0150, 0145, 0156, 0012, 0040, 0040, 0040, 0040, 0040, 0040, 
-  0040, 0162, 0145, 0141, 0144, 0151, 0156, 0147, 0163, 0040, 0141, 0162, 0145, 0040, 0156, 0157, 
-  0164, 0040, 0162, 0145, 0161, 0165, 0151, 0162, 0145, 0144, 0040, 0141, 0156, 0171, 0155, 0157, 
-  0162, 0145, 0056, 0040, 0106, 0157, 0162, 0040, 0145, 0170, 0141, 0155, 0160, 0154, 0145, 0054, 
-  0040, 0141, 0156, 0040, 0141, 0160, 0160, 0154, 0151, 0143, 0141, 0164, 0151, 0157, 0156, 0040, 
-  0164, 0150, 0141, 0164, 0040, 0155, 0157, 0156, 0151, 0164, 0157, 0162, 0163, 0012, 0040, 0040, 
-  0040, 0040, 0040, 0040, 0040, 0164, 0150, 0145, 0040, 0157, 0162, 0151, 0145, 0156, 0164, 0141, 
-  0164, 0151, 0157, 0156, 0040, 0157, 0146, 0040, 0164, 0150, 0145, 0040, 0155, 0141, 0151, 0156, 
-  0040, 0163, 0143, 0162, 0145, 0145, 0156, 0040, 0163, 0150, 0157, 0165, 0154, 0144, 0040, 0163, 
-  0164, 0157, 0160, 0040, 0155, 0157, 0156, 0151, 0164, 0157, 0162, 0151, 0156, 0147, 0040, 0146, 
-  0157, 0162, 0040, 0165, 0160, 0144, 0141, 0164, 0145, 0163, 0040, 0167, 0150, 0145, 0156, 0040, 
-  0164, 0150, 0141, 0164, 0012, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0163, 0143, 0162, 0145, 
-  0145, 0156, 0040, 0150, 0141, 0163, 0040, 0142, 0145, 0145, 0156, 0040, 0164, 0165, 0162, 0156, 
-  0145, 0144, 0040, 0157, 0146, 0146, 0056, 0012, 0012, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 
-  0124, 0150, 0151, 0163, 0040, 0160, 0162, 0145, 0166, 0145, 0156, 0164, 0163, 0040, 0164, 0150, 
-  0145, 0040, 0163, 0145, 0156, 0163, 0157, 0162, 0040, 0160, 0162, 0157, 0170, 0171, 0040, 0146, 
-  0162, 0157, 0155, 0040, 0160, 0157, 0154, 0154, 0151, 0156, 0147, 0040, 0164, 0150, 0145, 0040, 
-  0144, 0145, 0166, 0151, 0143, 0145, 0054, 0040, 0164, 0150, 0165, 0163, 0040, 0151, 0156, 0143, 
-  0162, 0145, 0141, 0163, 0151, 0156, 0147, 0040, 0167, 0141, 0153, 0145, 0055, 0165, 0160, 0163, 
-  0012, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0141, 0156, 0144, 0040, 0162, 0145, 0144, 0165, 
-  0143, 0151, 0156, 0147, 0040, 0142, 0141, 0164, 0164, 0145, 0162, 0171, 0040, 0154, 0151, 0146, 
-  0145, 0056, 0012, 0040, 0040, 0040, 0040, 0055, 0055, 0076, 0074, 0155, 0145, 0164, 0150, 0157, 
-  0144, 0040, 0156, 0141, 0155, 0145, 0075, 0042, 0103, 0154, 0141, 0151, 0155, 0101, 0143, 0143, 
-  0145, 0154, 0145, 0162, 0157, 0155, 0145, 0164, 0145, 0162, 0042, 0057, 0076, 0074, 0041, 0055, 
-  0055, 0012, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0122, 0145, 0154, 0145, 0141, 0163, 
-  0145, 0101, 0143, 0143, 0145, 0154, 0145, 0162, 0157, 0155, 0145, 0164, 0145, 0162, 0072, 0012, 
-  0012, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0124, 0150, 0151, 0163, 0040, 0163, 0150, 
-  0157, 0165, 0154, 0144, 0040, 0142, 0145, 0040, 0143, 0141, 0154, 0154, 0145, 0144, 0040, 0141, 
-  0163, 0040, 0163, 0157, 0157, 0156, 0040, 0141, 0163, 0040, 0162, 0145, 0141, 0144, 0151, 0156, 
-  0147, 0163, 0040, 0141, 0162, 0145, 0040, 0156, 0157, 0164, 0040, 0162, 0145, 0161, 0165, 0151, 
-  0162, 0145, 0144, 0040, 0141, 0156, 0171, 0155, 0157, 0162, 0145, 0056, 0040, 0116, 0157, 0164, 
-  0145, 0012, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0164, 0150, 0141, 0164, 0040, 0162, 
-  0145, 0163, 0157, 0165, 0162, 0143, 0145, 0163, 0040, 0141, 0162, 0145, 0040, 0146, 0162, 0145, 
-  0145, 0144, 0040, 0165, 0160, 0040, 0151, 0146, 0040, 0141, 0040, 0155, 0157, 0156, 0151, 0164, 
-  0157, 0162, 0151, 0156, 0147, 0040, 0141, 0160, 0160, 0154, 0151, 0143, 0141, 0164, 0151, 0157, 
-  0156, 0040, 0145, 0170, 0151, 0164, 0163, 0040, 0167, 0151, 0164, 0150, 0157, 0165, 0164, 0012, 
-  0040, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0143, 0141, 0154, 0154, 0151, 0156, 0147, 0040, 
-  0156, 0145, 0164, 0056, 0150, 0141, 0144, 0145, 0163, 0163, 0056, 0123, 0145, 0156, 0163, 0157, 
-  0162, 0120, 0162, 0157, 0170, 0171, 0056, 0122, 0145, 0154, 0145, 0141, 0163, 0145, 0101, 0143, 
-  0143, 0145, 0154, 0145, 0162, 0157, 0155, 0145, 0164, 0145, 0162, 0050, 0051, 0054, 0040, 0143, 
-  0162, 0141, 0163, 0150, 0145, 0163, 0040, 0157, 0162, 0040, 0164, 0150, 0145, 0040, 0163, 0145, 
-  0156, 0163, 0157, 0162, 0040, 0144, 0151, 0163, 0141, 0160, 0160, 0145, 0141, 0162, 0163, 0056, 
-  0012, 0040, 0040, 0040, 0040, 0055, 0055, 0076, 0074, 0155, 0145, 0164, 0150, 0157, 0144, 0040, 
-  0156, 0141, 0155, 0145, 0075, 0042, 0122, 0145, 0154, 0145, 0141, 0163, 0145, 0101, 0143, 0143, 
-  0145, 0154, 0145, 0162, 0157, 0155, 0145, 0164, 0145, 0162, 0042, 0057, 0076, 0074, 0041, 0055, 
-  0055, 0012, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0103, 0154, 0141, 0151, 0155, 0114, 0151, 
-  0147, 0150, 0164, 0072, 0012, 0012, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0124, 0157, 0040, 
-  0163, 0164, 0141, 0162, 0164, 0040, 0162, 0145, 0143, 0145, 0151, 0166, 0151, 0156, 0147, 0040, 
-  0141, 0155, 0142, 0151, 0145, 0156, 0164, 0040, 0154, 0151, 0147, 0150, 0164, 0040, 0163, 0145, 
-  0156, 0163, 0157, 0162, 0040, 0162, 0145, 0141, 0144, 0151, 0156, 0147, 0040, 0165, 0160, 0144, 
-  0141, 0164, 0145, 0163, 0040, 0146, 0162, 0157, 0155, 0040, 0164, 0150, 0145, 0040, 0160, 0162, 
-  0157, 0170, 0171, 0054, 0040, 0164, 0150, 0145, 0012, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 
-  0141, 0160, 0160, 0154, 0151, 0143, 0141, 0164, 0151, 0157, 0156, 0040, 0155, 0165, 0163, 0164, 
-  0040, 0143, 0141, 0154, 0154, 0040, 0164, 0150, 0145, 0040, 0156, 0145, 0164, 0056, 0150, 0141, 
-  0144, 0145, 0163, 0163, 0056, 0123, 0145, 0156, 0163, 0157, 0162, 0120, 0162, 0157, 0170, 0171, 
-  0056, 0103, 0154, 0141, 0151, 0155, 0114, 0151, 0147, 0150, 0164, 0050, 0051, 0040, 0155, 0145, 
-  0164, 0150, 0157, 0144, 0056, 0040, 0111, 0164, 0040, 0143, 0141, 0156, 0040, 0144, 0157, 0040, 
-  0163, 0157, 0012, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0167, 0150, 0145, 0164, 0150, 0145, 
-  0162, 0040, 0141, 0156, 0040, 0141, 0155, 0142, 0151, 0145, 0156, 0164, 0040, 0154, 0151, 0147, 
-  0150, 0164, 0040, 0163, 0145, 0156, 0163, 0157, 0162, 0040, 0151, 0163, 0040, 0141, 0166, 0141, 
-  0151, 0154, 0141, 0142, 0154, 0145, 0040, 0157, 0162, 0040, 0156, 0157, 0164, 0054, 0040, 0165, 
-  0160, 0144, 0141, 0164, 0145, 0163, 0040, 0167, 0157, 0165, 0154, 0144, 0040, 0164, 0150, 0145, 
-  0156, 0040, 0142, 0145, 0040, 0163, 0145, 0156, 0164, 0012, 0040, 0040, 0040, 0040, 0040, 0040, 
-  0040, 0167, 0150, 0145, 0156, 0040, 0163, 0165, 0143, 0150, 0040, 0141, 0040, 0163, 0145, 0156, 
-  0163, 0157, 0162, 0040, 0141, 0160, 0160, 0145, 0141, 0162, 0163, 0056, 0012, 0012, 0040, 0040, 
-  0040, 0040, 0040, 0040, 0040, 0101, 0160, 0160, 0154, 0151, 0143, 0141, 0164, 0151, 0157, 0156, 
-  0163, 0040, 0163, 0150, 0157, 0165, 0154, 0144, 0040, 0143, 0141, 0154, 0154, 0040, 0156, 0145, 
-  0164, 0056, 0150, 0141, 0144, 0145, 0163, 0163, 0056, 0123, 0145, 0156, 0163, 0157, 0162, 0120, 
-  0162, 0157, 0170, 0171, 0056, 0122, 0145, 0154, 0145, 0141, 0163, 0145, 0114, 0151, 0147, 0150, 
-  0164, 0050, 0051, 0040, 0167, 0150, 0145, 0156, 0040, 0162, 0145, 0141, 0144, 0151, 0156, 0147, 
-  0163, 0040, 0141, 0162, 0145, 0012, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0156, 0157, 0164, 
-  0040, 0162, 0145, 0161, 0165, 0151, 0162, 0145, 0144, 0040, 0141, 0156, 0171, 0155, 0157, 0162, 
-  0145, 0056, 0040, 0106, 0157, 0162, 0040, 0145, 0170, 0141, 0155, 0160, 0154, 0145, 0054, 0040, 
-  0141, 0156, 0040, 0141, 0160, 0160, 0154, 0151, 0143, 0141, 0164, 0151, 0157, 0156, 0040, 0164, 
-  0150, 0141, 0164, 0040, 0155, 0157, 0156, 0151, 0164, 0157, 0162, 0163, 0040, 0164, 0150, 0145, 
-  0040, 0141, 0155, 0142, 0151, 0145, 0156, 0164, 0040, 0154, 0151, 0147, 0150, 0164, 0012, 0040, 
-  0040, 0040, 0040, 0040, 0040, 0040, 0164, 0157, 0040, 0143, 0150, 0141, 0156, 0147, 0145, 0040, 
-  0164, 0150, 0145, 0040, 0163, 0143, 0162, 0145, 0145, 0156, 0040, 0142, 0162, 0151, 0147, 0150, 
-  0164, 0156, 0145, 0163, 0163, 0040, 0163, 0150, 0157, 0165, 0154, 0144, 0040, 0163, 0164, 0157, 
-  0160, 0040, 0155, 0157, 0156, 0151, 0164, 0157, 0162, 0151, 0156, 0147, 0040, 0146, 0157, 0162, 
-  0040, 0165, 0160, 0144, 0141, 0164, 0145, 0163, 0040, 0167, 0150, 0145, 0156, 0040, 0164, 0150, 
-  0141, 0164, 0040, 0163, 0143, 0162, 0145, 0145, 0156, 0012, 0040, 0040, 0040, 0040, 0040, 0040, 
-  0040, 0150, 0141, 0163, 0040, 0142, 0145, 0145, 0156, 0040, 0164, 0165, 0162, 0156, 0145, 0144, 
-  0040, 0157, 0146, 0146, 0056, 0012, 0012, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0124, 0150, 
-  0151, 0163, 0040, 0160, 0162, 0145, 0166, 0145, 0156, 0164, 0163, 0040, 0164, 0150, 0145, 0040, 
-  0163, 0145, 0156, 0163, 0157, 0162, 0040, 0160, 0162, 0157, 0170, 0171, 0040, 0146, 0162, 0157, 
-  0155, 0040, 0160, 0157, 0154, 0154, 0151, 0156, 0147, 0040, 0164, 0150, 0145, 0040, 0144, 0145, 
-  0166, 0151, 0143, 0145, 0054, 0040, 0164, 0150, 0165, 0163, 0040, 0151, 0156, 0143, 0162, 0145, 
-  0141, 0163, 0151, 0156, 0147, 0040, 0167, 0141, 0153, 0145, 0055, 0165, 0160, 0163, 0012, 0040, 
-  0040, 0040, 0040, 0040, 0040, 0040, 0141, 0156, 0144, 0040, 0162, 0145, 0144, 0165, 0143, 0151, 
-  0156, 0147, 0040, 0142, 0141, 0164, 0164, 0145, 0162, 0171, 0040, 0154, 0151, 0146, 0145, 0056, 
-  0012, 0040, 0040, 0040, 0040, 0055, 0055, 0076, 0074, 0155, 0145, 0164, 0150, 0157, 0144, 0040, 
-  0156, 0141, 0155, 0145, 0075, 0042, 0103, 0154, 0141, 0151, 0155, 0114, 0151, 0147, 0150, 0164, 
-  0042, 0057, 0076, 0074, 0041, 0055, 0055, 0012, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 
-  0122, 0145, 0154, 0145, 0141, 0163, 0145, 0114, 0151, 0147, 0150, 0164, 0072, 0012, 0012, 0040, 
-  0040, 0040, 0040, 0040, 0040, 0040, 0040, 0124, 0150, 0151, 0163, 0040, 0163, 0150, 0157, 0165, 
-  0154, 0144, 0040, 0142, 0145, 0040, 0143, 0141, 0154, 0154, 0145, 0144, 0040, 0141, 0163, 0040, 
-  0163, 0157, 0157, 0156, 0040, 0141, 0163, 0040, 0162, 0145, 0141, 0144, 0151, 0156, 0147, 0163, 
-  0040, 0141, 0162, 0145, 0040, 0156, 0157, 0164, 0040, 0162, 0145, 0161, 0165, 0151, 0162, 0145, 
-  0144, 0040, 0141, 0156, 0171, 0155, 0157, 0162, 0145, 0056, 0040, 0116, 0157, 0164, 0145, 0012, 
-  0040, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0164, 0150, 0141, 0164, 0040, 0162, 0145, 0163, 
-  0157, 0165, 0162, 0143, 0145, 0163, 0040, 0141, 0162, 0145, 0040, 0146, 0162, 0145, 0145, 0144, 
-  0040, 0165, 0160, 0040, 0151, 0146, 0040, 0141, 0040, 0155, 0157, 0156, 0151, 0164, 0157, 0162, 
-  0151, 0156, 0147, 0040, 0141, 0160, 0160, 0154, 0151, 0143, 0141, 0164, 0151, 0157, 0156, 0040, 
-  0145, 0170, 0151, 0164, 0163, 0040, 0167, 0151, 0164, 0150, 0157, 0165, 0164, 0012, 0040, 0040, 
-  0040, 0040, 0040, 0040, 0040, 0040, 0143, 0141, 0154, 0154, 0151, 0156, 0147, 0040, 0156, 0145, 
-  0164, 0056, 0150, 0141, 0144, 0145, 0163, 0163, 0056, 0123, 0145, 0156, 0163, 0157, 0162, 0120, 
-  0162, 0157, 0170, 0171, 0056, 0122, 0145, 0154, 0145, 0141, 0163, 0145, 0114, 0151, 0147, 0150, 
-  0164, 0050, 0051, 0054, 0040, 0143, 0162, 0141, 0163, 0150, 0145, 0163, 0040, 0157, 0162, 0040, 
-  0164, 0150, 0145, 0040, 0163, 0145, 0156, 0163, 0157, 0162, 0040, 0144, 0151, 0163, 0141, 0160, 
-  0160, 0145, 0141, 0162, 0163, 0056, 0012, 0040, 0040, 0040, 0040, 0055, 0055, 0076, 0074, 0155, 
-  0145, 0164, 0150, 0157, 0144, 0040, 0156, 0141, 0155, 0145, 0075, 0042, 0122, 0145, 0154, 0145, 
-  0141, 0163, 0145, 0114, 0151, 0147, 0150, 0164, 0042, 0057, 0076, 0074, 0041, 0055, 0055, 0012, 
-  0040, 0040, 0040, 0040, 0040, 0040, 0040, 0103, 0154, 0141, 0151, 0155, 0120, 0162, 0157, 0170, 
-  0151, 0155, 0151, 0164, 0171, 0072, 0012, 0012, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0124, 
-  0157, 0040, 0163, 0164, 0141, 0162, 0164, 0040, 0162, 0145, 0143, 0145, 0151, 0166, 0151, 0156, 
-  0147, 0040, 0160, 0162, 0157, 0170, 0151, 0155, 0151, 0164, 0171, 0040, 0165, 0160, 0144, 0141, 
-  0164, 0145, 0163, 0040, 0146, 0162, 0157, 0155, 0040, 0164, 0150, 0145, 0040, 0160, 0162, 0157, 
-  0170, 0171, 0054, 0040, 0164, 0150, 0145, 0012, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0141, 
-  0160, 0160, 0154, 0151, 0143, 0141, 0164, 0151, 0157, 0156, 0040, 0155, 0165, 0163, 0164, 0040, 
-  0143, 0141, 0154, 0154, 0040, 0164, 0150, 0145, 0040, 0156, 0145, 0164, 0056, 0150, 0141, 0144, 
-  0145, 0163, 0163, 0056, 0123, 0145, 0156, 0163, 0157, 0162, 0120, 0162, 0157, 0170, 0171, 0056, 
-  0103, 0154, 0141, 0151, 0155, 0120, 0162, 0157, 0170, 0151, 0155, 0151, 0164, 0171, 0050, 0051, 
-  0040, 0155, 0145, 0164, 0150, 0157, 0144, 0056, 0040, 0111, 0164, 0040, 0143, 0141, 0156, 0040, 
-  0144, 0157, 0040, 0163, 0157, 0012, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0167, 0150, 0145, 
-  0164, 0150, 0145, 0162, 0040, 0141, 0040, 0160, 0162, 0157, 0170, 0151, 0155, 0151, 0164, 0171, 
-  0040, 0151, 0163, 0040, 0141, 0166, 0141, 0151, 0154, 0141, 0142, 0154, 0145, 0040, 0157, 0162, 
-  0040, 0156, 0157, 0164, 0054, 0040, 0165, 0160, 0144, 0141, 0164, 0145, 0163, 0040, 0167, 0157, 
-  0165, 0154, 0144, 0040, 0164, 0150, 0145, 0156, 0040, 0142, 0145, 0040, 0163, 0145, 0156, 0164, 
-  0012, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0167, 0150, 0145, 0156, 0040, 0163, 0165, 0143, 
-  0150, 0040, 0141, 0040, 0163, 0145, 0156, 0163, 0157, 0162, 0040, 0141, 0160, 0160, 0145, 0141, 
-  0162, 0163, 0056, 0012, 0012, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0101, 0160, 0160, 0154, 
-  0151, 0143, 0141, 0164, 0151, 0157, 0156, 0163, 0040, 0163, 0150, 0157, 0165, 0154, 0144, 0040, 
-  0143, 0141, 0154, 0154, 0040, 0156, 0145, 0164, 0056, 0150, 0141, 0144, 0145, 0163, 0163, 0056, 
-  0123, 0145, 0156, 0163, 0157, 0162, 0120, 0162, 0157, 0170, 0171, 0056, 0122, 0145, 0154, 0145, 
-  0141, 0163, 0145, 0120, 0162, 0157, 0170, 0151, 0155, 0151, 0164, 0171, 0050, 0051, 0040, 0167, 
-  0150, 0145, 0156, 0040, 0162, 0145, 0141, 0144, 0151, 0156, 0147, 0163, 0040, 0141, 0162, 0145, 
-  0012, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0156, 0157, 0164, 0040, 0162, 0145, 0161, 0165, 
-  0151, 0162, 0145, 0144, 0040, 0141, 0156, 0171, 0155, 0157, 0162, 0145, 0056, 0040, 0124, 0150, 
-  0151, 0163, 0040, 0160, 0162, 0145, 0166, 0145, 0156, 0164, 0163, 0040, 0164, 0150, 0145, 0040, 
-  0163, 0145, 0156, 0163, 0157, 0162, 0040, 0160, 0162, 0157, 0170, 0171, 0040, 0146, 0162, 0157, 
-  0155, 0040, 0160, 0157, 0154, 0154, 0151, 0156, 0147, 0040, 0164, 0150, 0145, 0040, 0144, 0145, 
-  0166, 0151, 0143, 0145, 0054, 0040, 0164, 0150, 0165, 0163, 0012, 0040, 0040, 0040, 0040, 0040, 
-  0040, 0040, 0151, 0156, 0143, 0162, 0145, 0141, 0163, 0151, 0156, 0147, 0040, 0167, 0141, 0153, 
-  0145, 0055, 0165, 0160, 0163, 0040, 0141, 0156, 0144, 0040, 0162, 0145, 0144, 0165, 0143, 0151, 
-  0156, 0147, 0040, 0142, 0141, 0164, 0164, 0145, 0162, 0171, 0040, 0154, 0151, 0146, 0145, 0056, 
-  0012, 0040, 0040, 0040, 0040, 0055, 0055, 0076, 0074, 0155, 0145, 0164, 0150, 0157, 0144, 0040, 
-  0156, 0141, 0155, 0145, 0075, 0042, 0103, 0154, 0141, 0151, 0155, 0120, 0162, 0157, 0170, 0151, 
-  0155, 0151, 0164, 0171, 0042, 0057, 0076, 0074, 0041, 0055, 0055, 0012, 0040, 0040, 0040, 0040, 
-  0040, 0040, 0040, 0040, 0122, 0145, 0154, 0145, 0141, 0163, 0145, 0120, 0162, 0157, 0170, 0151, 
-  0155, 0151, 0164, 0171, 0072, 0012, 0012, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0124, 
-  0150, 0151, 0163, 0040, 0163, 0150, 0157, 0165, 0154, 0144, 0040, 0142, 0145, 0040, 0143, 0141, 
-  0154, 0154, 0145, 0144, 0040, 0141, 0163, 0040, 0163, 0157, 0157, 0156, 0040, 0141, 0163, 0040, 
-  0162, 0145, 0141, 0144, 0151, 0156, 0147, 0163, 0040, 0141, 0162, 0145, 0040, 0156, 0157, 0164, 
-  0040, 0162, 0145, 0161, 0165, 0151, 0162, 0145, 0144, 0040, 0141, 0156, 0171, 0155, 0157, 0162, 
-  0145, 0056, 0040, 0116, 0157, 0164, 0145, 0012, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 
-  0164, 0150, 0141, 0164, 0040, 0162, 0145, 0163, 0157, 0165, 0162, 0143, 0145, 0163, 0040, 0141, 
-  0162, 0145, 0040, 0146, 0162, 0145, 0145, 0144, 0040, 0165, 0160, 0040, 0151, 0146, 0040, 0141, 
-  0040, 0155, 0157, 0156, 0151, 0164, 0157, 0162, 0151, 0156, 0147, 0040, 0141, 0160, 0160, 0154, 
-  0151, 0143, 0141, 0164, 0151, 0157, 0156, 0040, 0145, 0170, 0151, 0164, 0163, 0040, 0167, 0151, 
-  0164, 0150, 0157, 0165, 0164, 0012, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0143, 0141, 
-  0154, 0154, 0151, 0156, 0147, 0040, 0156, 0145, 0164, 0056, 0150, 0141, 0144, 0145, 0163, 0163, 
-  0056, 0123, 0145, 0156, 0163, 0157, 0162, 0120, 0162, 0157, 0170, 0171, 0056, 0122, 0145, 0154, 
-  0145, 0141, 0163, 0145, 0120, 0162, 0157, 0170, 0151, 0155, 0151, 0164, 0171, 0050, 0051, 0054, 
-  0040, 0143, 0162, 0141, 0163, 0150, 0145, 0163, 0040, 0157, 0162, 0040, 0164, 0150, 0145, 0040, 
-  0163, 0145, 0156, 0163, 0157, 0162, 0040, 0144, 0151, 0163, 0141, 0160, 0160, 0145, 0141, 0162, 
-  0163, 0056, 0012, 0040, 0040, 0040, 0040, 0055, 0055, 0076, 0074, 0155, 0145, 0164, 0150, 0157, 
-  0144, 0040, 0156, 0141, 0155, 0145, 0075, 0042, 0122, 0145, 0154, 0145, 0141, 0163, 0145, 0120, 
-  0162, 0157, 0170, 0151, 0155, 0151, 0164, 0171, 0042, 0057, 0076, 0074, 0057, 0151, 0156, 0164, 
-  0145, 0162, 0146, 0141, 0143, 0145, 0076, 0074, 0041, 0055, 0055, 0012, 0040, 0040, 0040, 0040, 
-  0040, 0040, 0156, 0145, 0164, 0056, 0150, 0141, 0144, 0145, 0163, 0163, 0056, 0123, 0145, 0156, 
-  0163, 0157, 0162, 0120, 0162, 0157, 0170, 0171, 0056, 0103, 0157, 0155, 0160, 0141, 0163, 0163, 
-  0072, 0012, 0040, 0040, 0040, 0040, 0040, 0040, 0100, 0163, 0150, 0157, 0162, 0164, 0137, 0144, 
-  0145, 0163, 0143, 0162, 0151, 0160, 0164, 0151, 0157, 0156, 0072, 0040, 0104, 0055, 0102, 0165, 
-  0163, 0040, 0160, 0162, 0157, 0170, 0171, 0040, 0164, 0157, 0040, 0141, 0143, 0143, 0145, 0163, 
-  0163, 0040, 0103, 0157, 0155, 0160, 0141, 0163, 0163, 0040, 0163, 0145, 0156, 0163, 0157, 0162, 
-  0163, 0012, 0012, 0040, 0040, 0040, 0040, 0040, 0040, 0101, 0146, 0164, 0145, 0162, 0040, 0143, 
-  0150, 0145, 0143, 0153, 0151, 0156, 0147, 0040, 0164, 0150, 0145, 0040, 0141, 0166, 0141, 0151, 
-  0154, 0141, 0142, 0151, 0154, 0151, 0164, 0171, 0040, 0157, 0146, 0040, 0164, 0150, 0145, 0040, 
-  0163, 0145, 0156, 0163, 0157, 0162, 0040, 0164, 0171, 0160, 0145, 0040, 0171, 0157, 0165, 0040, 
-  0167, 0141, 0156, 0164, 0040, 0164, 0157, 0040, 0155, 0157, 0156, 0151, 0164, 0157, 0162, 0054, 
-  0012, 0040, 0040, 0040, 0040, 0040, 0040, 0143, 0141, 0154, 0154, 0040, 0164, 0150, 0145, 0040, 
-  0156, 0145, 0164, 0056, 0150, 0141, 0144, 0145, 0163, 0163, 0056, 0123, 0145, 0156, 0163, 0157, 
-  0162, 0120, 0162, 0157, 0170, 0171, 0056, 0103, 0154, 0141, 0151, 0155, 0103, 0157, 0155, 0160, 
-  0141, 0163, 0163, 0050, 0051, 0040, 0155, 0145, 0164, 0150, 0157, 0144, 0040, 0164, 0157, 0040, 
-  0163, 0164, 0141, 0162, 0164, 0040, 0165, 0160, 0144, 0141, 0164, 0151, 0156, 0147, 0012, 0040, 
-  0040, 0040, 0040, 0040, 0040, 0164, 0150, 0145, 0040, 0160, 0162, 0157, 0160, 0145, 0162, 0164, 
-  0151, 0145, 0163, 0040, 0146, 0162, 0157, 0155, 0040, 0164, 0150, 0145, 0040, 0150, 0141, 0162, 
-  0144, 0167, 0141, 0162, 0145, 0040, 0162, 0145, 0141, 0144, 0151, 0156, 0147, 0163, 0056, 0012, 
-  0012, 0040, 0040, 0040, 0040, 0040, 0040, 0124, 0150, 0145, 0040, 0157, 0142, 0152, 0145, 0143, 
-  0164, 0040, 0160, 0141, 0164, 0150, 0040, 0167, 0151, 0154, 0154, 0040, 0142, 0145, 0040, 0042, 
-  0057, 0156, 0145, 0164, 0057, 0150, 0141, 0144, 0145, 0163, 0163, 0057, 0123, 0145, 0156, 0163, 
-  0157, 0162, 0120, 0162, 0157, 0170, 0171, 0057, 0103, 0157, 0155, 0160, 0141, 0163, 0163, 0042, 
-  0056, 0012, 0040, 0040, 0055, 0055, 0076, 0074, 0151, 0156, 0164, 0145, 0162, 0146, 0141, 0143, 
-  0145, 0040, 0156, 0141, 0155, 0145, 0075, 0042, 0156, 0145, 0164, 0056, 0150, 0141, 0144, 0145, 
-  0163, 0163, 0056, 0123, 0145, 0156, 0163, 0157, 0162, 0120, 0162, 0157, 0170, 0171, 0056, 0103, 
-  0157, 0155, 0160, 0141, 0163, 0163, 0042, 0076, 0074, 0041, 0055, 0055, 0012, 0040, 0040, 0040, 
-  0040, 0040, 0040, 0040, 0040, 0110, 0141, 0163, 0103, 0157, 0155, 0160, 0141, 0163, 0163, 0072, 
-  0012, 0012, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0127, 0150, 0145, 0164, 0150, 0145, 
-  0162, 0040, 0141, 0040, 0163, 0165, 0160, 0160, 0157, 0162, 0164, 0145, 0144, 0040, 0143, 0157, 
-  0155, 0160, 0141, 0163, 0163, 0040, 0151, 0163, 0040, 0160, 0162, 0145, 0163, 0145, 0156, 0164, 
-  0040, 0157, 0156, 0040, 0164, 0150, 0145, 0040, 0163, 0171, 0163, 0164, 0145, 0155, 0056, 0012, 
-  0040, 0040, 0040, 0040, 0055, 0055, 0076, 0074, 0160, 0162, 0157, 0160, 0145, 0162, 0164, 0171, 
-  0040, 0156, 0141, 0155, 0145, 0075, 0042, 0110, 0141, 0163, 0103, 0157, 0155, 0160, 0141, 0163, 
-  0163, 0042, 0040, 0164, 0171, 0160, 0145, 0075, 0042, 0142, 0042, 0040, 0141, 0143, 0143, 0145, 
-  0163, 0163, 0075, 0042, 0162, 0145, 0141, 0144, 0042, 0057, 0076, 0074, 0041, 0055, 0055, 0012, 
-  0040, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0103, 0157, 0155, 0160, 0141, 0163, 0163, 0110, 
-  0145, 0141, 0144, 0151, 0156, 0147, 0072, 0012, 0012, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 
-  0040, 0124, 0150, 0145, 0040, 0143, 0157, 0155, 0160, 0141, 0163, 0163, 0040, 0150, 0145, 0141, 
-  0144, 0151, 0156, 0147, 0040, 0151, 0156, 0040, 0144, 0145, 0147, 0162, 0145, 0145, 0163, 0040, 
-  0167, 0151, 0164, 0150, 0040, 0162, 0145, 0163, 0160, 0145, 0143, 0164, 0040, 0164, 0157, 0040, 
-  0155, 0141, 0147, 0156, 0145, 0164, 0151, 0143, 0040, 0116, 0157, 0162, 0164, 0150, 0040, 0144, 
-  0151, 0162, 0145, 0143, 0164, 0151, 0157, 0156, 0054, 0040, 0151, 0156, 0012, 0040, 0040, 0040, 
-  0040, 0040, 0040, 0040, 0040, 0143, 0154, 0157, 0143, 0153, 0167, 0151, 0163, 0145, 0040, 0157, 
-  0162, 0144, 0145, 0162, 0056, 0040, 0124, 0150, 0141, 0164, 0040, 0155, 0145, 0141, 0156, 0163, 
-  0040, 0116, 0157, 0162, 0164, 0150, 0040, 0142, 0145, 0143, 0157, 0155, 0145, 0163, 0040, 0060, 
-  0040, 0144, 0145, 0147, 0162, 0145, 0145, 0054, 0040, 0105, 0141, 0163, 0164, 0072, 0040, 0071, 
-  0060, 0040, 0144, 0145, 0147, 0162, 0145, 0145, 0163, 0054, 0012, 0040, 0040, 0040, 0040, 0040, 
-  0040, 0040, 0040, 0123, 0157, 0165, 0164, 0150, 0072, 0040, 0061, 0070, 0060, 0040, 0144, 0145, 
-  0147, 0162, 0145, 0145, 0163, 0054, 0040, 0127, 0145, 0163, 0164, 0072, 0040, 0062, 0067, 0060, 
-  0040, 0144, 0145, 0147, 0162, 0145, 0145, 0163, 0040, 0141, 0156, 0144, 0040, 0163, 0157, 0040, 
-  0157, 0156, 0056, 0040, 0127, 0150, 0145, 0156, 0040, 0165, 0156, 0153, 0156, 0157, 0167, 0156, 
-  0054, 0012, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0151, 0164, 0047, 0163, 0040, 0163, 
-  0145, 0164, 0040, 0164, 0157, 0040, 0055, 0061, 0056, 0060, 0056, 0012, 0040, 0040, 0040, 0040, 
-  0055, 0055, 0076, 0074, 0160, 0162, 0157, 0160, 0145, 0162, 0164, 0171, 0040, 0156, 0141, 0155, 
-  0145, 0075, 0042, 0103, 0157, 0155, 0160, 0141, 0163, 0163, 0110, 0145, 0141, 0144, 0151, 0156, 
-  0147, 0042, 0040, 0164, 0171, 0160, 0145, 0075, 0042, 0144, 0042, 0040, 0141, 0143, 0143, 0145, 
-  0163, 0163, 0075, 0042, 0162, 0145, 0141, 0144, 0042, 0057, 0076, 0074, 0041, 0055, 0055, 0012, 
-  0040, 0040, 0040, 0040, 0040, 0040, 0040, 0103, 0154, 0141, 0151, 0155, 0103, 0157, 0155, 0160, 
-  0141, 0163, 0163, 0072, 0012, 0012, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0124, 0157, 0040, 
-  0163, 0164, 0141, 0162, 0164, 0040, 0162, 0145, 0143, 0145, 0151, 0166, 0151, 0156, 0147, 0040, 
-  0143, 0157, 0155, 0160, 0141, 0163, 0163, 0040, 0150, 0145, 0141, 0144, 0151, 0156, 0147, 0040, 
-  0165, 0160, 0144, 0141, 0164, 0145, 0163, 0040, 0146, 0162, 0157, 0155, 0040, 0164, 0150, 0145, 
-  0040, 0160, 0162, 0157, 0170, 0171, 0054, 0040, 0164, 0150, 0145, 0012, 0040, 0040, 0040, 0040, 
-  0040, 0040, 0040, 0141, 0160, 0160, 0154, 0151, 0143, 0141, 0164, 0151, 0157, 0156, 0040, 0155, 
-  0165, 0163, 0164, 0040, 0143, 0141, 0154, 0154, 0040, 0164, 0150, 0145, 0040, 0156, 0145, 0164, 
-  0056, 0150, 0141, 0144, 0145, 0163, 0163, 0056, 0123, 0145, 0156, 0163, 0157, 0162, 0120, 0162, 
-  0157, 0170, 0171, 0056, 0103, 0154, 0141, 0151, 0155, 0103, 0157, 0155, 0160, 0141, 0163, 0163, 
-  0050, 0051, 0040, 0155, 0145, 0164, 0150, 0157, 0144, 0056, 0040, 0111, 0164, 0040, 0143, 0141, 
-  0156, 0040, 0144, 0157, 0040, 0163, 0157, 0012, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0167, 
-  0150, 0145, 0164, 0150, 0145, 0162, 0040, 0141, 0040, 0143, 0157, 0155, 0160, 0141, 0163, 0163, 
-  0040, 0151, 0163, 0040, 0141, 0166, 0141, 0151, 0154, 0141, 0142, 0154, 0145, 0040, 0157, 0162, 
-  0040, 0156, 0157, 0164, 0054, 0040, 0165, 0160, 0144, 0141, 0164, 0145, 0163, 0040, 0167, 0157, 
-  0165, 0154, 0144, 0040, 0164, 0150, 0145, 0156, 0040, 0142, 0145, 0040, 0163, 0145, 0156, 0164, 
-  0012, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0167, 0150, 0145, 0156, 0040, 0163, 0165, 0143, 
-  0150, 0040, 0141, 0040, 0163, 0145, 0156, 0163, 0157, 0162, 0040, 0141, 0160, 0160, 0145, 0141, 
-  0162, 0163, 0056, 0012, 0012, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0101, 0160, 0160, 0154, 
-  0151, 0143, 0141, 0164, 0151, 0157, 0156, 0163, 0040, 0163, 0150, 0157, 0165, 0154, 0144, 0040, 
-  0143, 0141, 0154, 0154, 0040, 0156, 0145, 0164, 0056, 0150, 0141, 0144, 0145, 0163, 0163, 0056, 
-  0123, 0145, 0156, 0163, 0157, 0162, 0120, 0162, 0157, 0170, 0171, 0056, 0122, 0145, 0154, 0145, 
-  0141, 0163, 0145, 0103, 0157, 0155, 0160, 0141, 0163, 0163, 0050, 0051, 0040, 0167, 0150, 0145, 
-  0156, 0040, 0162, 0145, 0141, 0144, 0151, 0156, 0147, 0163, 0040, 0141, 0162, 0145, 0012, 0040, 
-  0040, 0040, 0040, 0040, 0040, 0040, 0156, 0157, 0164, 0040, 0162, 0145, 0161, 0165, 0151, 0162, 
-  0145, 0144, 0040, 0141, 0156, 0171, 0155, 0157, 0162, 0145, 0056, 0040, 0124, 0150, 0151, 0163, 
-  0040, 0160, 0162, 0145, 0166, 0145, 0156, 0164, 0163, 0040, 0164, 0150, 0145, 0040, 0163, 0145, 
-  0156, 0163, 0157, 0162, 0040, 0160, 0162, 0157, 0170, 0171, 0040, 0146, 0162, 0157, 0155, 0040, 
-  0160, 0157, 0154, 0154, 0151, 0156, 0147, 0040, 0164, 0150, 0145, 0040, 0144, 0145, 0166, 0151, 
-  0143, 0145, 0054, 0040, 0164, 0150, 0165, 0163, 0012, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 
-  0151, 0156, 0143, 0162, 0145, 0141, 0163, 0151, 0156, 0147, 0040, 0167, 0141, 0153, 0145, 0055, 
-  0165, 0160, 0163, 0040, 0141, 0156, 0144, 0040, 0162, 0145, 0144, 0165, 0143, 0151, 0156, 0147, 
-  0040, 0142, 0141, 0164, 0164, 0145, 0162, 0171, 0040, 0154, 0151, 0146, 0145, 0056, 0012, 0012, 
-  0040, 0040, 0040, 0040, 0040, 0040, 0040, 0116, 0157, 0164, 0145, 0040, 0164, 0150, 0141, 0164, 
-  0040, 0103, 0157, 0155, 0160, 0141, 0163, 0163, 0040, 0151, 0156, 0146, 0157, 0162, 0155, 0141, 
-  0164, 0151, 0157, 0156, 0040, 0151, 0163, 0040, 0157, 0156, 0154, 0171, 0040, 0141, 0166, 0141, 
-  0151, 0154, 0141, 0142, 0154, 0145, 0040, 0164, 0157, 0040, 0107, 0145, 0157, 0143, 0154, 0165, 
-  0145, 0040, 0142, 0171, 0040, 0144, 0145, 0146, 0141, 0165, 0154, 0164, 0054, 0040, 0167, 0150, 
-  0151, 0143, 0150, 0040, 0167, 0151, 0154, 0154, 0012, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 
-  0160, 0162, 0157, 0170, 0171, 0040, 0164, 0150, 0145, 0040, 0155, 0141, 0147, 0156, 0145, 0164, 
-  0151, 0143, 0040, 0150, 0145, 0141, 0144, 0151, 0156, 0147, 0040, 0151, 0156, 0146, 0157, 0162, 
-  0155, 0141, 0164, 0151, 0157, 0156, 0054, 0040, 0141, 0156, 0144, 0040, 0164, 0162, 0141, 0156, 
-  0163, 0146, 0157, 0162, 0155, 0040, 0151, 0164, 0040, 0164, 0157, 0040, 0124, 0162, 0165, 0145, 
-  0040, 0116, 0157, 0162, 0164, 0150, 0040, 0150, 0145, 0141, 0144, 0151, 0156, 0147, 0056, 0012, 
-  0040, 0040, 0040, 0040, 0055, 0055, 0076, 0074, 0155, 0145, 0164, 0150, 0157, 0144, 0040, 0156, 
-  0141, 0155, 0145, 0075, 0042, 0103, 0154, 0141, 0151, 0155, 0103, 0157, 0155, 0160, 0141, 0163, 
-  0163, 0042, 0057, 0076, 0074, 0041, 0055, 0055, 0012, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 
-  0040, 0122, 0145, 0154, 0145, 0141, 0163, 0145, 0103, 0157, 0155, 0160, 0141, 0163, 0163, 0072, 
-  0012, 0012, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0124, 0150, 0151, 0163, 0040, 0163, 
-  0150, 0157, 0165, 0154, 0144, 0040, 0142, 0145, 0040, 0143, 0141, 0154, 0154, 0145, 0144, 0040, 
-  0141, 0163, 0040, 0163, 0157, 0157, 0156, 0040, 0141, 0163, 0040, 0162, 0145, 0141, 0144, 0151, 
-  0156, 0147, 0163, 0040, 0141, 0162, 0145, 0040, 0156, 0157, 0164, 0040, 0162, 0145, 0161, 0165, 
-  0151, 0162, 0145, 0144, 0040, 0141, 0156, 0171, 0155, 0157, 0162, 0145, 0056, 0040, 0116, 0157, 
-  0164, 0145, 0012, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0164, 0150, 0141, 0164, 0040, 
-  0162, 0145, 0163, 0157, 0165, 0162, 0143, 0145, 0163, 0040, 0141, 0162, 0145, 0040, 0146, 0162, 
-  0145, 0145, 0144, 0040, 0165, 0160, 0040, 0151, 0146, 0040, 0141, 0040, 0155, 0157, 0156, 0151, 
-  0164, 0157, 0162, 0151, 0156, 0147, 0040, 0141, 0160, 0160, 0154, 0151, 0143, 0141, 0164, 0151, 
-  0157, 0156, 0040, 0145, 0170, 0151, 0164, 0163, 0040, 0167, 0151, 0164, 0150, 0157, 0165, 0164, 
-  0012, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0040, 0143, 0141, 0154, 0154, 0151, 0156, 0147, 
-  0040, 0156, 0145, 0164, 0056, 0150, 0141, 0144, 0145, 0163, 0163, 0056, 0123, 0145, 0156, 0163, 
-  0157, 0162, 0120, 0162, 0157, 0170, 0171, 0056, 0122, 0145, 0154, 0145, 0141, 0163, 0145, 0103, 
-  0157, 0155, 0160, 0141, 0163, 0163, 0050, 0051, 0054, 0040, 0143, 0162, 0141, 0163, 0150, 0145, 
-  0163, 0040, 0157, 0162, 0040, 0164, 0150, 0145, 0040, 0163, 0145, 0156, 0163, 0157, 0162, 0040, 
-  0144, 0151, 0163, 0141, 0160, 0160, 0145, 0141, 0162, 0163, 0056, 0012, 0040, 0040, 0040, 0040, 
-  0055, 0055, 0076, 0074, 0155, 0145, 0164, 0150, 0157, 0144, 0040, 0156, 0141, 0155, 0145, 0075, 
-  0042, 0122, 0145, 0154, 0145, 0141, 0163, 0145, 0103, 0157, 0155, 0160, 0141, 0163, 0163, 0042, 
-  0057, 0076, 0074, 0057, 0151, 0156, 0164, 0145, 0162, 0146, 0141, 0143, 0145, 0076, 0074, 0057, 
-  0156, 0157, 0144, 0145, 0076, 0012, 0000, 0000, 0050, 0165, 0165, 0141, 0171, 0051, 0150, 0141, 
-  0144, 0145, 0163, 0163, 0057, 0000, 0000, 0000, 0004, 0000, 0000, 0000, 0123, 0145, 0156, 0163, 
-  0157, 0162, 0120, 0162, 0157, 0170, 0171, 0057, 0002, 0000, 0000, 0000
-} };
-#else /* _MSC_VER */
-static const SECTION union { const guint8 data[7597]; const double alignment; void * const ptr;}  iio_sensor_proxy_resource_data = {
-  "\107\126\141\162\151\141\156\164\000\000\000\000\000\000\000\000"
-  "\030\000\000\000\254\000\000\000\000\000\000\050\005\000\000\000"
-  "\000\000\000\000\003\000\000\000\003\000\000\000\003\000\000\000"
-  "\005\000\000\000\324\265\002\000\377\377\377\377\254\000\000\000"
-  "\001\000\114\000\260\000\000\000\264\000\000\000\112\216\217\013"
-  "\000\000\000\000\264\000\000\000\004\000\114\000\270\000\000\000"
-  "\274\000\000\000\322\324\141\114\004\000\000\000\274\000\000\000"
-  "\032\000\166\000\330\000\000\000\216\035\000\000\121\127\003\223"
-  "\001\000\000\000\216\035\000\000\007\000\114\000\230\035\000\000"
-  "\234\035\000\000\034\245\240\240\003\000\000\000\234\035\000\000"
-  "\014\000\114\000\250\035\000\000\254\035\000\000\057\000\000\000"
-  "\001\000\000\000\156\145\164\057\003\000\000\000\156\145\164\056"
-  "\150\141\144\145\163\163\056\123\145\156\163\157\162\120\162\157"
-  "\170\171\056\170\155\154\000\000\246\034\000\000\000\000\000\000"
-  "\074\077\170\155\154\040\166\145\162\163\151\157\156\075\042\061"
-  "\056\060\042\077\076\012\074\041\104\117\103\124\131\120\105\040"
-  "\156\157\144\145\040\120\125\102\114\111\103\040\042\055\057\057"
-  "\146\162\145\145\144\145\163\153\164\157\160\057\057\104\124\104"
-  "\040\104\055\102\125\123\040\117\142\152\145\143\164\040\111\156"
-  "\164\162\157\163\160\145\143\164\151\157\156\040\061\056\060\057"
-  "\057\105\116\042\040\042\150\164\164\160\072\057\057\167\167\167"
-  "\056\146\162\145\145\144\145\163\153\164\157\160\056\157\162\147"
-  "\057\163\164\141\156\144\141\162\144\163\057\144\142\165\163\057"
-  "\061\056\060\057\151\156\164\162\157\163\160\145\143\164\056\144"
-  "\164\144\042\076\012\074\156\157\144\145\076\074\041\055\055\012"
-  "\040\040\040\040\040\040\156\145\164\056\150\141\144\145\163\163"
-  "\056\123\145\156\163\157\162\120\162\157\170\171\072\012\040\040"
-  "\040\040\040\040\100\163\150\157\162\164\137\144\145\163\143\162"
-  "\151\160\164\151\157\156\072\040\104\055\102\165\163\040\160\162"
-  "\157\170\171\040\164\157\040\141\143\143\145\163\163\040\150\141"
-  "\162\144\167\141\162\145\040\163\145\156\163\157\162\163\012\012"
-  "\040\040\040\040\040\040\101\146\164\145\162\040\143\150\145\143"
-  "\153\151\156\147\040\164\150\145\040\141\166\141\151\154\141\142"
-  "\151\154\151\164\171\040\157\146\040\164\150\145\040\163\145\156"
-  "\163\157\162\040\164\171\160\145\040\171\157\165\040\167\141\156"
-  "\164\040\164\157\040\155\157\156\151\164\157\162\054\012\040\040"
-  "\040\040\040\040\143\141\154\154\040\164\150\145\040\156\145\164"
-  "\056\150\141\144\145\163\163\056\123\145\156\163\157\162\120\162"
-  "\157\170\171\056\103\154\141\151\155\101\143\143\145\154\145\162"
-  "\157\155\145\164\145\162\050\051\040\157\162\040\164\150\145\012"
-  "\040\040\040\040\040\040\156\145\164\056\150\141\144\145\163\163"
-  "\056\123\145\156\163\157\162\120\162\157\170\171\056\103\154\141"
-  "\151\155\114\151\147\150\164\050\051\040\155\145\164\150\157\144"
-  "\040\164\157\040\163\164\141\162\164\040\165\160\144\141\164\151"
-  "\156\147\040\164\150\145\040\160\162\157\160\145\162\164\151\145"
-  "\163\012\040\040\040\040\040\040\146\162\157\155\040\164\150\145"
-  "\040\150\141\162\144\167\141\162\145\040\162\145\141\144\151\156"
-  "\147\163\056\012\012\040\040\040\040\040\040\124\150\145\040\157"
-  "\142\152\145\143\164\040\160\141\164\150\040\167\151\154\154\040"
-  "\142\145\040\042\057\156\145\164\057\150\141\144\145\163\163\057"
-  "\123\145\156\163\157\162\120\162\157\170\171\042\056\012\040\040"
-  "\055\055\076\074\151\156\164\145\162\146\141\143\145\040\156\141"
-  "\155\145\075\042\156\145\164\056\150\141\144\145\163\163\056\123"
-  "\145\156\163\157\162\120\162\157\170\171\042\076\074\041\055\055"
-  "\012\040\040\040\040\040\040\040\040\110\141\163\101\143\143\145"
-  "\154\145\162\157\155\145\164\145\162\072\012\012\040\040\040\040"
-  "\040\040\040\040\127\150\145\164\150\145\162\040\141\040\163\165"
-  "\160\160\157\162\164\145\144\040\141\143\143\145\154\145\162\157"
-  "\155\145\164\145\162\040\151\163\040\160\162\145\163\145\156\164"
-  "\040\157\156\040\164\150\145\040\163\171\163\164\145\155\056\012"
-  "\040\040\040\040\055\055\076\074\160\162\157\160\145\162\164\171"
-  "\040\156\141\155\145\075\042\110\141\163\101\143\143\145\154\145"
-  "\162\157\155\145\164\145\162\042\040\164\171\160\145\075\042\142"
-  "\042\040\141\143\143\145\163\163\075\042\162\145\141\144\042\057"
-  "\076\074\041\055\055\012\040\040\040\040\040\040\040\040\101\143"
-  "\143\145\154\145\162\157\155\145\164\145\162\117\162\151\145\156"
-  "\164\141\164\151\157\156\072\012\012\040\040\040\040\040\040\040"
-  "\040\124\150\145\040\144\145\164\145\143\164\145\144\040\157\162"
-  "\151\145\156\164\141\164\151\157\156\040\157\146\040\164\150\145"
-  "\040\164\141\142\154\145\164\040\157\162\040\154\141\160\164\157"
-  "\160\056\012\040\040\040\040\040\040\040\040\120\157\163\163\151"
-  "\142\154\145\040\166\141\154\165\145\163\040\141\162\145\072\012"
-  "\040\040\040\040\040\040\040\040\055\040\165\156\144\145\146\151"
-  "\156\145\144\012\040\040\040\040\040\040\040\040\055\040\156\157"
-  "\162\155\141\154\012\040\040\040\040\040\040\040\040\055\040\142"
-  "\157\164\164\157\155\055\165\160\012\040\040\040\040\040\040\040"
-  "\040\055\040\154\145\146\164\055\165\160\012\040\040\040\040\040"
-  "\040\040\040\055\040\162\151\147\150\164\055\165\160\012\040\040"
-  "\040\040\055\055\076\074\160\162\157\160\145\162\164\171\040\156"
-  "\141\155\145\075\042\101\143\143\145\154\145\162\157\155\145\164"
-  "\145\162\117\162\151\145\156\164\141\164\151\157\156\042\040\164"
-  "\171\160\145\075\042\163\042\040\141\143\143\145\163\163\075\042"
-  "\162\145\141\144\042\057\076\074\041\055\055\012\040\040\040\040"
-  "\040\040\040\040\110\141\163\101\155\142\151\145\156\164\114\151"
-  "\147\150\164\072\012\012\040\040\040\040\040\040\040\040\127\150"
-  "\145\164\150\145\162\040\141\040\163\165\160\160\157\162\164\145"
-  "\144\040\141\155\142\151\145\156\164\040\154\151\147\150\164\040"
-  "\163\145\156\163\157\162\040\151\163\040\160\162\145\163\145\156"
-  "\164\040\157\156\040\164\150\145\040\163\171\163\164\145\155\056"
-  "\012\040\040\040\040\055\055\076\074\160\162\157\160\145\162\164"
-  "\171\040\156\141\155\145\075\042\110\141\163\101\155\142\151\145"
-  "\156\164\114\151\147\150\164\042\040\164\171\160\145\075\042\142"
-  "\042\040\141\143\143\145\163\163\075\042\162\145\141\144\042\057"
-  "\076\074\041\055\055\012\040\040\040\040\040\040\040\040\114\151"
-  "\147\150\164\114\145\166\145\154\125\156\151\164\072\012\012\040"
-  "\040\040\040\040\040\040\040\124\150\145\040\165\156\151\164\040"
-  "\165\163\145\144\040\151\156\040\101\155\142\151\145\156\164\040"
-  "\114\151\147\150\164\040\123\145\156\163\157\162\040\162\145\141"
-  "\144\151\156\147\163\056\040\111\164\040\151\163\012\040\040\040"
-  "\040\040\040\040\040\157\156\145\040\157\146\040\145\151\164\150"
-  "\145\162\040\042\154\165\170\042\040\157\162\040\042\166\145\156"
-  "\144\157\162\042\056\012\012\040\040\040\040\040\040\040\040\116"
-  "\157\164\145\040\164\150\141\164\040\144\151\146\146\145\162\145"
-  "\156\164\040\150\141\162\144\167\141\162\145\040\167\151\154\154"
-  "\040\150\141\166\145\040\144\151\146\146\145\162\145\156\164\040"
-  "\162\145\141\144\151\156\147\163\040\151\156\040\164\150\145\012"
-  "\040\040\040\040\040\040\040\040\163\141\155\145\040\143\157\156"
-  "\144\151\164\151\157\156\054\040\163\157\040\166\141\154\165\145"
-  "\163\040\163\150\157\165\154\144\040\142\145\040\164\141\153\145"
-  "\156\040\141\163\040\162\145\154\141\164\151\166\145\056\012\012"
-  "\040\040\040\040\040\040\040\040\127\150\145\156\040\164\150\145"
-  "\040\165\156\151\164\040\151\163\040\042\166\145\156\144\157\162"
-  "\042\054\040\162\145\141\144\151\156\147\163\040\167\151\154\154"
-  "\040\142\145\040\141\040\160\145\162\143\145\156\164\141\147\145"
-  "\040\167\151\164\150\040\061\060\060\045\040\142\145\151\156\147"
-  "\040\164\150\145\012\040\040\040\040\040\040\040\040\155\141\170"
-  "\151\155\165\155\040\162\145\141\144\151\156\147\056\012\040\040"
-  "\040\040\055\055\076\074\160\162\157\160\145\162\164\171\040\156"
-  "\141\155\145\075\042\114\151\147\150\164\114\145\166\145\154\125"
-  "\156\151\164\042\040\164\171\160\145\075\042\163\042\040\141\143"
-  "\143\145\163\163\075\042\162\145\141\144\042\057\076\074\041\055"
-  "\055\012\040\040\040\040\040\040\040\040\114\151\147\150\164\114"
-  "\145\166\145\154\072\012\012\040\040\040\040\040\040\040\040\124"
-  "\150\145\040\141\155\142\151\145\156\164\040\154\151\147\150\164"
-  "\040\163\145\156\163\157\162\040\162\145\141\144\151\156\147\054"
-  "\040\151\156\040\164\150\145\040\165\156\151\164\040\145\170\160"
-  "\157\162\164\145\144\040\151\156\040\164\150\145\012\040\040\040"
-  "\040\040\040\040\040\042\114\151\147\150\164\114\145\166\145\154"
-  "\125\156\151\164\042\040\160\162\157\160\145\162\164\171\056\012"
-  "\040\040\040\040\055\055\076\074\160\162\157\160\145\162\164\171"
-  "\040\156\141\155\145\075\042\114\151\147\150\164\114\145\166\145"
-  "\154\042\040\164\171\160\145\075\042\144\042\040\141\143\143\145"
-  "\163\163\075\042\162\145\141\144\042\057\076\074\041\055\055\012"
-  "\040\040\040\040\040\040\040\040\110\141\163\120\162\157\170\151"
-  "\155\151\164\171\072\012\012\040\040\040\040\040\040\040\040\127"
-  "\150\145\164\150\145\162\040\141\040\163\165\160\160\157\162\164"
-  "\145\144\040\160\162\157\170\151\155\151\164\171\040\163\145\156"
-  "\163\157\162\040\151\163\040\160\162\145\163\145\156\164\040\157"
-  "\156\040\164\150\145\040\163\171\163\164\145\155\056\012\040\040"
-  "\040\040\055\055\076\074\160\162\157\160\145\162\164\171\040\156"
-  "\141\155\145\075\042\110\141\163\120\162\157\170\151\155\151\164"
-  "\171\042\040\164\171\160\145\075\042\142\042\040\141\143\143\145"
-  "\163\163\075\042\162\145\141\144\042\057\076\074\041\055\055\012"
-  "\040\040\040\040\040\040\040\040\120\162\157\170\151\155\151\164"
-  "\171\116\145\141\162\072\012\012\040\040\040\040\040\040\040\040"
-  "\127\150\145\164\150\145\162\040\141\156\040\157\142\152\145\143"
-  "\164\040\151\163\040\156\145\141\162\040\164\157\040\164\150\145"
-  "\040\160\162\157\170\151\155\151\164\171\040\163\145\156\163\157"
-  "\162\056\012\040\040\040\040\055\055\076\074\160\162\157\160\145"
-  "\162\164\171\040\156\141\155\145\075\042\120\162\157\170\151\155"
-  "\151\164\171\116\145\141\162\042\040\164\171\160\145\075\042\142"
-  "\042\040\141\143\143\145\163\163\075\042\162\145\141\144\042\057"
-  "\076\074\041\055\055\012\040\040\040\040\040\040\040\103\154\141"
-  "\151\155\101\143\143\145\154\145\162\157\155\145\164\145\162\072"
-  "\012\012\040\040\040\040\040\040\040\124\157\040\163\164\141\162"
-  "\164\040\162\145\143\145\151\166\151\156\147\040\141\143\143\145"
-  "\154\145\162\157\155\145\164\145\162\040\162\145\141\144\151\156"
-  "\147\040\165\160\144\141\164\145\163\040\146\162\157\155\040\164"
-  "\150\145\040\160\162\157\170\171\054\040\164\150\145\040\141\160"
-  "\160\154\151\143\141\164\151\157\156\012\040\040\040\040\040\040"
-  "\040\155\165\163\164\040\143\141\154\154\040\164\150\145\040\156"
-  "\145\164\056\150\141\144\145\163\163\056\123\145\156\163\157\162"
-  "\120\162\157\170\171\056\103\154\141\151\155\101\143\143\145\154"
-  "\145\162\157\155\145\164\145\162\050\051\040\155\145\164\150\157"
-  "\144\056\040\111\164\040\143\141\156\040\144\157\040\163\157\012"
-  "\040\040\040\040\040\040\040\167\150\145\164\150\145\162\040\141"
-  "\156\040\141\143\143\145\154\145\162\157\155\145\164\145\162\040"
-  "\151\163\040\141\166\141\151\154\141\142\154\145\040\157\162\040"
-  "\156\157\164\054\040\165\160\144\141\164\145\163\040\167\157\165"
-  "\154\144\040\164\150\145\156\040\142\145\040\163\145\156\164\040"
-  "\167\150\145\156\040\141\156\012\040\040\040\040\040\040\040\141"
-  "\143\143\145\154\145\162\157\155\145\164\145\162\040\141\160\160"
-  "\145\141\162\163\056\012\012\040\040\040\040\040\040\040\101\160"
-  "\160\154\151\143\141\164\151\157\156\163\040\163\150\157\165\154"
-  "\144\040\143\141\154\154\040\156\145\164\056\150\141\144\145\163"
-  "\163\056\123\145\156\163\157\162\120\162\157\170\171\056\122\145"
-  "\154\145\141\163\145\101\143\143\145\154\145\162\157\155\145\164"
-  "\145\162\050\051\040\167\150\145\156\012\040\040\040\040\040\040"
-  "\040\162\145\141\144\151\156\147\163\040\141\162\145\040\156\157"
-  "\164\040\162\145\161\165\151\162\145\144\040\141\156\171\155\157"
-  "\162\145\056\040\106\157\162\040\145\170\141\155\160\154\145\054"
-  "\040\141\156\040\141\160\160\154\151\143\141\164\151\157\156\040"
-  "\164\150\141\164\040\155\157\156\151\164\157\162\163\012\040\040"
-  "\040\040\040\040\040\164\150\145\040\157\162\151\145\156\164\141"
-  "\164\151\157\156\040\157\146\040\164\150\145\040\155\141\151\156"
-  "\040\163\143\162\145\145\156\040\163\150\157\165\154\144\040\163"
-  "\164\157\160\040\155\157\156\151\164\157\162\151\156\147\040\146"
-  "\157\162\040\165\160\144\141\164\145\163\040\167\150\145\156\040"
-  "\164\150\141\164\012\040\040\040\040\040\040\040\163\143\162\145"
-  "\145\156\040\150\141\163\040\142\145\145\156\040\164\165\162\156"
-  "\145\144\040\157\146\146\056\012\012\040\040\040\040\040\040\040"
-  "\124\150\151\163\040\160\162\145\166\145\156\164\163\040\164\150"
-  "\145\040\163\145\156\163\157\162\040\160\162\157\170\171\040\146"
-  "\162\157\155\040\160\157\154\154\151\156\147\040\164\150\145\040"
-  "\144\145\166\151\143\145\054\040\164\150\165\163\040\151\156\143"
-  "\162\145\141\163\151\156\147\040\167\141\153\145\055\165\160\163"
-  "\012\040\040\040\040\040\040\040\141\156\144\040\162\145\144\165"
-  "\143\151\156\147\040\142\141\164\164\145\162\171\040\154\151\146"
-  "\145\056\012\040\040\040\040\055\055\076\074\155\145\164\150\157"
-  "\144\040\156\141\155\145\075\042\103\154\141\151\155\101\143\143"
-  "\145\154\145\162\157\155\145\164\145\162\042\057\076\074\041\055"
-  "\055\012\040\040\040\040\040\040\040\040\122\145\154\145\141\163"
-  "\145\101\143\143\145\154\145\162\157\155\145\164\145\162\072\012"
-  "\012\040\040\040\040\040\040\040\040\124\150\151\163\040\163\150"
-  "\157\165\154\144\040\142\145\040\143\141\154\154\145\144\040\141"
-  "\163\040\163\157\157\156\040\141\163\040\162\145\141\144\151\156"
-  "\147\163\040\141\162\145\040\156\157\164\040\162\145\161\165\151"
-  "\162\145\144\040\141\156\171\155\157\162\145\056\040\116\157\164"
-  "\145\012\040\040\040\040\040\040\040\040\164\150\141\164\040\162"
-  "\145\163\157\165\162\143\145\163\040\141\162\145\040\146\162\145"
-  "\145\144\040\165\160\040\151\146\040\141\040\155\157\156\151\164"
-  "\157\162\151\156\147\040\141\160\160\154\151\143\141\164\151\157"
-  "\156\040\145\170\151\164\163\040\167\151\164\150\157\165\164\012"
-  "\040\040\040\040\040\040\040\040\143\141\154\154\151\156\147\040"
-  "\156\145\164\056\150\141\144\145\163\163\056\123\145\156\163\157"
-  "\162\120\162\157\170\171\056\122\145\154\145\141\163\145\101\143"
-  "\143\145\154\145\162\157\155\145\164\145\162\050\051\054\040\143"
-  "\162\141\163\150\145\163\040\157\162\040\164\150\145\040\163\145"
-  "\156\163\157\162\040\144\151\163\141\160\160\145\141\162\163\056"
-  "\012\040\040\040\040\055\055\076\074\155\145\164\150\157\144\040"
-  "\156\141\155\145\075\042\122\145\154\145\141\163\145\101\143\143"
-  "\145\154\145\162\157\155\145\164\145\162\042\057\076\074\041\055"
-  "\055\012\040\040\040\040\040\040\040\103\154\141\151\155\114\151"
-  "\147\150\164\072\012\012\040\040\040\040\040\040\040\124\157\040"
-  "\163\164\141\162\164\040\162\145\143\145\151\166\151\156\147\040"
-  "\141\155\142\151\145\156\164\040\154\151\147\150\164\040\163\145"
-  "\156\163\157\162\040\162\145\141\144\151\156\147\040\165\160\144"
-  "\141\164\145\163\040\146\162\157\155\040\164\150\145\040\160\162"
-  "\157\170\171\054\040\164\150\145\012\040\040\040\040\040\040\040"
-  "\141\160\160\154\151\143\141\164\151\157\156\040\155\165\163\164"
-  "\040\143\141\154\154\040\164\150\145\040\156\145\164\056\150\141"
-  "\144\145\163\163\056\123\145\156\163\157\162\120\162\157\170\171"
-  "\056\103\154\141\151\155\114\151\147\150\164\050\051\040\155\145"
-  "\164\150\157\144\056\040\111\164\040\143\141\156\040\144\157\040"
-  "\163\157\012\040\040\040\040\040\040\040\167\150\145\164\150\145"
-  "\162\040\141\156\040\141\155\142\151\145\156\164\040\154\151\147"
-  "\150\164\040\163\145\156\163\157\162\040\151\163\040\141\166\141"
-  "\151\154\141\142\154\145\040\157\162\040\156\157\164\054\040\165"
-  "\160\144\141\164\145\163\040\167\157\165\154\144\040\164\150\145"
-  "\156\040\142\145\040\163\145\156\164\012\040\040\040\040\040\040"
-  "\040\167\150\145\156\040\163\165\143\150\040\141\040\163\145\156"
-  "\163\157\162\040\141\160\160\145\141\162\163\056\012\012\040\040"
-  "\040\040\040\040\040\101\160\160\154\151\143\141\164\151\157\156"
-  "\163\040\163\150\157\165\154\144\040\143\141\154\154\040\156\145"
-  "\164\056\150\141\144\145\163\163\056\123\145\156\163\157\162\120"
-  "\162\157\170\171\056\122\145\154\145\141\163\145\114\151\147\150"
-  "\164\050\051\040\167\150\145\156\040\162\145\141\144\151\156\147"
-  "\163\040\141\162\145\012\040\040\040\040\040\040\040\156\157\164"
-  "\040\162\145\161\165\151\162\145\144\040\141\156\171\155\157\162"
-  "\145\056\040\106\157\162\040\145\170\141\155\160\154\145\054\040"
-  "\141\156\040\141\160\160\154\151\143\141\164\151\157\156\040\164"
-  "\150\141\164\040\155\157\156\151\164\157\162\163\040\164\150\145"
-  "\040\141\155\142\151\145\156\164\040\154\151\147\150\164\012\040"
-  "\040\040\040\040\040\040\164\157\040\143\150\141\156\147\145\040"
-  "\164\150\145\040\163\143\162\145\145\156\040\142\162\151\147\150"
-  "\164\156\145\163\163\040\163\150\157\165\154\144\040\163\164\157"
-  "\160\040\155\157\156\151\164\157\162\151\156\147\040\146\157\162"
-  "\040\165\160\144\141\164\145\163\040\167\150\145\156\040\164\150"
-  "\141\164\040\163\143\162\145\145\156\012\040\040\040\040\040\040"
-  "\040\150\141\163\040\142\145\145\156\040\164\165\162\156\145\144"
-  "\040\157\146\146\056\012\012\040\040\040\040\040\040\040\124\150"
-  "\151\163\040\160\162\145\166\145\156\164\163\040\164\150\145\040"
-  "\163\145\156\163\157\162\040\160\162\157\170\171\040\146\162\157"
-  "\155\040\160\157\154\154\151\156\147\040\164\150\145\040\144\145"
-  "\166\151\143\145\054\040\164\150\165\163\040\151\156\143\162\145"
-  "\141\163\151\156\147\040\167\141\153\145\055\165\160\163\012\040"
-  "\040\040\040\040\040\040\141\156\144\040\162\145\144\165\143\151"
-  "\156\147\040\142\141\164\164\145\162\171\040\154\151\146\145\056"
-  "\012\040\040\040\040\055\055\076\074\155\145\164\150\157\144\040"
-  "\156\141\155\145\075\042\103\154\141\151\155\114\151\147\150\164"
-  "\042\057\076\074\041\055\055\012\040\040\040\040\040\040\040\040"
-  "\122\145\154\145\141\163\145\114\151\147\150\164\072\012\012\040"
-  "\040\040\040\040\040\040\040\124\150\151\163\040\163\150\157\165"
-  "\154\144\040\142\145\040\143\141\154\154\145\144\040\141\163\040"
-  "\163\157\157\156\040\141\163\040\162\145\141\144\151\156\147\163"
-  "\040\141\162\145\040\156\157\164\040\162\145\161\165\151\162\145"
-  "\144\040\141\156\171\155\157\162\145\056\040\116\157\164\145\012"
-  "\040\040\040\040\040\040\040\040\164\150\141\164\040\162\145\163"
-  "\157\165\162\143\145\163\040\141\162\145\040\146\162\145\145\144"
-  "\040\165\160\040\151\146\040\141\040\155\157\156\151\164\157\162"
-  "\151\156\147\040\141\160\160\154\151\143\141\164\151\157\156\040"
-  "\145\170\151\164\163\040\167\151\164\150\157\165\164\012\040\040"
-  "\040\040\040\040\040\040\143\141\154\154\151\156\147\040\156\145"
-  "\164\056\150\141\144\145\163\163\056\123\145\156\163\157\162\120"
-  "\162\157\170\171\056\122\145\154\145\141\163\145\114\151\147\150"
-  "\164\050\051\054\040\143\162\141\163\150\145\163\040\157\162\040"
-  "\164\150\145\040\163\145\156\163\157\162\040\144\151\163\141\160"
-  "\160\145\141\162\163\056\012\040\040\040\040\055\055\076\074\155"
-  "\145\164\150\157\144\040\156\141\155\145\075\042\122\145\154\145"
-  "\141\163\145\114\151\147\150\164\042\057\076\074\041\055\055\012"
-  "\040\040\040\040\040\040\040\103\154\141\151\155\120\162\157\170"
-  "\151\155\151\164\171\072\012\012\040\040\040\040\040\040\040\124"
-  "\157\040\163\164\141\162\164\040\162\145\143\145\151\166\151\156"
-  "\147\040\160\162\157\170\151\155\151\164\171\040\165\160\144\141"
-  "\164\145\163\040\146\162\157\155\040\164\150\145\040\160\162\157"
-  "\170\171\054\040\164\150\145\012\040\040\040\040\040\040\040\141"
-  "\160\160\154\151\143\141\164\151\157\156\040\155\165\163\164\040"
-  "\143\141\154\154\040\164\150\145\040\156\145\164\056\150\141\144"
-  "\145\163\163\056\123\145\156\163\157\162\120\162\157\170\171\056"
-  "\103\154\141\151\155\120\162\157\170\151\155\151\164\171\050\051"
-  "\040\155\145\164\150\157\144\056\040\111\164\040\143\141\156\040"
-  "\144\157\040\163\157\012\040\040\040\040\040\040\040\167\150\145"
-  "\164\150\145\162\040\141\040\160\162\157\170\151\155\151\164\171"
-  "\040\151\163\040\141\166\141\151\154\141\142\154\145\040\157\162"
-  "\040\156\157\164\054\040\165\160\144\141\164\145\163\040\167\157"
-  "\165\154\144\040\164\150\145\156\040\142\145\040\163\145\156\164"
-  "\012\040\040\040\040\040\040\040\167\150\145\156\040\163\165\143"
-  "\150\040\141\040\163\145\156\163\157\162\040\141\160\160\145\141"
-  "\162\163\056\012\012\040\040\040\040\040\040\040\101\160\160\154"
-  "\151\143\141\164\151\157\156\163\040\163\150\157\165\154\144\040"
-  "\143\141\154\154\040\156\145\164\056\150\141\144\145\163\163\056"
-  "\123\145\156\163\157\162\120\162\157\170\171\056\122\145\154\145"
-  "\141\163\145\120\162\157\170\151\155\151\164\171\050\051\040\167"
-  "\150\145\156\040\162\145\141\144\151\156\147\163\040\141\162\145"
-  "\012\040\040\040\040\040\040\040\156\157\164\040\162\145\161\165"
-  "\151\162\145\144\040\141\156\171\155\157\162\145\056\040\124\150"
-  "\151\163\040\160\162\145\166\145\156\164\163\040\164\150\145\040"
-  "\163\145\156\163\157\162\040\160\162\157\170\171\040\146\162\157"
-  "\155\040\160\157\154\154\151\156\147\040\164\150\145\040\144\145"
-  "\166\151\143\145\054\040\164\150\165\163\012\040\040\040\040\040"
-  "\040\040\151\156\143\162\145\141\163\151\156\147\040\167\141\153"
-  "\145\055\165\160\163\040\141\156\144\040\162\145\144\165\143\151"
-  "\156\147\040\142\141\164\164\145\162\171\040\154\151\146\145\056"
-  "\012\040\040\040\040\055\055\076\074\155\145\164\150\157\144\040"
-  "\156\141\155\145\075\042\103\154\141\151\155\120\162\157\170\151"
-  "\155\151\164\171\042\057\076\074\041\055\055\012\040\040\040\040"
-  "\040\040\040\040\122\145\154\145\141\163\145\120\162\157\170\151"
-  "\155\151\164\171\072\012\012\040\040\040\040\040\040\040\040\124"
-  "\150\151\163\040\163\150\157\165\154\144\040\142\145\040\143\141"
-  "\154\154\145\144\040\141\163\040\163\157\157\156\040\141\163\040"
-  "\162\145\141\144\151\156\147\163\040\141\162\145\040\156\157\164"
-  "\040\162\145\161\165\151\162\145\144\040\141\156\171\155\157\162"
-  "\145\056\040\116\157\164\145\012\040\040\040\040\040\040\040\040"
-  "\164\150\141\164\040\162\145\163\157\165\162\143\145\163\040\141"
-  "\162\145\040\146\162\145\145\144\040\165\160\040\151\146\040\141"
-  "\040\155\157\156\151\164\157\162\151\156\147\040\141\160\160\154"
-  "\151\143\141\164\151\157\156\040\145\170\151\164\163\040\167\151"
-  "\164\150\157\165\164\012\040\040\040\040\040\040\040\040\143\141"
-  "\154\154\151\156\147\040\156\145\164\056\150\141\144\145\163\163"
-  "\056\123\145\156\163\157\162\120\162\157\170\171\056\122\145\154"
-  "\145\141\163\145\120\162\157\170\151\155\151\164\171\050\051\054"
-  "\040\143\162\141\163\150\145\163\040\157\162\040\164\150\145\040"
-  "\163\145\156\163\157\162\040\144\151\163\141\160\160\145\141\162"
-  "\163\056\012\040\040\040\040\055\055\076\074\155\145\164\150\157"
-  "\144\040\156\141\155\145\075\042\122\145\154\145\141\163\145\120"
-  "\162\157\170\151\155\151\164\171\042\057\076\074\057\151\156\164"
-  "\145\162\146\141\143\145\076\074\041\055\055\012\040\040\040\040"
-  "\040\040\156\145\164\056\150\141\144\145\163\163\056\123\145\156"
-  "\163\157\162\120\162\157\170\171\056\103\157\155\160\141\163\163"
-  "\072\012\040\040\040\040\040\040\100\163\150\157\162\164\137\144"
-  "\145\163\143\162\151\160\164\151\157\156\072\040\104\055\102\165"
-  "\163\040\160\162\157\170\171\040\164\157\040\141\143\143\145\163"
-  "\163\040\103\157\155\160\141\163\163\040\163\145\156\163\157\162"
-  "\163\012\012\040\040\040\040\040\040\101\146\164\145\162\040\143"
-  "\150\145\143\153\151\156\147\040\164\150\145\040\141\166\141\151"
-  "\154\141\142\151\154\151\164\171\040\157\146\040\164\150\145\040"
-  "\163\145\156\163\157\162\040\164\171\160\145\040\171\157\165\040"
-  "\167\141\156\164\040\164\157\040\155\157\156\151\164\157\162\054"
-  "\012\040\040\040\040\040\040\143\141\154\154\040\164\150\145\040"
-  "\156\145\164\056\150\141\144\145\163\163\056\123\145\156\163\157"
-  "\162\120\162\157\170\171\056\103\154\141\151\155\103\157\155\160"
-  "\141\163\163\050\051\040\155\145\164\150\157\144\040\164\157\040"
-  "\163\164\141\162\164\040\165\160\144\141\164\151\156\147\012\040"
-  "\040\040\040\040\040\164\150\145\040\160\162\157\160\145\162\164"
-  "\151\145\163\040\146\162\157\155\040\164\150\145\040\150\141\162"
-  "\144\167\141\162\145\040\162\145\141\144\151\156\147\163\056\012"
-  "\012\040\040\040\040\040\040\124\150\145\040\157\142\152\145\143"
-  "\164\040\160\141\164\150\040\167\151\154\154\040\142\145\040\042"
-  "\057\156\145\164\057\150\141\144\145\163\163\057\123\145\156\163"
-  "\157\162\120\162\157\170\171\057\103\157\155\160\141\163\163\042"
-  "\056\012\040\040\055\055\076\074\151\156\164\145\162\146\141\143"
-  "\145\040\156\141\155\145\075\042\156\145\164\056\150\141\144\145"
-  "\163\163\056\123\145\156\163\157\162\120\162\157\170\171\056\103"
-  "\157\155\160\141\163\163\042\076\074\041\055\055\012\040\040\040"
-  "\040\040\040\040\040\110\141\163\103\157\155\160\141\163\163\072"
-  "\012\012\040\040\040\040\040\040\040\040\127\150\145\164\150\145"
-  "\162\040\141\040\163\165\160\160\157\162\164\145\144\040\143\157"
-  "\155\160\141\163\163\040\151\163\040\160\162\145\163\145\156\164"
-  "\040\157\156\040\164\150\145\040\163\171\163\164\145\155\056\012"
-  "\040\040\040\040\055\055\076\074\160\162\157\160\145\162\164\171"
-  "\040\156\141\155\145\075\042\110\141\163\103\157\155\160\141\163"
-  "\163\042\040\164\171\160\145\075\042\142\042\040\141\143\143\145"
-  "\163\163\075\042\162\145\141\144\042\057\076\074\041\055\055\012"
-  "\040\040\040\040\040\040\040\040\103\157\155\160\141\163\163\110"
-  "\145\141\144\151\156\147\072\012\012\040\040\040\040\040\040\040"
-  "\040\124\150\145\040\143\157\155\160\141\163\163\040\150\145\141"
-  "\144\151\156\147\040\151\156\040\144\145\147\162\145\145\163\040"
-  "\167\151\164\150\040\162\145\163\160\145\143\164\040\164\157\040"
-  "\155\141\147\156\145\164\151\143\040\116\157\162\164\150\040\144"
-  "\151\162\145\143\164\151\157\156\054\040\151\156\012\040\040\040"
-  "\040\040\040\040\040\143\154\157\143\153\167\151\163\145\040\157"
-  "\162\144\145\162\056\040\124\150\141\164\040\155\145\141\156\163"
-  "\040\116\157\162\164\150\040\142\145\143\157\155\145\163\040\060"
-  "\040\144\145\147\162\145\145\054\040\105\141\163\164\072\040\071"
-  "\060\040\144\145\147\162\145\145\163\054\012\040\040\040\040\040"
-  "\040\040\040\123\157\165\164\150\072\040\061\070\060\040\144\145"
-  "\147\162\145\145\163\054\040\127\145\163\164\072\040\062\067\060"
-  "\040\144\145\147\162\145\145\163\040\141\156\144\040\163\157\040"
-  "\157\156\056\040\127\150\145\156\040\165\156\153\156\157\167\156"
-  "\054\012\040\040\040\040\040\040\040\040\151\164\047\163\040\163"
-  "\145\164\040\164\157\040\055\061\056\060\056\012\040\040\040\040"
-  "\055\055\076\074\160\162\157\160\145\162\164\171\040\156\141\155"
-  "\145\075\042\103\157\155\160\141\163\163\110\145\141\144\151\156"
-  "\147\042\040\164\171\160\145\075\042\144\042\040\141\143\143\145"
-  "\163\163\075\042\162\145\141\144\042\057\076\074\041\055\055\012"
-  "\040\040\040\040\040\040\040\103\154\141\151\155\103\157\155\160"
-  "\141\163\163\072\012\012\040\040\040\040\040\040\040\124\157\040"
-  "\163\164\141\162\164\040\162\145\143\145\151\166\151\156\147\040"
-  "\143\157\155\160\141\163\163\040\150\145\141\144\151\156\147\040"
-  "\165\160\144\141\164\145\163\040\146\162\157\155\040\164\150\145"
-  "\040\160\162\157\170\171\054\040\164\150\145\012\040\040\040\040"
-  "\040\040\040\141\160\160\154\151\143\141\164\151\157\156\040\155"
-  "\165\163\164\040\143\141\154\154\040\164\150\145\040\156\145\164"
-  "\056\150\141\144\145\163\163\056\123\145\156\163\157\162\120\162"
-  "\157\170\171\056\103\154\141\151\155\103\157\155\160\141\163\163"
-  "\050\051\040\155\145\164\150\157\144\056\040\111\164\040\143\141"
-  "\156\040\144\157\040\163\157\012\040\040\040\040\040\040\040\167"
-  "\150\145\164\150\145\162\040\141\040\143\157\155\160\141\163\163"
-  "\040\151\163\040\141\166\141\151\154\141\142\154\145\040\157\162"
-  "\040\156\157\164\054\040\165\160\144\141\164\145\163\040\167\157"
-  "\165\154\144\040\164\150\145\156\040\142\145\040\163\145\156\164"
-  "\012\040\040\040\040\040\040\040\167\150\145\156\040\163\165\143"
-  "\150\040\141\040\163\145\156\163\157\162\040\141\160\160\145\141"
-  "\162\163\056\012\012\040\040\040\040\040\040\040\101\160\160\154"
-  "\151\143\141\164\151\157\156\163\040\163\150\157\165\154\144\040"
-  "\143\141\154\154\040\156\145\164\056\150\141\144\145\163\163\056"
-  "\123\145\156\163\157\162\120\162\157\170\171\056\122\145\154\145"
-  "\141\163\145\103\157\155\160\141\163\163\050\051\040\167\150\145"
-  "\156\040\162\145\141\144\151\156\147\163\040\141\162\145\012\040"
-  "\040\040\040\040\040\040\156\157\164\040\162\145\161\165\151\162"
-  "\145\144\040\141\156\171\155\157\162\145\056\040\124\150\151\163"
-  "\040\160\162\145\166\145\156\164\163\040\164\150\145\040\163\145"
-  "\156\163\157\162\040\160\162\157\170\171\040\146\162\157\155\040"
-  "\160\157\154\154\151\156\147\040\164\150\145\040\144\145\166\151"
-  "\143\145\054\040\164\150\165\163\012\040\040\040\040\040\040\040"
-  "\151\156\143\162\145\141\163\151\156\147\040\167\141\153\145\055"
-  "\165\160\163\040\141\156\144\040\162\145\144\165\143\151\156\147"
-  "\040\142\141\164\164\145\162\171\040\154\151\146\145\056\012\012"
-  "\040\040\040\040\040\040\040\116\157\164\145\040\164\150\141\164"
-  "\040\103\157\155\160\141\163\163\040\151\156\146\157\162\155\141"
-  "\164\151\157\156\040\151\163\040\157\156\154\171\040\141\166\141"
-  "\151\154\141\142\154\145\040\164\157\040\107\145\157\143\154\165"
-  "\145\040\142\171\040\144\145\146\141\165\154\164\054\040\167\150"
-  "\151\143\150\040\167\151\154\154\012\040\040\040\040\040\040\040"
-  "\160\162\157\170\171\040\164\150\145\040\155\141\147\156\145\164"
-  "\151\143\040\150\145\141\144\151\156\147\040\151\156\146\157\162"
-  "\155\141\164\151\157\156\054\040\141\156\144\040\164\162\141\156"
-  "\163\146\157\162\155\040\151\164\040\164\157\040\124\162\165\145"
-  "\040\116\157\162\164\150\040\150\145\141\144\151\156\147\056\012"
-  "\040\040\040\040\055\055\076\074\155\145\164\150\157\144\040\156"
-  "\141\155\145\075\042\103\154\141\151\155\103\157\155\160\141\163"
-  "\163\042\057\076\074\041\055\055\012\040\040\040\040\040\040\040"
-  "\040\122\145\154\145\141\163\145\103\157\155\160\141\163\163\072"
-  "\012\012\040\040\040\040\040\040\040\040\124\150\151\163\040\163"
-  "\150\157\165\154\144\040\142\145\040\143\141\154\154\145\144\040"
-  "\141\163\040\163\157\157\156\040\141\163\040\162\145\141\144\151"
-  "\156\147\163\040\141\162\145\040\156\157\164\040\162\145\161\165"
-  "\151\162\145\144\040\141\156\171\155\157\162\145\056\040\116\157"
-  "\164\145\012\040\040\040\040\040\040\040\040\164\150\141\164\040"
-  "\162\145\163\157\165\162\143\145\163\040\141\162\145\040\146\162"
-  "\145\145\144\040\165\160\040\151\146\040\141\040\155\157\156\151"
-  "\164\157\162\151\156\147\040\141\160\160\154\151\143\141\164\151"
-  "\157\156\040\145\170\151\164\163\040\167\151\164\150\157\165\164"
-  "\012\040\040\040\040\040\040\040\040\143\141\154\154\151\156\147"
-  "\040\156\145\164\056\150\141\144\145\163\163\056\123\145\156\163"
-  "\157\162\120\162\157\170\171\056\122\145\154\145\141\163\145\103"
-  "\157\155\160\141\163\163\050\051\054\040\143\162\141\163\150\145"
-  "\163\040\157\162\040\164\150\145\040\163\145\156\163\157\162\040"
-  "\144\151\163\141\160\160\145\141\162\163\056\012\040\040\040\040"
-  "\055\055\076\074\155\145\164\150\157\144\040\156\141\155\145\075"
-  "\042\122\145\154\145\141\163\145\103\157\155\160\141\163\163\042"
-  "\057\076\074\057\151\156\164\145\162\146\141\143\145\076\074\057"
-  "\156\157\144\145\076\012\000\000\050\165\165\141\171\051\150\141"
-  "\144\145\163\163\057\000\000\000\004\000\000\000\123\145\156\163"
-  "\157\162\120\162\157\170\171\057\002\000\000\000" };
-#endif /* !_MSC_VER */
-
-static GStaticResource static_resource = { iio_sensor_proxy_resource_data.data, sizeof (iio_sensor_proxy_resource_data.data) - 1 /* nul terminator */, NULL, NULL, NULL };
-extern GResource *iio_sensor_proxy_get_resource (void);
-GResource *iio_sensor_proxy_get_resource (void)
-{
-  return g_static_resource_get_resource (&static_resource);
-}
-/*
-  If G_HAS_CONSTRUCTORS is true then the compiler support *both* constructors and
-  destructors, in a sane way, including e.g. on library unload. If not you're on
-  your own.
-
-  Some compilers need #pragma to handle this, which does not work with macros,
-  so the way you need to use this is (for constructors):
-
-  #ifdef G_DEFINE_CONSTRUCTOR_NEEDS_PRAGMA
-  #pragma G_DEFINE_CONSTRUCTOR_PRAGMA_ARGS(my_constructor)
-  #endif
-  G_DEFINE_CONSTRUCTOR(my_constructor)
-  static void my_constructor(void) {
-   ...
-  }
-
-*/
-
-#ifndef __GTK_DOC_IGNORE__
-
-#if  __GNUC__ > 2 || (__GNUC__ == 2 && __GNUC_MINOR__ >= 7)
-
-#define G_HAS_CONSTRUCTORS 1
-
-#define G_DEFINE_CONSTRUCTOR(_func) static void __attribute__((constructor)) _func (void);
-#define G_DEFINE_DESTRUCTOR(_func) static void __attribute__((destructor)) _func (void);
-
-#elif defined (_MSC_VER) && (_MSC_VER >= 1500)
-/* Visual studio 2008 and later has _Pragma */
-
-#include <stdlib.h>
-
-#define G_HAS_CONSTRUCTORS 1
-
-/* We do some weird things to avoid the constructors being optimized
- * away on VS2015 if WholeProgramOptimization is enabled. First we
- * make a reference to the array from the wrapper to make sure its
- * references. Then we use a pragma to make sure the wrapper function
- * symbol is always included at the link stage. Also, the symbols
- * need to be extern (but not dllexport), even though they are not
- * really used from another object file.
- */
-
-/* We need to account for differences between the mangling of symbols
- * for Win32 (x86) and x64 programs, as symbols on Win32 are prefixed
- * with an underscore but symbols on x64 are not.
- */
-#ifdef _WIN64
-#define G_MSVC_SYMBOL_PREFIX ""
-#else
-#define G_MSVC_SYMBOL_PREFIX "_"
-#endif
-
-#define G_DEFINE_CONSTRUCTOR(_func) G_MSVC_CTOR (_func, G_MSVC_SYMBOL_PREFIX)
-#define G_DEFINE_DESTRUCTOR(_func) G_MSVC_DTOR (_func, G_MSVC_SYMBOL_PREFIX)
-
-#define G_MSVC_CTOR(_func,_sym_prefix) \
-  static void _func(void); \
-  extern int (* _array ## _func)(void);              \
-  int _func ## _wrapper(void) { _func(); g_slist_find (NULL,  _array ## _func); return 0; } \
-  __pragma(comment(linker,"/include:" _sym_prefix # _func "_wrapper")) \
-  __pragma(section(".CRT$XCU",read)) \
-  __declspec(allocate(".CRT$XCU")) int (* _array ## _func)(void) = _func ## _wrapper;
-
-#define G_MSVC_DTOR(_func,_sym_prefix) \
-  static void _func(void); \
-  extern int (* _array ## _func)(void);              \
-  int _func ## _constructor(void) { atexit (_func); g_slist_find (NULL,  _array ## _func); return 0; } \
-   __pragma(comment(linker,"/include:" _sym_prefix # _func "_constructor")) \
-  __pragma(section(".CRT$XCU",read)) \
-  __declspec(allocate(".CRT$XCU")) int (* _array ## _func)(void) = _func ## _constructor;
-
-#elif defined (_MSC_VER)
-
-#define G_HAS_CONSTRUCTORS 1
-
-/* Pre Visual studio 2008 must use #pragma section */
-#define G_DEFINE_CONSTRUCTOR_NEEDS_PRAGMA 1
-#define G_DEFINE_DESTRUCTOR_NEEDS_PRAGMA 1
-
-#define G_DEFINE_CONSTRUCTOR_PRAGMA_ARGS(_func) \
-  section(".CRT$XCU",read)
-#define G_DEFINE_CONSTRUCTOR(_func) \
-  static void _func(void); \
-  static int _func ## _wrapper(void) { _func(); return 0; } \
-  __declspec(allocate(".CRT$XCU")) static int (*p)(void) = _func ## _wrapper;
-
-#define G_DEFINE_DESTRUCTOR_PRAGMA_ARGS(_func) \
-  section(".CRT$XCU",read)
-#define G_DEFINE_DESTRUCTOR(_func) \
-  static void _func(void); \
-  static int _func ## _constructor(void) { atexit (_func); return 0; } \
-  __declspec(allocate(".CRT$XCU")) static int (* _array ## _func)(void) = _func ## _constructor;
-
-#elif defined(__SUNPRO_C)
-
-/* This is not tested, but i believe it should work, based on:
- * http://opensource.apple.com/source/OpenSSL098/OpenSSL098-35/src/fips/fips_premain.c
- */
-
-#define G_HAS_CONSTRUCTORS 1
-
-#define G_DEFINE_CONSTRUCTOR_NEEDS_PRAGMA 1
-#define G_DEFINE_DESTRUCTOR_NEEDS_PRAGMA 1
-
-#define G_DEFINE_CONSTRUCTOR_PRAGMA_ARGS(_func) \
-  init(_func)
-#define G_DEFINE_CONSTRUCTOR(_func) \
-  static void _func(void);
-
-#define G_DEFINE_DESTRUCTOR_PRAGMA_ARGS(_func) \
-  fini(_func)
-#define G_DEFINE_DESTRUCTOR(_func) \
-  static void _func(void);
-
-#else
-
-/* constructors not supported for this compiler */
-
-#endif
-
-#endif /* __GTK_DOC_IGNORE__ */
-
-#ifdef G_HAS_CONSTRUCTORS
-
-#ifdef G_DEFINE_CONSTRUCTOR_NEEDS_PRAGMA
-#pragma G_DEFINE_CONSTRUCTOR_PRAGMA_ARGS(resource_constructor)
-#endif
-G_DEFINE_CONSTRUCTOR(resource_constructor)
-#ifdef G_DEFINE_DESTRUCTOR_NEEDS_PRAGMA
-#pragma G_DEFINE_DESTRUCTOR_PRAGMA_ARGS(resource_destructor)
-#endif
-G_DEFINE_DESTRUCTOR(resource_destructor)
-
-#else
-#warning "Constructor not supported on this compiler, linking in resources will not work"
-#endif
-
-static void resource_constructor (void)
-{
-  g_static_resource_init (&static_resource);
-}
-
-static void resource_destructor (void)
-{
-  g_static_resource_fini (&static_resource);
-}
@@ -1,7 +0,0 @@
-#ifndef __RESOURCE_iio_sensor_proxy_H__
-#define __RESOURCE_iio_sensor_proxy_H__
-
-#include <gio/gio.h>
-
-extern GResource *iio_sensor_proxy_get_resource (void);
-#endif
@@ -13,66 +13,140 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <string.h>
+#include <math.h>
 #include <stdlib.h>
 #include <stdio.h>
 
 #include <gio/gio.h>
+#include <gio/gunixfdlist.h>
 #include <gudev/gudev.h>
 
 #include "orientation.h"
-#include "iio-sensor-proxy-resources.h"
+#include "emission-scheduler.h"
+#include "signal-template.h"
+#include "sensor-state.h"
+#include "change-filter.h"
+#include "sample-stream.h"
+#include "dbus-schema.h"
+#include "rotation-fusion.h"
+#include "tilt-compass.h"
 
 #include "sensorfw-core/console_log.h"
-#include "sensorfw-core/sensorfw_proximity_sensor.h"
-#include "sensorfw-core/sensorfw_light_sensor.h"
-#include "sensorfw-core/sensorfw_orientation_sensor.h"
-#include "sensorfw-core/sensorfw_compass_sensor.h"
+#include "sensorfw-core/sensorfw_sensor.h"
 
-#define SENSOR_PROXY_DBUS_NAME          "net.hadess.SensorProxy"
-#define SENSOR_PROXY_DBUS_PATH          "/net/hadess/SensorProxy"
-#define SENSOR_PROXY_COMPASS_DBUS_PATH  "/net/hadess/SensorProxy/Compass"
-#define SENSOR_PROXY_IFACE_NAME         SENSOR_PROXY_DBUS_NAME
-#define SENSOR_PROXY_COMPASS_IFACE_NAME SENSOR_PROXY_DBUS_NAME ".Compass"
-
-#define NUM_SENSOR_TYPES DRIVER_TYPE_PROXIMITY + 1
+#define NUM_SENSOR_TYPES DRIVER_TYPE_TAP + 1
 
 typedef enum {
 	DRIVER_TYPE_ACCEL,
 	DRIVER_TYPE_LIGHT,
 	DRIVER_TYPE_COMPASS,
 	DRIVER_TYPE_PROXIMITY,
+	DRIVER_TYPE_GYROSCOPE,
+	DRIVER_TYPE_PRESSURE,
+	DRIVER_TYPE_TEMPERATURE,
+	DRIVER_TYPE_HUMIDITY,
+	DRIVER_TYPE_STEP_COUNTER,
+	DRIVER_TYPE_TAP,
 } DriverType;
 
 typedef struct {
 	GMainLoop *loop;
 	GUdevClient *client;
-	GDBusNodeInfo *introspection_data;
 	GDBusConnection *connection;
 	guint name_id;
 	int ret;
 
-	GHashTable   *clients[NUM_SENSOR_TYPES]; /* key = D-Bus name, value = watch ID */
+	EmissionScheduler *emission_scheduler;
+	GHashTable        *signal_templates; /* key = mask and string values, value = SignalTemplate */
+	GVariant          *properties[SCHEMA_N_INTERFACES]; /* a{sv}, NULL when stale */
+	GVariant          *property_values[SCHEMA_N_PROPERTIES];
+	guint              unicast_fanout; /* 0 to always broadcast */
+
+	GHashTable   *clients; /* key = D-Bus name, value = ClientRecord */
+	guint         n_claims[NUM_SENSOR_TYPES];
+
+	/* Optional private socket, see setup_peer_server() */
+	GDBusServer  *peer_server;
+	GHashTable   *peers; /* key = made-up unique name, value = GDBusConnection */
+	guint         peer_serial;
+	guint         peer_uid;
+
+	/* Full-rate sample streams, see sample-stream.h */
+	SampleStreamSet *streams[NUM_SENSOR_TYPES];
+	guint            stream_capacity;
+
+	/* ms between samples when nobody asked for a rate, 0 for sensord's */
+	guint            sample_interval[NUM_SENSOR_TYPES];
+
+	/* Display and suspend hints driving the sensor policies */
+	gboolean display_on;
+	gboolean suspended;
+	guint display_signal_id;
+	guint sleep_signal_id;
+
+	/* Latest readings, see sensor-state.h */
+	SensorState *state;
 
 	/* Orientation */
-	OrientationUp previous_orientation;
 	gboolean accel_avaliable;
-	std::shared_ptr<repowerd::OrientationSensor> orientation_sensor;
+	std::shared_ptr<repowerd::Sensor<repowerd::OrientationPlugin::Value>> orientation_sensor;
+	/* Preferred over orientation_sensor, computed here, see orientation.h */
+	std::shared_ptr<repowerd::Sensor<repowerd::AccelerometerPlugin::Value>> accelerometer_sensor;
+	GravityFilter gravity_filter;
+	OrientationThresholds orientation_thresholds;
+	OrientationUp orientation; /* last computed from the accelerometer */
 
 	/* Light */
-	gdouble previous_level;
-	gboolean uses_lux;
 	gboolean light_avaliable;
-	std::shared_ptr<repowerd::LightSensor> light_sensor;
+	ChangeFilter *light_filter;
+	std::shared_ptr<repowerd::Sensor<repowerd::LightPlugin::Value>> light_sensor;
 
 	/* Compass */
-	gdouble previous_heading;
 	gboolean compass_avaliable;
-	std::shared_ptr<repowerd::CompassSensor> compass_sensor;
+	ChangeFilter *compass_filter;
+	std::shared_ptr<repowerd::Sensor<repowerd::CompassPlugin::Value>> compass_sensor;
+	/* Preferred over compass_sensor when the raw accelerometer is there */
+	TiltCompass *tilt_compass;
+	std::shared_ptr<repowerd::Sensor<repowerd::MagnetometerPlugin::Value>> magnetometer_sensor;
 
 	/* Proximity */
-	gboolean previous_prox_near;
 	gboolean prox_avaliable;
-	std::shared_ptr<repowerd::ProximitySensor> proximity_sensor;
+	guint prox_near_threshold; /* raw value, 0 to go by sensord */
+	guint prox_hysteresis;
+	gboolean prox_near; /* only used by the proximity thread */
+	std::shared_ptr<repowerd::Sensor<repowerd::ProximityPlugin::Value>> proximity_sensor;
+
+	/* Gyroscope, fused with the accelerometer on its own thread */
+	gboolean gyro_avaliable;
+	RotationFusion *fusion;
+	std::shared_ptr<repowerd::Sensor<repowerd::GyroscopePlugin::Value>> gyroscope_sensor;
+
+	/* Pressure */
+	gboolean pressure_avaliable;
+	ChangeFilter *pressure_filter;
+	std::atomic<gdouble> altitude_reference; /* hPa, 0 until the first reading */
+	std::shared_ptr<repowerd::Sensor<repowerd::PressurePlugin::Value>> pressure_sensor;
+
+	/* Temperature and humidity */
+	gboolean temperature_avaliable;
+	ChangeFilter *temperature_filter;
+	std::shared_ptr<repowerd::Sensor<repowerd::TemperaturePlugin::Value>> temperature_sensor;
+	gboolean humidity_avaliable;
+	ChangeFilter *humidity_filter;
+	std::shared_ptr<repowerd::Sensor<repowerd::HumidityPlugin::Value>> humidity_sensor;
+
+	/* Step counter, the offset and last counts are only used by
+	 * its thread */
+	gboolean step_counter_avaliable;
+	gboolean step_primed;
+	gint64 step_offset;
+	guint32 step_raw;
+	guint32 step_count;
+	std::shared_ptr<repowerd::Sensor<repowerd::StepCounterPlugin::Value>> step_counter_sensor;
+
+	/* Tap */
+	gboolean tap_avaliable;
+	std::shared_ptr<repowerd::Sensor<repowerd::TapPlugin::Value>> tap_sensor;
 } SensorData;
 
 static const char *
@@ -87,6 +161,18 @@ driver_type_to_str (DriverType type)
 		return "compass";
 	case DRIVER_TYPE_PROXIMITY:
 		return "proximity";
+	case DRIVER_TYPE_GYROSCOPE:
+		return "gyroscope";
+	case DRIVER_TYPE_PRESSURE:
+		return "pressure";
+	case DRIVER_TYPE_TEMPERATURE:
+		return "temperature";
+	case DRIVER_TYPE_HUMIDITY:
+		return "humidity";
+	case DRIVER_TYPE_STEP_COUNTER:
+		return "step-counter";
+	case DRIVER_TYPE_TAP:
+		return "tap";
 	default:
 		g_assert_not_reached ();
 	}
@@ -105,538 +191,2085 @@ driver_type_exists (SensorData *data,
 		return (data->compass_avaliable == TRUE);
 	case DRIVER_TYPE_PROXIMITY:
 		return (data->prox_avaliable == TRUE);
+	case DRIVER_TYPE_GYROSCOPE:
+		return (data->gyro_avaliable == TRUE);
+	case DRIVER_TYPE_PRESSURE:
+		return (data->pressure_avaliable == TRUE);
+	case DRIVER_TYPE_TEMPERATURE:
+		return (data->temperature_avaliable == TRUE);
+	case DRIVER_TYPE_HUMIDITY:
+		return (data->humidity_avaliable == TRUE);
+	case DRIVER_TYPE_STEP_COUNTER:
+		return (data->step_counter_avaliable == TRUE);
+	case DRIVER_TYPE_TAP:
+		return (data->tap_avaliable == TRUE);
 	default:
 		return FALSE;
 	}
 	return FALSE;
 }
 
+/* Everything a client holds, behind a single name watch */
+typedef struct {
+	guint watch_id;
+	guint claimed; /* 1 << DriverType */
+	guint streams; /* 1 << DriverType */
+} ClientRecord;
+
 static void
-free_client_watch (gpointer data)
+free_client_record (gpointer data)
 {
-	guint watch_id = GPOINTER_TO_UINT (data);
+	ClientRecord *record = (ClientRecord *) data;
 
-	if (watch_id == 0)
-		return;
-	g_bus_unwatch_name (watch_id);
+	if (record->watch_id != 0)
+		g_bus_unwatch_name (record->watch_id);
+	g_free (record);
 }
 
 static GHashTable *
 create_clients_hash_table (void)
 {
 	return g_hash_table_new_full (g_str_hash, g_str_equal,
-				      g_free, free_client_watch);
-}
-
-enum {
-	PROP_HAS_ACCELEROMETER		= 1 << 0,
-	PROP_ACCELEROMETER_ORIENTATION  = 1 << 1,
-	PROP_HAS_AMBIENT_LIGHT		= 1 << 2,
-	PROP_LIGHT_LEVEL		= 1 << 3,
-	PROP_HAS_COMPASS                = 1 << 4,
-	PROP_COMPASS_HEADING            = 1 << 5,
-	PROP_HAS_PROXIMITY              = 1 << 6,
-	PROP_PROXIMITY_NEAR             = 1 << 7,
-};
+				      g_free, free_client_record);
+}
 
-#define PROP_ALL (PROP_HAS_ACCELEROMETER | \
-                  PROP_ACCELEROMETER_ORIENTATION | \
-                  PROP_HAS_AMBIENT_LIGHT | \
-                  PROP_LIGHT_LEVEL | \
-                  PROP_HAS_PROXIMITY | \
-		  PROP_PROXIMITY_NEAR)
-#define PROP_ALL_COMPASS (PROP_HAS_COMPASS | \
-			  PROP_COMPASS_HEADING)
+/* Peer connections have no bus daemon handing out unique names,
+ * so each gets one of ours, ":peer.N", stored under this key */
+#define PEER_NAME_KEY "hadess-sensorfw-peer-name"
 
-static void
-send_dbus_event (SensorData     *data,
-		 int  mask)
-{
-	GVariantBuilder props_builder;
-	GVariant *props_changed = NULL;
+/* PROP_* come from dbus-schema.h */
+#define PROP_ALL SCHEMA_PROPS_ALL
+#define PROP_ROTATION_VECTOR (PROP_ROTATION_VECTOR_W | PROP_ROTATION_VECTOR_X | \
+			      PROP_ROTATION_VECTOR_Y | PROP_ROTATION_VECTOR_Z)
 
-	if (data->connection == NULL)
-		return;
+/* Values of the HasX properties go along with the HasX property itself */
+static int
+expand_dbus_event_mask (SensorData *data,
+			int         mask)
+{
+	/* Send the orientation when the device appears, without
+	 * an accelerometer it stays undefined */
+	if ((mask & PROP_HAS_ACCELEROMETER) && driver_type_exists (data, DRIVER_TYPE_ACCEL))
+		mask |= PROP_ACCELEROMETER_ORIENTATION;
+
+	/* Send the light level when the device appears */
+	if ((mask & PROP_HAS_AMBIENT_LIGHT) && driver_type_exists (data, DRIVER_TYPE_LIGHT))
+		mask |= PROP_LIGHT_LEVEL;
+
+	/* The level can't be read without its unit */
+	if (mask & PROP_LIGHT_LEVEL)
+		mask |= PROP_LIGHT_LEVEL_UNIT;
+
+	/* Send the heading when the device appears */
+	if ((mask & PROP_HAS_COMPASS) && driver_type_exists (data, DRIVER_TYPE_COMPASS))
+		mask |= PROP_COMPASS_HEADING;
+
+	/* Send proximity information when the device appears */
+	if ((mask & PROP_HAS_PROXIMITY) && driver_type_exists (data, DRIVER_TYPE_PROXIMITY))
+		mask |= PROP_PROXIMITY_NEAR | PROP_PROXIMITY_VALUE;
+
+	/* Send the attitude when the device appears */
+	if ((mask & PROP_HAS_GYROSCOPE) && driver_type_exists (data, DRIVER_TYPE_GYROSCOPE))
+		mask |= PROP_ROTATION_VECTOR;
+
+	/* Send the pressure when the device appears */
+	if ((mask & PROP_HAS_PRESSURE) && driver_type_exists (data, DRIVER_TYPE_PRESSURE))
+		mask |= PROP_PRESSURE | PROP_ALTITUDE;
+
+	/* Send the readings when the devices appear */
+	if ((mask & PROP_HAS_TEMPERATURE) && driver_type_exists (data, DRIVER_TYPE_TEMPERATURE))
+		mask |= PROP_TEMPERATURE;
+	if ((mask & PROP_HAS_HUMIDITY) && driver_type_exists (data, DRIVER_TYPE_HUMIDITY))
+		mask |= PROP_RELATIVE_HUMIDITY;
+	if ((mask & PROP_HAS_STEP_COUNTER) && driver_type_exists (data, DRIVER_TYPE_STEP_COUNTER))
+		mask |= PROP_STEP_COUNT;
+
+	/* The components only make sense together */
+	if (mask & PROP_ROTATION_VECTOR)
+		mask |= PROP_ROTATION_VECTOR;
+
+	return mask;
+}
 
-	if (mask == 0)
-		return;
+static GVariant *
+build_property_value (SensorData           *data,
+		      const SensorSnapshot *snapshot,
+		      SchemaProperty        property)
+{
+	switch (property) {
+	case SCHEMA_PROPERTY_HAS_ACCELEROMETER:
+		return g_variant_new_boolean (driver_type_exists (data, DRIVER_TYPE_ACCEL));
+	case SCHEMA_PROPERTY_ACCELEROMETER_ORIENTATION:
+		return g_variant_new_string (orientation_to_string ((OrientationUp) snapshot->orientation));
+	case SCHEMA_PROPERTY_HAS_AMBIENT_LIGHT:
+		return g_variant_new_boolean (driver_type_exists (data, DRIVER_TYPE_LIGHT));
+	case SCHEMA_PROPERTY_LIGHT_LEVEL_UNIT:
+		return g_variant_new_string (snapshot->uses_lux ? "lux" : "vendor");
+	case SCHEMA_PROPERTY_LIGHT_LEVEL:
+		return g_variant_new_double (snapshot->level);
+	case SCHEMA_PROPERTY_HAS_PROXIMITY:
+		return g_variant_new_boolean (driver_type_exists (data, DRIVER_TYPE_PROXIMITY));
+	case SCHEMA_PROPERTY_PROXIMITY_NEAR:
+		return g_variant_new_boolean (snapshot->prox_near);
+	case SCHEMA_PROPERTY_PROXIMITY_VALUE:
+		return g_variant_new_uint32 (snapshot->prox_value);
+	case SCHEMA_PROPERTY_HAS_COMPASS:
+		return g_variant_new_boolean (driver_type_exists (data, DRIVER_TYPE_COMPASS));
+	case SCHEMA_PROPERTY_COMPASS_HEADING:
+		return g_variant_new_double (snapshot->heading);
+	case SCHEMA_PROPERTY_HAS_GYROSCOPE:
+		return g_variant_new_boolean (driver_type_exists (data, DRIVER_TYPE_GYROSCOPE));
+	case SCHEMA_PROPERTY_ROTATION_VECTOR_W:
+		return g_variant_new_double (snapshot->rotation[0]);
+	case SCHEMA_PROPERTY_ROTATION_VECTOR_X:
+		return g_variant_new_double (snapshot->rotation[1]);
+	case SCHEMA_PROPERTY_ROTATION_VECTOR_Y:
+		return g_variant_new_double (snapshot->rotation[2]);
+	case SCHEMA_PROPERTY_ROTATION_VECTOR_Z:
+		return g_variant_new_double (snapshot->rotation[3]);
+	case SCHEMA_PROPERTY_HAS_PRESSURE:
+		return g_variant_new_boolean (driver_type_exists (data, DRIVER_TYPE_PRESSURE));
+	case SCHEMA_PROPERTY_PRESSURE:
+		return g_variant_new_double (snapshot->pressure);
+	case SCHEMA_PROPERTY_ALTITUDE:
+		return g_variant_new_double (snapshot->altitude);
+	case SCHEMA_PROPERTY_HAS_TEMPERATURE:
+		return g_variant_new_boolean (driver_type_exists (data, DRIVER_TYPE_TEMPERATURE));
+	case SCHEMA_PROPERTY_TEMPERATURE:
+		return g_variant_new_double (snapshot->temperature);
+	case SCHEMA_PROPERTY_HAS_HUMIDITY:
+		return g_variant_new_boolean (driver_type_exists (data, DRIVER_TYPE_HUMIDITY));
+	case SCHEMA_PROPERTY_RELATIVE_HUMIDITY:
+		return g_variant_new_double (snapshot->humidity);
+	case SCHEMA_PROPERTY_HAS_STEP_COUNTER:
+		return g_variant_new_boolean (driver_type_exists (data, DRIVER_TYPE_STEP_COUNTER));
+	case SCHEMA_PROPERTY_STEP_COUNT:
+		return g_variant_new_uint32 (snapshot->step_count);
+	case SCHEMA_PROPERTY_HAS_TAP:
+		return g_variant_new_boolean (driver_type_exists (data, DRIVER_TYPE_TAP));
+	default:
+		g_assert_not_reached ();
+	}
+}
 
-	g_assert ((mask & PROP_ALL) == 0 || (mask & PROP_ALL_COMPASS) == 0);
+static GVariant *
+build_properties (SensorData           *data,
+		  const SensorSnapshot *snapshot,
+		  int                   mask)
+{
+	GVariantBuilder props_builder;
+	guint i;
 
 	g_variant_builder_init (&props_builder, G_VARIANT_TYPE ("a{sv}"));
 
-	if (mask & PROP_HAS_ACCELEROMETER) {
-		gboolean has_accel;
+	for (i = 0; i < SCHEMA_N_PROPERTIES; i++) {
+		if (!(mask & (1 << i)))
+			continue;
+		g_variant_builder_add (&props_builder, "{sv}",
+				       schema_property_name ((SchemaProperty) i),
+				       build_property_value (data, snapshot, (SchemaProperty) i));
+	}
 
-		has_accel = driver_type_exists (data, DRIVER_TYPE_ACCEL);
-		g_variant_builder_add (&props_builder, "{sv}", "HasAccelerometer",
-				       g_variant_new_boolean (has_accel));
+	return g_variant_builder_end (&props_builder);
+}
 
-		/* Send the orientation when the device appears */
-		if (has_accel)
-			mask |= PROP_ACCELEROMETER_ORIENTATION;
-		else
-			data->previous_orientation = ORIENTATION_UNDEFINED;
-	}
+/* The interface of the properties in @mask, they all share one */
+static SchemaInterface
+mask_to_interface (int mask)
+{
+	guint i;
 
-	if (mask & PROP_ACCELEROMETER_ORIENTATION) {
-		g_variant_builder_add (&props_builder, "{sv}", "AccelerometerOrientation",
-				       g_variant_new_string (orientation_to_string (data->previous_orientation)));
+	for (i = 0; i < SCHEMA_N_INTERFACES; i++) {
+		if (schema_interface_props ((SchemaInterface) i) & mask) {
+			g_assert ((mask & ~schema_interface_props ((SchemaInterface) i)) == 0);
+			return (SchemaInterface) i;
+		}
 	}
 
-	if (mask & PROP_HAS_AMBIENT_LIGHT) {
-		gboolean has_als;
+	g_assert_not_reached ();
+}
 
-		has_als = driver_type_exists (data, DRIVER_TYPE_LIGHT);
-		g_variant_builder_add (&props_builder, "{sv}", "HasAmbientLight",
-				       g_variant_new_boolean (has_als));
+static GVariant *
+build_properties_changed (SensorData           *data,
+			  const SensorSnapshot *snapshot,
+			  int                   mask)
+{
+	SchemaInterface iface = mask_to_interface (mask);
 
-		/* Send the light level when the device appears */
-		if (has_als)
-			mask |= PROP_LIGHT_LEVEL;
-	}
+	return g_variant_new ("(s@a{sv}@as)", schema_interface_name (iface),
+			      build_properties (data, snapshot, mask),
+			      g_variant_new_strv (NULL, 0));
+}
 
-	if (mask & PROP_LIGHT_LEVEL) {
-		g_variant_builder_add (&props_builder, "{sv}", "LightLevelUnit",
-				       g_variant_new_string (data->uses_lux ? "lux" : "vendor"));
-		g_variant_builder_add (&props_builder, "{sv}", "LightLevel",
-				       g_variant_new_double (data->previous_level));
-	}
+/* All the properties of @iface, rebuilt once after each
+ * change rather than on every Get */
+static GVariant *
+get_cached_properties (SensorData      *data,
+		       SchemaInterface  iface)
+{
+	GVariantBuilder props_builder;
+	SensorSnapshot snapshot;
+	guint i;
 
-	if (mask & PROP_HAS_COMPASS) {
-		gboolean has_compass;
+	if (data->properties[iface] != NULL)
+		return data->properties[iface];
 
-		has_compass = driver_type_exists (data, DRIVER_TYPE_COMPASS);
-		g_variant_builder_add (&props_builder, "{sv}", "HasCompass",
-				       g_variant_new_boolean (has_compass));
+	sensor_state_read (data->state, &snapshot);
+	g_variant_builder_init (&props_builder, G_VARIANT_TYPE ("a{sv}"));
 
-		/* Send the heading when the device appears */
-		if (has_compass)
-			mask |= PROP_COMPASS_HEADING;
-	}
+	for (i = 0; i < SCHEMA_N_PROPERTIES; i++) {
+		if (schema_property_interface ((SchemaProperty) i) != iface)
+			continue;
 
-	if (mask & PROP_COMPASS_HEADING) {
-		g_variant_builder_add (&props_builder, "{sv}", "CompassHeading",
-				       g_variant_new_double (data->previous_heading));
+		data->property_values[i] = g_variant_ref_sink (build_property_value (data, &snapshot, (SchemaProperty) i));
+		g_variant_builder_add (&props_builder, "{sv}",
+				       schema_property_name ((SchemaProperty) i),
+				       data->property_values[i]);
 	}
 
-	if (mask & PROP_HAS_PROXIMITY) {
-		gboolean has_proximity;
+	data->properties[iface] = g_variant_ref_sink (g_variant_builder_end (&props_builder));
+	return data->properties[iface];
+}
 
-		has_proximity = driver_type_exists (data, DRIVER_TYPE_PROXIMITY);
-		g_variant_builder_add (&props_builder, "{sv}", "HasProximity",
-				       g_variant_new_boolean (has_proximity));
+static void
+invalidate_cached_properties (SensorData *data,
+			      int         mask)
+{
+	guint i;
 
-		/* Send proximity information when the device appears */
-		if (has_proximity)
-			mask |= PROP_PROXIMITY_NEAR;
+	for (i = 0; i < SCHEMA_N_INTERFACES; i++) {
+		if (schema_interface_props ((SchemaInterface) i) & mask)
+			g_clear_pointer (&data->properties[i], g_variant_unref);
 	}
 
-	if (mask & PROP_PROXIMITY_NEAR) {
-		g_variant_builder_add (&props_builder, "{sv}", "ProximityNear",
-				       g_variant_new_boolean (data->previous_prox_near));
+	for (i = 0; i < SCHEMA_N_PROPERTIES; i++) {
+		if (data->properties[schema_property_interface ((SchemaProperty) i)] == NULL)
+			g_clear_pointer (&data->property_values[i], g_variant_unref);
 	}
+}
+
+/* String values can't be patched in place, so they are part of the key,
+ * above the 32 bits of the mask */
+static guint64
+signal_template_key (const SensorSnapshot *snapshot,
+		     int                   mask)
+{
+	guint64 key = (guint) mask;
 
-	props_changed = g_variant_new ("(s@a{sv}@as)", (mask & PROP_ALL) ? SENSOR_PROXY_IFACE_NAME : SENSOR_PROXY_COMPASS_IFACE_NAME,
-				       g_variant_builder_end (&props_builder),
-				       g_variant_new_strv (NULL, 0));
+	if (mask & PROP_ACCELEROMETER_ORIENTATION)
+		key |= (guint64) snapshot->orientation << 32;
+	if ((mask & PROP_LIGHT_LEVEL_UNIT) && snapshot->uses_lux)
+		key |= G_GUINT64_CONSTANT (1) << 40;
 
-	g_dbus_connection_emit_signal (data->connection,
-				       NULL,
-				       (mask & PROP_ALL) ? SENSOR_PROXY_DBUS_PATH : SENSOR_PROXY_COMPASS_DBUS_PATH,
-				       "org.freedesktop.DBus.Properties",
-				       "PropertiesChanged",
-				       props_changed, NULL);
+	return key;
 }
 
-static void
-client_release (SensorData            *data,
-		const char            *sender,
-		DriverType             driver_type)
+static SignalTemplate *
+lookup_signal_template (SensorData           *data,
+			const SensorSnapshot *snapshot,
+			int                   mask)
 {
-	GHashTable *ht;
-	guint watch_id;
+	SignalTemplate *tmpl;
+	guint64 key, *stored_key;
 
-	ht = data->clients[driver_type];
+	key = signal_template_key (snapshot, mask);
+	tmpl = (SignalTemplate *) g_hash_table_lookup (data->signal_templates, &key);
+	if (tmpl != NULL)
+		return tmpl;
 
-	watch_id = GPOINTER_TO_UINT (g_hash_table_lookup (ht, sender));
-	if (watch_id == 0)
-		return;
+	tmpl = signal_template_new (schema_interface_path (mask_to_interface (mask)),
+				    build_properties_changed (data, snapshot, mask));
+	stored_key = g_new (guint64, 1);
+	*stored_key = key;
+	g_hash_table_insert (data->signal_templates, stored_key, tmpl);
 
-	g_hash_table_remove (ht, sender);
+	return tmpl;
 }
 
-static void
-client_vanished_cb (GDBusConnection *connection,
-		    const gchar     *name,
-		    gpointer         user_data)
-{
-	SensorData *data = (SensorData *) user_data;
-	guint i;
-	char *sender;
+static const struct {
+	int        prop;
+	DriverType driver_type;
+} live_properties[] = {
+	{ PROP_ACCELEROMETER_ORIENTATION, DRIVER_TYPE_ACCEL },
+	{ PROP_LIGHT_LEVEL, DRIVER_TYPE_LIGHT },
+	{ PROP_COMPASS_HEADING, DRIVER_TYPE_COMPASS },
+	{ PROP_PROXIMITY_NEAR | PROP_PROXIMITY_VALUE, DRIVER_TYPE_PROXIMITY },
+	{ PROP_ROTATION_VECTOR, DRIVER_TYPE_GYROSCOPE },
+	{ PROP_PRESSURE | PROP_ALTITUDE, DRIVER_TYPE_PRESSURE },
+	{ PROP_TEMPERATURE, DRIVER_TYPE_TEMPERATURE },
+	{ PROP_RELATIVE_HUMIDITY, DRIVER_TYPE_HUMIDITY },
+	{ PROP_STEP_COUNT, DRIVER_TYPE_STEP_COUNTER },
+};
 
-	if (name == NULL)
-		return;
+/* Set of the clients claiming any of the @claimed driver types, or
+ * NULL if the signal should be broadcast instead */
+static GHashTable *
+claimant_destinations (SensorData *data,
+		       guint       claimed)
+{
+	GHashTable *destinations;
+	GHashTableIter iter;
+	gpointer name, value;
 
-	sender = g_strdup (name);
+	if (data->unicast_fanout == 0)
+		return NULL;
 
-	for (i = 0; i < NUM_SENSOR_TYPES; i++) {
-		GHashTable *ht;
-		guint watch_id;
+	destinations = g_hash_table_new (g_str_hash, g_str_equal);
 
-		ht = data->clients[i];
-		g_assert (ht);
+	g_hash_table_iter_init (&iter, data->clients);
+	while (g_hash_table_iter_next (&iter, &name, &value)) {
+		if (((ClientRecord *) value)->claimed & claimed)
+			g_hash_table_add (destinations, name);
+	}
 
-		watch_id = GPOINTER_TO_UINT (g_hash_table_lookup (ht, sender));
-		if (watch_id > 0)
-			client_release(data, sender, (DriverType) i);
+	if (g_hash_table_size (destinations) > data->unicast_fanout) {
+		g_hash_table_destroy (destinations);
+		return NULL;
 	}
 
-	g_free (sender);
+	return destinations;
 }
 
-static void
-handle_generic_method_call (SensorData            *data,
-			    const gchar           *sender,
-			    const gchar           *object_path,
-			    const gchar           *interface_name,
-			    const gchar           *method_name,
-			    GVariant              *parameters,
-			    GDBusMethodInvocation *invocation,
-			    DriverType             driver_type)
+/* Set of the clients claiming the sensors behind @mask, or NULL
+ * if the signal should be broadcast instead */
+static GHashTable *
+unicast_destinations (SensorData *data,
+		      int         mask)
 {
-	GHashTable *ht;
-	guint watch_id;
+	guint claimed = 0;
+	guint i;
 
-	g_debug ("Handling driver refcounting method '%s' for %s device",
-		 method_name, driver_type_to_str (driver_type));
+	if (data->unicast_fanout == 0)
+		return NULL;
 
-	ht = data->clients[driver_type];
+	/* Sensors appearing is of interest to everyone */
+	if (mask & (PROP_HAS_ACCELEROMETER | PROP_HAS_AMBIENT_LIGHT |
+		    PROP_HAS_COMPASS | PROP_HAS_PROXIMITY | PROP_HAS_GYROSCOPE |
+		    PROP_HAS_PRESSURE | PROP_HAS_TEMPERATURE | PROP_HAS_HUMIDITY |
+		    PROP_HAS_STEP_COUNTER | PROP_HAS_TAP))
+		return NULL;
 
-	if (g_str_has_prefix (method_name, "Claim")) {
-		watch_id = GPOINTER_TO_UINT (g_hash_table_lookup (ht, sender));
-		if (watch_id > 0) {
-			g_dbus_method_invocation_return_value (invocation, NULL);
-			return;
-		}
+	for (i = 0; i < G_N_ELEMENTS (live_properties); i++) {
+		if (mask & live_properties[i].prop)
+			claimed |= 1 << live_properties[i].driver_type;
+	}
 
-		watch_id = g_bus_watch_name_on_connection (data->connection,
-							   sender,
-							   G_BUS_NAME_WATCHER_FLAGS_NONE,
-							   NULL,
-							   client_vanished_cb,
-							   data,
-							   NULL);
-		g_hash_table_insert (ht, g_strdup (sender), GUINT_TO_POINTER (watch_id));
+	return claimant_destinations (data, claimed);
+}
 
-		g_dbus_method_invocation_return_value (invocation, NULL);
-	} else if (g_str_has_prefix (method_name, "Release")) {
-		client_release (data, sender, driver_type);
-		g_dbus_method_invocation_return_value (invocation, NULL);
-	}
+static void
+send_dbus_message_copy (GDBusConnection *connection,
+			GDBusMessage    *message,
+			const char      *destination)
+{
+	GDBusMessage *copy;
+
+	copy = g_dbus_message_copy (message, NULL);
+	g_dbus_message_set_destination (copy, destination);
+	g_dbus_connection_send_message (connection, copy,
+					G_DBUS_SEND_MESSAGE_FLAGS_NONE, NULL, NULL);
+	g_object_unref (copy);
 }
 
+/* Takes @destinations, NULL to broadcast */
 static void
-handle_method_call (GDBusConnection       *connection,
-		    const gchar           *sender,
-		    const gchar           *object_path,
-		    const gchar           *interface_name,
-		    const gchar           *method_name,
-		    GVariant              *parameters,
-		    GDBusMethodInvocation *invocation,
-		    gpointer               user_data)
+send_dbus_message (SensorData   *data,
+		   GDBusMessage *message,
+		   GHashTable   *destinations)
 {
-	SensorData *data = (SensorData *) user_data;
-	DriverType driver_type;
+	GHashTableIter iter;
+	gpointer name, peer;
 
-	if (g_strcmp0 (method_name, "ClaimAccelerometer") == 0 ||
-	    g_strcmp0 (method_name, "ReleaseAccelerometer") == 0)
-		driver_type = DRIVER_TYPE_ACCEL;
-	else if (g_strcmp0 (method_name, "ClaimLight") == 0 ||
-		 g_strcmp0 (method_name, "ReleaseLight") == 0)
-		driver_type = DRIVER_TYPE_LIGHT;
-	else if (g_strcmp0 (method_name, "ClaimProximity") == 0 ||
-		 g_strcmp0 (method_name, "ReleaseProximity") == 0)
-	        driver_type = DRIVER_TYPE_PROXIMITY;
-	else {
-		g_dbus_method_invocation_return_error (invocation,
-						       G_DBUS_ERROR,
-						       G_DBUS_ERROR_UNKNOWN_METHOD,
-						       "Method '%s' does not exist on object %s",
-						       method_name, object_path);
+	if (destinations == NULL) {
+		g_hash_table_iter_init (&iter, data->peers);
+		while (g_hash_table_iter_next (&iter, NULL, &peer))
+			send_dbus_message_copy ((GDBusConnection *) peer, message, NULL);
+
+		g_dbus_connection_send_message (data->connection, message,
+						G_DBUS_SEND_MESSAGE_FLAGS_NONE, NULL, NULL);
 		return;
 	}
 
-	handle_generic_method_call (data, sender, object_path,
-				    interface_name, method_name,
-				    parameters, invocation, driver_type);
+	g_hash_table_iter_init (&iter, destinations);
+	while (g_hash_table_iter_next (&iter, &name, NULL)) {
+		peer = g_hash_table_lookup (data->peers, name);
+		if (peer != NULL)
+			send_dbus_message_copy ((GDBusConnection *) peer, message, NULL);
+		else
+			send_dbus_message_copy (data->connection, message, (const char *) name);
+	}
+
+	g_hash_table_destroy (destinations);
 }
 
-static GVariant *
-handle_get_property (GDBusConnection *connection,
-		     const gchar     *sender,
-		     const gchar     *object_path,
-		     const gchar     *interface_name,
-		     const gchar     *property_name,
-		     GError         **error,
-		     gpointer         user_data)
+static void
+send_dbus_event (SensorData     *data,
+		 int  mask)
 {
-	SensorData *data = (SensorData *) user_data;
+	SignalTemplateValue values[SCHEMA_N_PROPERTIES] = {};
+	SensorSnapshot snapshot;
+	SignalTemplate *tmpl;
+	GDBusMessage *message;
 
 	if (data->connection == NULL)
-		return NULL;
+		return;
 
-	if (g_strcmp0 (property_name, "HasAccelerometer") == 0)
-		return g_variant_new_boolean (driver_type_exists (data, DRIVER_TYPE_ACCEL));
-	if (g_strcmp0 (property_name, "AccelerometerOrientation") == 0)
-		return g_variant_new_string (orientation_to_string (data->previous_orientation));
-	if (g_strcmp0 (property_name, "HasAmbientLight") == 0)
-		return g_variant_new_boolean (driver_type_exists (data, DRIVER_TYPE_LIGHT));
-	if (g_strcmp0 (property_name, "LightLevelUnit") == 0)
-		return g_variant_new_string (data->uses_lux ? "lux" : "vendor");
-	if (g_strcmp0 (property_name, "LightLevel") == 0)
-		return g_variant_new_double (data->previous_level);
-	if (g_strcmp0 (property_name, "HasProximity") == 0)
-		return g_variant_new_boolean (driver_type_exists (data, DRIVER_TYPE_PROXIMITY));
-	if (g_strcmp0 (property_name, "ProximityNear") == 0)
-		return g_variant_new_boolean (data->previous_prox_near);
+	if (mask == 0)
+		return;
 
-	return NULL;
+	sensor_state_read (data->state, &snapshot);
+	mask = expand_dbus_event_mask (data, mask);
+	tmpl = lookup_signal_template (data, &snapshot, mask);
+
+	values[SCHEMA_PROPERTY_HAS_ACCELEROMETER].b = driver_type_exists (data, DRIVER_TYPE_ACCEL);
+	values[SCHEMA_PROPERTY_HAS_AMBIENT_LIGHT].b = driver_type_exists (data, DRIVER_TYPE_LIGHT);
+	values[SCHEMA_PROPERTY_LIGHT_LEVEL].d = snapshot.level;
+	values[SCHEMA_PROPERTY_HAS_COMPASS].b = driver_type_exists (data, DRIVER_TYPE_COMPASS);
+	values[SCHEMA_PROPERTY_COMPASS_HEADING].d = snapshot.heading;
+	values[SCHEMA_PROPERTY_HAS_PROXIMITY].b = driver_type_exists (data, DRIVER_TYPE_PROXIMITY);
+	values[SCHEMA_PROPERTY_PROXIMITY_NEAR].b = snapshot.prox_near;
+	values[SCHEMA_PROPERTY_PROXIMITY_VALUE].u = snapshot.prox_value;
+	values[SCHEMA_PROPERTY_HAS_GYROSCOPE].b = driver_type_exists (data, DRIVER_TYPE_GYROSCOPE);
+	values[SCHEMA_PROPERTY_ROTATION_VECTOR_W].d = snapshot.rotation[0];
+	values[SCHEMA_PROPERTY_ROTATION_VECTOR_X].d = snapshot.rotation[1];
+	values[SCHEMA_PROPERTY_ROTATION_VECTOR_Y].d = snapshot.rotation[2];
+	values[SCHEMA_PROPERTY_ROTATION_VECTOR_Z].d = snapshot.rotation[3];
+	values[SCHEMA_PROPERTY_HAS_PRESSURE].b = driver_type_exists (data, DRIVER_TYPE_PRESSURE);
+	values[SCHEMA_PROPERTY_PRESSURE].d = snapshot.pressure;
+	values[SCHEMA_PROPERTY_ALTITUDE].d = snapshot.altitude;
+	values[SCHEMA_PROPERTY_HAS_TEMPERATURE].b = driver_type_exists (data, DRIVER_TYPE_TEMPERATURE);
+	values[SCHEMA_PROPERTY_TEMPERATURE].d = snapshot.temperature;
+	values[SCHEMA_PROPERTY_HAS_HUMIDITY].b = driver_type_exists (data, DRIVER_TYPE_HUMIDITY);
+	values[SCHEMA_PROPERTY_RELATIVE_HUMIDITY].d = snapshot.humidity;
+	values[SCHEMA_PROPERTY_HAS_STEP_COUNTER].b = driver_type_exists (data, DRIVER_TYPE_STEP_COUNTER);
+	values[SCHEMA_PROPERTY_STEP_COUNT].u = snapshot.step_count;
+
+	message = signal_template_instantiate (tmpl, values);
+	send_dbus_message (data, message, unicast_destinations (data, mask));
+	g_object_unref (message);
 }
 
-static const GDBusInterfaceVTable interface_vtable =
+template<typename Value>
+static void
+set_sensor_policy (std::shared_ptr<repowerd::Sensor<Value>> const &sensor,
+		   repowerd::SensorPolicy const                   &policy)
 {
-	handle_method_call,
-	handle_get_property,
-	NULL
-};
+	if (sensor)
+		sensor->set_policy (policy);
+}
+
+static gboolean
+driver_type_claimed (SensorData *data,
+		     DriverType  driver_type)
+{
+	return data->n_claims[driver_type] > 0 ||
+	       sample_stream_set_size (data->streams[driver_type]) > 0;
+}
 
 static void
-handle_compass_method_call (GDBusConnection       *connection,
-			    const gchar           *sender,
-			    const gchar           *object_path,
-			    const gchar           *interface_name,
-			    const gchar           *method_name,
-			    GVariant              *parameters,
-			    GDBusMethodInvocation *invocation,
-			    gpointer               user_data)
+update_sensor_policy (SensorData *data,
+		      DriverType  driver_type)
 {
-	SensorData *data = (SensorData *) user_data;
+	repowerd::SensorPolicy policy;
 
-	if (g_strcmp0 (method_name, "ClaimCompass") != 0 &&
-	    g_strcmp0 (method_name, "ReleaseCompass") != 0) {
-		g_dbus_method_invocation_return_error (invocation,
-						       G_DBUS_ERROR,
-						       G_DBUS_ERROR_UNKNOWN_METHOD,
-						       "Method '%s' does not exist on object %s",
-						       method_name, object_path);
-		return;
+	policy.claimed = data->n_claims[driver_type] > 0;
+	/* An open stream counts as a claim, at the rate it asked for */
+	if (sample_stream_set_size (data->streams[driver_type]) > 0) {
+		policy.claimed = true;
+		policy.interval = sample_stream_set_min_interval (data->streams[driver_type]);
 	}
+	if (policy.interval == 0)
+		policy.interval = data->sample_interval[driver_type];
+	/* These barely change, run them as slow as sensord allows */
+	policy.lowest_rate = (driver_type == DRIVER_TYPE_TEMPERATURE ||
+			      driver_type == DRIVER_TYPE_HUMIDITY);
+	/* The gyroscope fusion and the tilt compensation need gravity */
+	if (driver_type == DRIVER_TYPE_ACCEL &&
+	    (driver_type_claimed (data, DRIVER_TYPE_GYROSCOPE) ||
+	     (data->magnetometer_sensor && driver_type_claimed (data, DRIVER_TYPE_COMPASS))))
+		policy.claimed = true;
+	policy.display_on = data->display_on;
+	policy.suspended = data->suspended;
 
-	handle_generic_method_call (data, sender, object_path,
-				    interface_name, method_name,
-				    parameters, invocation, DRIVER_TYPE_COMPASS);
+	switch (driver_type) {
+	case DRIVER_TYPE_ACCEL:
+		set_sensor_policy (data->accelerometer_sensor, policy);
+		set_sensor_policy (data->orientation_sensor, policy);
+		break;
+	case DRIVER_TYPE_LIGHT:
+		set_sensor_policy (data->light_sensor, policy);
+		break;
+	case DRIVER_TYPE_COMPASS:
+		set_sensor_policy (data->compass_sensor, policy);
+		set_sensor_policy (data->magnetometer_sensor, policy);
+		if (data->magnetometer_sensor)
+			update_sensor_policy (data, DRIVER_TYPE_ACCEL);
+		break;
+	case DRIVER_TYPE_PROXIMITY:
+		set_sensor_policy (data->proximity_sensor, policy);
+		break;
+	case DRIVER_TYPE_GYROSCOPE:
+		set_sensor_policy (data->gyroscope_sensor, policy);
+		update_sensor_policy (data, DRIVER_TYPE_ACCEL);
+		break;
+	case DRIVER_TYPE_PRESSURE:
+		set_sensor_policy (data->pressure_sensor, policy);
+		break;
+	case DRIVER_TYPE_TEMPERATURE:
+		set_sensor_policy (data->temperature_sensor, policy);
+		break;
+	case DRIVER_TYPE_HUMIDITY:
+		set_sensor_policy (data->humidity_sensor, policy);
+		break;
+	case DRIVER_TYPE_STEP_COUNTER:
+		set_sensor_policy (data->step_counter_sensor, policy);
+		break;
+	case DRIVER_TYPE_TAP:
+		set_sensor_policy (data->tap_sensor, policy);
+		break;
+	default:
+		g_assert_not_reached ();
+	}
 }
 
-static GVariant *
-handle_compass_get_property (GDBusConnection *connection,
-			     const gchar     *sender,
-			     const gchar     *object_path,
-			     const gchar     *interface_name,
-			     const gchar     *property_name,
-			     GError         **error,
-			     gpointer         user_data)
+static void
+update_all_sensor_policies (SensorData *data)
 {
-	SensorData *data = (SensorData *) user_data;
-
-	if (data->connection == NULL)
-		return NULL;
-
-	if (g_strcmp0 (property_name, "HasCompass") == 0)
-		return g_variant_new_boolean (driver_type_exists (data, DRIVER_TYPE_COMPASS));
-	if (g_strcmp0 (property_name, "CompassHeading") == 0)
-		return g_variant_new_double (data->previous_heading);
+	guint i;
 
-	return NULL;
+	for (i = 0; i < NUM_SENSOR_TYPES; i++)
+		update_sensor_policy (data, (DriverType) i);
 }
 
-static const GDBusInterfaceVTable compass_interface_vtable =
-{
-	handle_compass_method_call,
-	handle_compass_get_property,
-	NULL
-};
-
 static void
-name_lost_handler (GDBusConnection *connection,
-		   const gchar     *name,
-		   gpointer         user_data)
+flush_dbus_events (guint    mask,
+		   gpointer user_data)
 {
-	g_debug ("iio-sensor-proxy is already running, or it cannot own its D-Bus name. Verify installation.");
-	exit (0);
+	SensorData *data = (SensorData *) user_data;
+	guint i;
+
+	sensor_state_publish (data->state);
+	invalidate_cached_properties (data, mask);
+
+	/* One PropertiesChanged per interface */
+	for (i = 0; i < SCHEMA_N_INTERFACES; i++)
+		send_dbus_event (data, mask & schema_interface_props ((SchemaInterface) i));
 }
 
+/* Safe to call from the sensor threads, the signals are sent
+ * from the main loop once the emission window closes */
 static void
-bus_acquired_handler (GDBusConnection *connection,
-		      const gchar     *name,
-		      gpointer         user_data)
+queue_dbus_event (SensorData *data,
+		  int         mask)
 {
-	SensorData *data = (SensorData *)user_data;
-
-	g_dbus_connection_register_object (connection,
-					   SENSOR_PROXY_DBUS_PATH,
-					   data->introspection_data->interfaces[0],
-					   &interface_vtable,
-					   data,
-					   NULL,
-					   NULL);
-
-	g_dbus_connection_register_object(connection,
-					   SENSOR_PROXY_COMPASS_DBUS_PATH,
-					   data->introspection_data->interfaces[1],
-					   &compass_interface_vtable,
-					   data,
-					   NULL,
-					   NULL);
-
-	data->connection = (GDBusConnection *) g_object_ref(connection);
+	emission_scheduler_queue (data->emission_scheduler, mask);
 }
 
-char const *const log_tag = "main";
+typedef struct {
+	SensorData   *data;
+	SchemaSignal  signal;
+	DriverType    driver_type;
+	GVariant     *body;
+} QueuedSignal;
 
-std::string the_dbus_bus_address()
+static gboolean
+emit_queued_signal (gpointer user_data)
 {
-	auto const address = std::unique_ptr<gchar, decltype(&g_free)>{
-		g_dbus_address_get_for_bus_sync(G_BUS_TYPE_SYSTEM, nullptr, nullptr),
-		g_free};
+	QueuedSignal *queued = (QueuedSignal *) user_data;
+	SchemaInterface iface;
+	GDBusMessage *message;
+
+	if (queued->data->connection != NULL) {
+		iface = schema_signal_interface (queued->signal);
+		message = g_dbus_message_new_signal (schema_interface_path (iface),
+						     schema_interface_name (iface),
+						     schema_signal_name (queued->signal));
+		g_dbus_message_set_body (message, queued->body);
+		send_dbus_message (queued->data, message,
+				   claimant_destinations (queued->data, 1 << queued->driver_type));
+		g_object_unref (message);
+	}
 
-	return address ? address.get() : std::string{};
+	g_variant_unref (queued->body);
+	g_free (queued);
+	return G_SOURCE_REMOVE;
 }
 
+/* Safe to call from the sensor threads. Unlike property changes, events
+ * are never coalesced, each one gets sent from the main loop to the
+ * clients claiming @driver_type */
 static void
-name_acquired_handler (GDBusConnection *connection,
-		       const gchar     *name,
-		       gpointer         user_data)
+queue_dbus_signal (SensorData   *data,
+		   SchemaSignal  signal,
+		   DriverType    driver_type,
+		   GVariant     *body)
 {
-	SensorData *data = (SensorData *)user_data;
-	guint i;
-
-	for (i = 0; i < NUM_SENSOR_TYPES; i++) {
-		data->clients[i] = create_clients_hash_table ();
-	}
-
-	send_dbus_event (data, PROP_ALL);
-	return;
-
-bail:
-	data->ret = 0;
-	g_debug ("No sensors or missing kernel drivers for the sensors");
-	g_main_loop_quit (data->loop);
+	QueuedSignal *queued;
+
+	queued = g_new0 (QueuedSignal, 1);
+	queued->data = data;
+	queued->signal = signal;
+	queued->driver_type = driver_type;
+	queued->body = g_variant_ref_sink (body);
+	g_idle_add_full (G_PRIORITY_DEFAULT, emit_queued_signal, queued, NULL);
 }
 
 static gboolean
-setup_dbus (SensorData *data)
+sensor_name_to_driver_type (const char *sensor,
+			    DriverType *driver_type)
 {
-	GBytes *bytes;
+	if (g_strcmp0 (sensor, "accelerometer") == 0)
+		*driver_type = DRIVER_TYPE_ACCEL;
+	else if (g_strcmp0 (sensor, "light") == 0)
+		*driver_type = DRIVER_TYPE_LIGHT;
+	else if (g_strcmp0 (sensor, "compass") == 0)
+		*driver_type = DRIVER_TYPE_COMPASS;
+	else if (g_strcmp0 (sensor, "proximity") == 0)
+		*driver_type = DRIVER_TYPE_PROXIMITY;
+	else if (g_strcmp0 (sensor, "gyroscope") == 0)
+		*driver_type = DRIVER_TYPE_GYROSCOPE;
+	else if (g_strcmp0 (sensor, "pressure") == 0)
+		*driver_type = DRIVER_TYPE_PRESSURE;
+	else if (g_strcmp0 (sensor, "temperature") == 0)
+		*driver_type = DRIVER_TYPE_TEMPERATURE;
+	else if (g_strcmp0 (sensor, "humidity") == 0)
+		*driver_type = DRIVER_TYPE_HUMIDITY;
+	else if (g_strcmp0 (sensor, "step-counter") == 0)
+		*driver_type = DRIVER_TYPE_STEP_COUNTER;
+	else if (g_strcmp0 (sensor, "tap") == 0)
+		*driver_type = DRIVER_TYPE_TAP;
+	else
+		return FALSE;
+	return TRUE;
+}
 
-	bytes = g_resources_lookup_data ("/net/hadess/SensorProxy/net.hadess.SensorProxy.xml",
-					 G_RESOURCE_LOOKUP_FLAGS_NONE,
-					 NULL);
-	data->introspection_data = g_dbus_node_info_new_for_xml((const gchar *)g_bytes_get_data(bytes, NULL), NULL);
-	g_bytes_unref (bytes);
-	g_assert (data->introspection_data != NULL);
+static void client_vanished_cb (GDBusConnection *connection,
+				const gchar     *name,
+				gpointer         user_data);
 
-	data->name_id = g_bus_own_name (G_BUS_TYPE_SYSTEM,
-					SENSOR_PROXY_DBUS_NAME,
-					G_BUS_NAME_OWNER_FLAGS_NONE,
-					bus_acquired_handler,
-					name_acquired_handler,
-					name_lost_handler,
-					data,
-					NULL);
+static ClientRecord *
+lookup_client_record (SensorData *data,
+		      const char *sender,
+		      gboolean    create)
+{
+	ClientRecord *record;
+
+	record = (ClientRecord *) g_hash_table_lookup (data->clients, sender);
+	if (record != NULL || !create)
+		return record;
+
+	record = g_new0 (ClientRecord, 1);
+	/* Peers are dropped when their connection closes instead */
+	if (!g_hash_table_contains (data->peers, sender))
+		record->watch_id = g_bus_watch_name_on_connection (data->connection,
+								   sender,
+								   G_BUS_NAME_WATCHER_FLAGS_NONE,
+								   NULL,
+								   client_vanished_cb,
+								   data,
+								   NULL);
+	g_hash_table_insert (data->clients, g_strdup (sender), record);
+
+	return record;
+}
 
-	return TRUE;
+/* Drops the record, and its watch, once the client holds nothing */
+static void
+maybe_free_client_record (SensorData   *data,
+			  const char   *sender,
+			  ClientRecord *record)
+{
+	if (record->claimed == 0 && record->streams == 0)
+		g_hash_table_remove (data->clients, sender);
 }
 
 static void
-free_sensor_data (SensorData *data)
+client_claim (SensorData *data,
+	      const char *sender,
+	      DriverType  driver_type)
 {
-	guint i;
+	ClientRecord *record;
 
-	if (data == NULL)
+	record = lookup_client_record (data, sender, TRUE);
+	if (record->claimed & (1 << driver_type))
 		return;
 
-	if (data->name_id != 0) {
-		g_bus_unown_name (data->name_id);
-		data->name_id = 0;
-	}
-
-	for (i = 0; i < NUM_SENSOR_TYPES; i++) {
-		g_clear_pointer (&data->clients[i], g_hash_table_unref);
-	}
-
-	g_clear_pointer (&data->introspection_data, g_dbus_node_info_unref);
-	g_clear_object (&data->connection);
-	g_clear_object (&data->client);
-	g_clear_pointer (&data->loop, g_main_loop_unref);
-	g_free (data);
+	record->claimed |= 1 << driver_type;
+	data->n_claims[driver_type]++;
+	update_sensor_policy (data, driver_type);
 }
 
 static void
-setup_sensors (SensorData *data)
+client_release (SensorData            *data,
+		const char            *sender,
+		DriverType             driver_type)
 {
-	auto const log = std::make_shared<repowerd::ConsoleLog>();
+	ClientRecord *record;
 
-	try
-	{
-		data->proximity_sensor = std::make_shared<repowerd::SensorfwProximitySensor>(log,
-			the_dbus_bus_address());
-		data->prox_avaliable = TRUE;
-		send_dbus_event(data, PROP_HAS_PROXIMITY);
+	record = lookup_client_record (data, sender, FALSE);
+	if (record == NULL || !(record->claimed & (1 << driver_type)))
+		return;
+
+	record->claimed &= ~(1 << driver_type);
+	data->n_claims[driver_type]--;
+	maybe_free_client_record (data, sender, record);
+	update_sensor_policy (data, driver_type);
+}
+
+static void
+client_vanished_cb (GDBusConnection *connection,
+		    const gchar     *name,
+		    gpointer         user_data)
+{
+	SensorData *data = (SensorData *) user_data;
+	ClientRecord *record;
+	guint claimed, streams;
+	guint i;
+	char *sender;
+
+	if (name == NULL)
+		return;
+
+	record = lookup_client_record (data, name, FALSE);
+	if (record == NULL)
+		return;
+
+	claimed = record->claimed;
+	streams = record->streams;
+
+	/* name belongs to the watch that goes away with the record */
+	sender = g_strdup (name);
+	g_hash_table_remove (data->clients, sender);
+
+	for (i = 0; i < NUM_SENSOR_TYPES; i++) {
+		if (claimed & (1 << i))
+			data->n_claims[i]--;
+		if (streams & (1 << i))
+			sample_stream_set_remove (data->streams[i], sender);
+		if ((claimed | streams) & (1 << i))
+			update_sensor_policy (data, (DriverType) i);
 	}
-	catch (std::exception const &e)
-	{
-		log->log(log_tag, "Failed to create SensorfwProximitySensor: %s", e.what());
-		data->prox_avaliable = FALSE;
+
+	g_free (sender);
+}
+
+static void
+handle_claim_method_call (SensorData            *data,
+			  const gchar           *sender,
+			  GDBusMethodInvocation *invocation,
+			  DriverType             driver_type,
+			  gboolean               claim)
+{
+	g_debug ("Handling driver refcounting method '%s' for %s device",
+		 g_dbus_method_invocation_get_method_name (invocation),
+		 driver_type_to_str (driver_type));
+
+	if (claim)
+		client_claim (data, sender, driver_type);
+	else
+		client_release (data, sender, driver_type);
+	g_dbus_method_invocation_return_value (invocation, NULL);
+}
+
+/* The vtable has no get_property, so GDBus routes Get and GetAll
+ * here and they can be answered from the cached dictionary */
+static void
+handle_properties_method_call (SensorData            *data,
+			       const gchar           *method_name,
+			       GVariant              *parameters,
+			       GDBusMethodInvocation *invocation)
+{
+	SchemaInterface iface;
+	const char *iface_name;
+	GVariant *properties;
+
+	g_variant_get_child (parameters, 0, "&s", &iface_name);
+	iface = schema_lookup_interface (iface_name);
+	if (iface == SCHEMA_INTERFACE_INVALID) {
+		g_dbus_method_invocation_return_error (invocation,
+						       G_DBUS_ERROR,
+						       G_DBUS_ERROR_UNKNOWN_INTERFACE,
+						       "No such interface '%s'",
+						       iface_name);
+		return;
 	}
 
-	try
-	{
-		data->light_sensor = std::make_shared<repowerd::SensorfwLightSensor>(log,
-			the_dbus_bus_address());
-		data->light_avaliable = TRUE;
-		send_dbus_event(data, PROP_HAS_AMBIENT_LIGHT);
+	properties = get_cached_properties (data, iface);
+
+	if (g_strcmp0 (method_name, "GetAll") == 0) {
+		g_dbus_method_invocation_return_value (invocation,
+						       g_variant_new ("(@a{sv})", properties));
+	} else if (g_strcmp0 (method_name, "Get") == 0) {
+		SchemaProperty property;
+		const char *property_name;
+
+		g_variant_get_child (parameters, 1, "&s", &property_name);
+		property = schema_lookup_property (iface, property_name);
+		if (property == SCHEMA_PROPERTY_INVALID) {
+			g_dbus_method_invocation_return_error (invocation,
+							       G_DBUS_ERROR,
+							       G_DBUS_ERROR_UNKNOWN_PROPERTY,
+							       "No such property '%s'",
+							       property_name);
+			return;
+		}
+
+		g_dbus_method_invocation_return_value (invocation,
+						       g_variant_new ("(v)", data->property_values[property]));
+	} else {
+		g_dbus_method_invocation_return_error (invocation,
+						       G_DBUS_ERROR,
+						       G_DBUS_ERROR_PROPERTY_READ_ONLY,
+						       "Properties are read-only");
 	}
-	catch (std::exception const &e)
-	{
-		log->log(log_tag, "Failed to create SensorfwLightSensor: %s", e.what());
-		data->light_avaliable = FALSE;
+}
+
+/* @props is set to the properties the filter decides on */
+static ChangeFilter *
+lookup_change_filter (SensorData *data,
+		      const char *sensor,
+		      guint      *props)
+{
+	if (g_strcmp0 (sensor, "light") == 0) {
+		*props = PROP_LIGHT_LEVEL;
+		return data->light_filter;
+	}
+	if (g_strcmp0 (sensor, "compass") == 0) {
+		*props = PROP_COMPASS_HEADING;
+		return data->compass_filter;
+	}
+	if (g_strcmp0 (sensor, "pressure") == 0) {
+		*props = PROP_PRESSURE | PROP_ALTITUDE;
+		return data->pressure_filter;
 	}
+	if (g_strcmp0 (sensor, "temperature") == 0) {
+		*props = PROP_TEMPERATURE;
+		return data->temperature_filter;
+	}
+	if (g_strcmp0 (sensor, "humidity") == 0) {
+		*props = PROP_RELATIVE_HUMIDITY;
+		return data->humidity_filter;
+	}
+	return NULL;
+}
 
-	try
-	{
-		data->orientation_sensor = std::make_shared<repowerd::SensorfwOrientationSensor>(log,
-			the_dbus_bus_address());
-		data->accel_avaliable = TRUE;
-		send_dbus_event(data, PROP_HAS_ACCELEROMETER);
+static GVariant *
+change_filter_params_to_variant (const ChangeFilterParams *params)
+{
+	GVariantBuilder builder;
+
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sv}"));
+	g_variant_builder_add (&builder, "{sv}", "AbsoluteDelta",
+			       g_variant_new_double (params->abs_delta));
+	g_variant_builder_add (&builder, "{sv}", "RelativeDelta",
+			       g_variant_new_double (params->rel_delta));
+	g_variant_builder_add (&builder, "{sv}", "Hysteresis",
+			       g_variant_new_double (params->hysteresis));
+	g_variant_builder_add (&builder, "{sv}", "DwellTime",
+			       g_variant_new_uint32 (params->dwell_ms));
+	g_variant_builder_add (&builder, "{sv}", "Quantum",
+			       g_variant_new_double (params->quantum));
+	g_variant_builder_add (&builder, "{sv}", "LogBuckets",
+			       g_variant_new_uint32 (params->log_buckets));
+
+	return g_variant_builder_end (&builder);
+}
+
+/* Keys that are missing keep their current value */
+static gboolean
+change_filter_params_from_variant (GVariant           *dict,
+				   ChangeFilterParams *params)
+{
+	ChangeFilterParams ret = *params;
+
+	g_variant_lookup (dict, "AbsoluteDelta", "d", &ret.abs_delta);
+	g_variant_lookup (dict, "RelativeDelta", "d", &ret.rel_delta);
+	g_variant_lookup (dict, "Hysteresis", "d", &ret.hysteresis);
+	g_variant_lookup (dict, "DwellTime", "u", &ret.dwell_ms);
+	g_variant_lookup (dict, "Quantum", "d", &ret.quantum);
+	g_variant_lookup (dict, "LogBuckets", "u", &ret.log_buckets);
+
+	if (!(ret.abs_delta >= 0) || !(ret.rel_delta >= 0) || !(ret.hysteresis >= 0) ||
+	    !(ret.quantum >= 0))
+		return FALSE;
+
+	*params = ret;
+	return TRUE;
+}
+
+static void
+handle_tuning_method_call (SensorData            *data,
+                           GDBusConnection       *connection,
+                           const gchar           *sender,
+                           SchemaMethod           method,
+                           GVariant              *parameters,
+                           GDBusMethodInvocation *invocation)
+{
+	ChangeFilterParams params;
+	ChangeFilter *filter;
+	const char *sensor;
+	guint props;
+
+	g_variant_get_child (parameters, 0, "&s", &sensor);
+	filter = lookup_change_filter (data, sensor, &props);
+	if (filter == NULL) {
+		g_dbus_method_invocation_return_error (invocation,
+						       G_DBUS_ERROR,
+						       G_DBUS_ERROR_INVALID_ARGS,
+						       "No change filter for sensor '%s'",
+						       sensor);
+		return;
 	}
-	catch (std::exception const &e)
-	{
-		log->log(log_tag, "Failed to create SensorfwOrientationSensor: %s", e.what());
-		data->accel_avaliable = FALSE;
+
+	change_filter_get_params (filter, &params);
+
+	if (method == SCHEMA_METHOD_GET_CHANGE_FILTER) {
+		g_dbus_method_invocation_return_value (invocation,
+						       g_variant_new ("(@a{sv})",
+								      change_filter_params_to_variant (&params)));
+	} else {
+		GVariant *dict;
+		gboolean valid;
+
+		dict = g_variant_get_child_value (parameters, 1);
+		valid = change_filter_params_from_variant (dict, &params);
+		g_variant_unref (dict);
+
+		if (!valid) {
+			g_dbus_method_invocation_return_error (invocation,
+							       G_DBUS_ERROR,
+							       G_DBUS_ERROR_INVALID_ARGS,
+							       "Change filter parameters must not be negative");
+			return;
+		}
+
+		change_filter_set_params (filter, &params);
+		emission_scheduler_set_dwell (data->emission_scheduler, props, params.dwell_ms);
+		g_dbus_method_invocation_return_value (invocation, NULL);
+	}
+}
+
+static void
+handle_snapshot_method_call (SensorData            *data,
+			     GDBusConnection       *connection,
+			     GDBusMethodInvocation *invocation)
+{
+	GUnixFDList *fd_list;
+	int fd;
+
+	if (!(g_dbus_connection_get_capabilities (connection) & G_DBUS_CAPABILITY_FLAGS_UNIX_FD_PASSING)) {
+		g_dbus_method_invocation_return_error (invocation,
+						       G_DBUS_ERROR,
+						       G_DBUS_ERROR_NOT_SUPPORTED,
+						       "File descriptor passing is not supported on this connection");
+		return;
+	}
+
+	fd = sensor_state_dup_fd (data->state);
+	if (fd < 0) {
+		g_dbus_method_invocation_return_error (invocation,
+						       G_DBUS_ERROR,
+						       G_DBUS_ERROR_FAILED,
+						       "Shared sensor state is not available");
+		return;
+	}
+
+	/* The list takes ownership of the fd */
+	fd_list = g_unix_fd_list_new_from_array (&fd, 1);
+	g_dbus_method_invocation_return_value_with_unix_fd_list (invocation,
+								 g_variant_new ("(h)", 0),
+								 fd_list);
+	g_object_unref (fd_list);
+}
+
+/* Per record: x/y/z for the motion sensors, in m/s² and rad/s */
+static guint
+driver_type_stream_values (DriverType driver_type)
+{
+	switch (driver_type) {
+	case DRIVER_TYPE_ACCEL:
+	case DRIVER_TYPE_GYROSCOPE:
+		return 3;
+	default:
+		return 1;
+	}
+}
+
+static void
+handle_stream_method_call (SensorData            *data,
+                           GDBusConnection       *connection,
+                           const gchar           *sender,
+                           SchemaMethod           method,
+                           GVariant              *parameters,
+                           GDBusMethodInvocation *invocation)
+{
+	ClientRecord *record;
+	DriverType driver_type;
+	const char *sensor;
+
+	g_variant_get_child (parameters, 0, "&s", &sensor);
+	/* Taps are events, there are no samples to stream */
+	if (!sensor_name_to_driver_type (sensor, &driver_type) ||
+	    driver_type == DRIVER_TYPE_TAP ||
+	    !driver_type_exists (data, driver_type)) {
+		g_dbus_method_invocation_return_error (invocation,
+						       G_DBUS_ERROR,
+						       G_DBUS_ERROR_INVALID_ARGS,
+						       "No sensor '%s' to stream from",
+						       sensor);
+		return;
 	}
 
+	if (method == SCHEMA_METHOD_OPEN_STREAM) {
+		SampleStream *stream;
+		GUnixFDList *fd_list;
+		int fds[2];
+		guint rate;
+
+		if (!(g_dbus_connection_get_capabilities (connection) & G_DBUS_CAPABILITY_FLAGS_UNIX_FD_PASSING)) {
+			g_dbus_method_invocation_return_error (invocation,
+							       G_DBUS_ERROR,
+							       G_DBUS_ERROR_NOT_SUPPORTED,
+							       "File descriptor passing is not supported on this connection");
+			return;
+		}
+
+		/* sensord's orientation plugin only reports the result */
+		if (driver_type == DRIVER_TYPE_ACCEL && data->accelerometer_sensor == nullptr) {
+			g_dbus_method_invocation_return_error (invocation,
+							       G_DBUS_ERROR,
+							       G_DBUS_ERROR_NOT_SUPPORTED,
+							       "No raw accelerometer readings to stream");
+			return;
+		}
+
+		g_variant_get_child (parameters, 1, "u", &rate);
+		stream = sample_stream_new (data->stream_capacity,
+					    driver_type_stream_values (driver_type),
+					    rate > 0 ? MAX (1000 / rate, 1) : 0);
+		if (stream == NULL) {
+			g_dbus_method_invocation_return_error (invocation,
+							       G_DBUS_ERROR,
+							       G_DBUS_ERROR_FAILED,
+							       "Could not create the stream");
+			return;
+		}
+
+		fds[0] = sample_stream_dup_ring_fd (stream);
+		fds[1] = sample_stream_dup_event_fd (stream);
+		if (fds[0] < 0 || fds[1] < 0) {
+			if (fds[0] >= 0)
+				close (fds[0]);
+			if (fds[1] >= 0)
+				close (fds[1]);
+			sample_stream_free (stream);
+			g_dbus_method_invocation_return_error (invocation,
+							       G_DBUS_ERROR,
+							       G_DBUS_ERROR_FAILED,
+							       "Could not share the stream");
+			return;
+		}
+
+		record = lookup_client_record (data, sender, TRUE);
+		record->streams |= 1 << driver_type;
+		sample_stream_set_add (data->streams[driver_type], sender, stream);
+		update_sensor_policy (data, driver_type);
+
+		/* The list takes ownership of the fds */
+		fd_list = g_unix_fd_list_new_from_array (fds, 2);
+		g_dbus_method_invocation_return_value_with_unix_fd_list (invocation,
+									 g_variant_new ("(hh)", 0, 1),
+									 fd_list);
+		g_object_unref (fd_list);
+	} else {
+		record = lookup_client_record (data, sender, FALSE);
+		if (record != NULL && (record->streams & (1 << driver_type))) {
+			record->streams &= ~(1 << driver_type);
+			sample_stream_set_remove (data->streams[driver_type], sender);
+			maybe_free_client_record (data, sender, record);
+			update_sensor_policy (data, driver_type);
+		}
+
+		g_dbus_method_invocation_return_value (invocation, NULL);
+	}
+}
+
+static int
+driver_type_to_props (DriverType driver_type)
+{
+	switch (driver_type) {
+	case DRIVER_TYPE_ACCEL:
+		return PROP_HAS_ACCELEROMETER | PROP_ACCELEROMETER_ORIENTATION;
+	case DRIVER_TYPE_LIGHT:
+		return PROP_HAS_AMBIENT_LIGHT | PROP_LIGHT_LEVEL_UNIT | PROP_LIGHT_LEVEL;
+	case DRIVER_TYPE_COMPASS:
+		return PROP_HAS_COMPASS | PROP_COMPASS_HEADING;
+	case DRIVER_TYPE_PROXIMITY:
+		return PROP_HAS_PROXIMITY | PROP_PROXIMITY_NEAR | PROP_PROXIMITY_VALUE;
+	case DRIVER_TYPE_GYROSCOPE:
+		return PROP_HAS_GYROSCOPE | PROP_ROTATION_VECTOR;
+	case DRIVER_TYPE_PRESSURE:
+		return PROP_HAS_PRESSURE | PROP_PRESSURE | PROP_ALTITUDE;
+	case DRIVER_TYPE_TEMPERATURE:
+		return PROP_HAS_TEMPERATURE | PROP_TEMPERATURE;
+	case DRIVER_TYPE_HUMIDITY:
+		return PROP_HAS_HUMIDITY | PROP_RELATIVE_HUMIDITY;
+	case DRIVER_TYPE_STEP_COUNTER:
+		return PROP_HAS_STEP_COUNTER | PROP_STEP_COUNT;
+	case DRIVER_TYPE_TAP:
+		return PROP_HAS_TAP;
+	default:
+		g_assert_not_reached ();
+	}
+}
+
+static void
+handle_batch_method_call (SensorData            *data,
+                          GDBusConnection       *connection,
+                          const gchar           *sender,
+                          SchemaMethod           method,
+                          GVariant              *parameters,
+                          GDBusMethodInvocation *invocation)
+{
+	const gchar **sensors;
+	guint driver_types = 0;
+	guint i;
+
+	/* All or nothing */
+	g_variant_get (parameters, "(^a&s)", &sensors);
+	for (i = 0; sensors[i] != NULL; i++) {
+		DriverType driver_type;
+
+		if (!sensor_name_to_driver_type (sensors[i], &driver_type)) {
+			g_dbus_method_invocation_return_error (invocation,
+							       G_DBUS_ERROR,
+							       G_DBUS_ERROR_INVALID_ARGS,
+							       "Unknown sensor '%s'",
+							       sensors[i]);
+			g_free (sensors);
+			return;
+		}
+		driver_types |= 1 << driver_type;
+	}
+	g_free (sensors);
+
+	if (method == SCHEMA_METHOD_CLAIM_MULTIPLE) {
+		SensorSnapshot snapshot;
+		int mask = 0;
+
+		for (i = 0; i < NUM_SENSOR_TYPES; i++) {
+			if (!(driver_types & (1 << i)))
+				continue;
+			client_claim (data, sender, (DriverType) i);
+			mask |= driver_type_to_props ((DriverType) i);
+		}
+
+		sensor_state_read (data->state, &snapshot);
+		g_dbus_method_invocation_return_value (invocation,
+						       g_variant_new ("(@a{sv})",
+								      build_properties (data, &snapshot, mask)));
+	} else {
+		for (i = 0; i < NUM_SENSOR_TYPES; i++) {
+			if (driver_types & (1 << i))
+				client_release (data, sender, (DriverType) i);
+		}
+
+		g_dbus_method_invocation_return_value (invocation, NULL);
+	}
+}
+
+static void
+handle_reset_altitude_method_call (SensorData            *data,
+				   GDBusMethodInvocation *invocation)
+{
+	SensorSnapshot snapshot;
+
+	if (!driver_type_exists (data, DRIVER_TYPE_PRESSURE)) {
+		g_dbus_method_invocation_return_error (invocation,
+						       G_DBUS_ERROR,
+						       G_DBUS_ERROR_NOT_SUPPORTED,
+						       "No pressure sensor");
+		return;
+	}
+
+	/* The next reading is the reference if there was none yet */
+	sensor_state_read (data->state, &snapshot);
+	data->altitude_reference = snapshot.pressure;
+	if (sensor_state_set_pressure (data->state, snapshot.pressure, 0.0) ||
+	    snapshot.altitude != 0.0)
+		queue_dbus_event (data, PROP_ALTITUDE);
+
+	g_dbus_method_invocation_return_value (invocation, NULL);
+}
+
+static void
+handle_method_call (GDBusConnection       *connection,
+		    const gchar           *sender,
+		    const gchar           *object_path,
+		    const gchar           *interface_name,
+		    const gchar           *method_name,
+		    GVariant              *parameters,
+		    GDBusMethodInvocation *invocation,
+		    gpointer               user_data)
+{
+	SensorData *data = (SensorData *) user_data;
+	SchemaMethod method;
+
+	if (sender == NULL)
+		sender = (const gchar *) g_object_get_data (G_OBJECT (connection), PEER_NAME_KEY);
+
+	if (g_strcmp0 (interface_name, "org.freedesktop.DBus.Properties") == 0) {
+		handle_properties_method_call (data, method_name, parameters, invocation);
+		return;
+	}
+
+	method = schema_lookup_method (schema_lookup_interface (interface_name), method_name);
+
+	switch (method) {
+	case SCHEMA_METHOD_CLAIM_ACCELEROMETER:
+	case SCHEMA_METHOD_RELEASE_ACCELEROMETER:
+		handle_claim_method_call (data, sender, invocation, DRIVER_TYPE_ACCEL,
+					  method == SCHEMA_METHOD_CLAIM_ACCELEROMETER);
+		break;
+	case SCHEMA_METHOD_CLAIM_LIGHT:
+	case SCHEMA_METHOD_RELEASE_LIGHT:
+		handle_claim_method_call (data, sender, invocation, DRIVER_TYPE_LIGHT,
+					  method == SCHEMA_METHOD_CLAIM_LIGHT);
+		break;
+	case SCHEMA_METHOD_CLAIM_PROXIMITY:
+	case SCHEMA_METHOD_RELEASE_PROXIMITY:
+		handle_claim_method_call (data, sender, invocation, DRIVER_TYPE_PROXIMITY,
+					  method == SCHEMA_METHOD_CLAIM_PROXIMITY);
+		break;
+	case SCHEMA_METHOD_CLAIM_COMPASS:
+	case SCHEMA_METHOD_RELEASE_COMPASS:
+		handle_claim_method_call (data, sender, invocation, DRIVER_TYPE_COMPASS,
+					  method == SCHEMA_METHOD_CLAIM_COMPASS);
+		break;
+	case SCHEMA_METHOD_CLAIM_GYROSCOPE:
+	case SCHEMA_METHOD_RELEASE_GYROSCOPE:
+		handle_claim_method_call (data, sender, invocation, DRIVER_TYPE_GYROSCOPE,
+					  method == SCHEMA_METHOD_CLAIM_GYROSCOPE);
+		break;
+	case SCHEMA_METHOD_CLAIM_PRESSURE:
+	case SCHEMA_METHOD_RELEASE_PRESSURE:
+		handle_claim_method_call (data, sender, invocation, DRIVER_TYPE_PRESSURE,
+					  method == SCHEMA_METHOD_CLAIM_PRESSURE);
+		break;
+	case SCHEMA_METHOD_CLAIM_TEMPERATURE:
+	case SCHEMA_METHOD_RELEASE_TEMPERATURE:
+		handle_claim_method_call (data, sender, invocation, DRIVER_TYPE_TEMPERATURE,
+					  method == SCHEMA_METHOD_CLAIM_TEMPERATURE);
+		break;
+	case SCHEMA_METHOD_CLAIM_HUMIDITY:
+	case SCHEMA_METHOD_RELEASE_HUMIDITY:
+		handle_claim_method_call (data, sender, invocation, DRIVER_TYPE_HUMIDITY,
+					  method == SCHEMA_METHOD_CLAIM_HUMIDITY);
+		break;
+	case SCHEMA_METHOD_CLAIM_STEP_COUNTER:
+	case SCHEMA_METHOD_RELEASE_STEP_COUNTER:
+		handle_claim_method_call (data, sender, invocation, DRIVER_TYPE_STEP_COUNTER,
+					  method == SCHEMA_METHOD_CLAIM_STEP_COUNTER);
+		break;
+	case SCHEMA_METHOD_CLAIM_TAP:
+	case SCHEMA_METHOD_RELEASE_TAP:
+		handle_claim_method_call (data, sender, invocation, DRIVER_TYPE_TAP,
+					  method == SCHEMA_METHOD_CLAIM_TAP);
+		break;
+	case SCHEMA_METHOD_RESET_ALTITUDE:
+		handle_reset_altitude_method_call (data, invocation);
+		break;
+	case SCHEMA_METHOD_GET_CHANGE_FILTER:
+	case SCHEMA_METHOD_SET_CHANGE_FILTER:
+		handle_tuning_method_call (data, connection, sender, method, parameters, invocation);
+		break;
+	case SCHEMA_METHOD_OPEN_SNAPSHOT:
+		handle_snapshot_method_call (data, connection, invocation);
+		break;
+	case SCHEMA_METHOD_OPEN_STREAM:
+	case SCHEMA_METHOD_CLOSE_STREAM:
+		handle_stream_method_call (data, connection, sender, method, parameters, invocation);
+		break;
+	case SCHEMA_METHOD_CLAIM_MULTIPLE:
+	case SCHEMA_METHOD_RELEASE_MULTIPLE:
+		handle_batch_method_call (data, connection, sender, method, parameters, invocation);
+		break;
+	default:
+		g_dbus_method_invocation_return_error (invocation,
+						       G_DBUS_ERROR,
+						       G_DBUS_ERROR_UNKNOWN_METHOD,
+						       "Method '%s' does not exist on object %s",
+						       method_name, object_path);
+		break;
+	}
+}
+
+/* Shared by every interface of dbus-schema.h */
+static const GDBusInterfaceVTable interface_vtable =
+{
+	handle_method_call,
+	NULL,
+	NULL
+};
+
+static void
+name_lost_handler (GDBusConnection *connection,
+		   const gchar     *name,
+		   gpointer         user_data)
+{
+	g_debug ("iio-sensor-proxy is already running, or it cannot own its D-Bus name. Verify installation.");
+	exit (0);
+}
+
+/* Sent by repowerd on Ubuntu Touch, state 0 is off */
+static void
+display_power_state_changed_cb (GDBusConnection *connection,
+				const gchar     *sender_name,
+				const gchar     *object_path,
+				const gchar     *interface_name,
+				const gchar     *signal_name,
+				GVariant        *parameters,
+				gpointer         user_data)
+{
+	SensorData *data = (SensorData *) user_data;
+	gint32 state, reason;
+
+	if (!g_variant_is_of_type (parameters, G_VARIANT_TYPE ("(ii)")))
+		return;
+
+	g_variant_get (parameters, "(ii)", &state, &reason);
+	if (data->display_on == (state != 0))
+		return;
+
+	data->display_on = (state != 0);
+	g_debug ("Display turned %s", data->display_on ? "on" : "off");
+	update_all_sensor_policies (data);
+}
+
+static void
+prepare_for_sleep_cb (GDBusConnection *connection,
+		      const gchar     *sender_name,
+		      const gchar     *object_path,
+		      const gchar     *interface_name,
+		      const gchar     *signal_name,
+		      GVariant        *parameters,
+		      gpointer         user_data)
+{
+	SensorData *data = (SensorData *) user_data;
+	gboolean start;
+
+	if (!g_variant_is_of_type (parameters, G_VARIANT_TYPE ("(b)")))
+		return;
+
+	g_variant_get (parameters, "(b)", &start);
+	if (data->suspended == start)
+		return;
+
+	data->suspended = start;
+	g_debug ("System %s", start ? "suspending" : "resumed");
+	update_all_sensor_policies (data);
+}
+
+static void
+register_objects (SensorData      *data,
+		  GDBusConnection *connection)
+{
+	guint i;
+
+	for (i = 0; i < SCHEMA_N_INTERFACES; i++) {
+		g_dbus_connection_register_object (connection,
+						   schema_interface_path ((SchemaInterface) i),
+						   schema_interface_info ((SchemaInterface) i),
+						   &interface_vtable,
+						   data,
+						   NULL,
+						   NULL);
+	}
+}
+
+static void
+bus_acquired_handler (GDBusConnection *connection,
+		      const gchar     *name,
+		      gpointer         user_data)
+{
+	SensorData *data = (SensorData *)user_data;
+
+	register_objects (data, connection);
+
+	data->display_signal_id = g_dbus_connection_signal_subscribe (connection,
+								       "com.canonical.Unity.Screen",
+								       "com.canonical.Unity.Screen",
+								       "DisplayPowerStateChange",
+								       "/com/canonical/Unity/Screen",
+								       NULL,
+								       G_DBUS_SIGNAL_FLAGS_NONE,
+								       display_power_state_changed_cb,
+								       data,
+								       NULL);
+	data->sleep_signal_id = g_dbus_connection_signal_subscribe (connection,
+								     "org.freedesktop.login1",
+								     "org.freedesktop.login1.Manager",
+								     "PrepareForSleep",
+								     "/org/freedesktop/login1",
+								     NULL,
+								     G_DBUS_SIGNAL_FLAGS_NONE,
+								     prepare_for_sleep_cb,
+								     data,
+								     NULL);
+
+	data->connection = (GDBusConnection *) g_object_ref(connection);
+}
+
+char const *const log_tag = "main";
+
+std::string the_dbus_bus_address()
+{
+	auto const address = std::unique_ptr<gchar, decltype(&g_free)>{
+		g_dbus_address_get_for_bus_sync(G_BUS_TYPE_SYSTEM, nullptr, nullptr),
+		g_free};
+
+	return address ? address.get() : std::string{};
+}
+
+static void
+name_acquired_handler (GDBusConnection *connection,
+		       const gchar     *name,
+		       gpointer         user_data)
+{
+	SensorData *data = (SensorData *)user_data;
+
+	flush_dbus_events (PROP_ALL, data);
+	return;
+
+bail:
+	data->ret = 0;
+	g_debug ("No sensors or missing kernel drivers for the sensors");
+	g_main_loop_quit (data->loop);
+}
+
+static gboolean
+setup_dbus (SensorData *data)
+{
+	data->name_id = g_bus_own_name (G_BUS_TYPE_SYSTEM,
+					SENSOR_PROXY_DBUS_NAME,
+					G_BUS_NAME_OWNER_FLAGS_NONE,
+					bus_acquired_handler,
+					name_acquired_handler,
+					name_lost_handler,
+					data,
+					NULL);
+
+	return TRUE;
+}
+
+static void
+free_sensor_data (SensorData *data)
+{
+	guint i;
+
+	if (data == NULL)
+		return;
+
+	if (data->name_id != 0) {
+		g_bus_unown_name (data->name_id);
+		data->name_id = 0;
+	}
+
+	if (data->peer_server != NULL) {
+		g_dbus_server_stop (data->peer_server);
+		g_clear_object (&data->peer_server);
+	}
+	if (data->peers != NULL) {
+		GHashTableIter iter;
+		gpointer peer;
+
+		g_hash_table_iter_init (&iter, data->peers);
+		while (g_hash_table_iter_next (&iter, NULL, &peer))
+			g_signal_handlers_disconnect_by_data (peer, data);
+		g_clear_pointer (&data->peers, g_hash_table_unref);
+	}
+
+	g_clear_pointer (&data->clients, g_hash_table_unref);
+	for (i = 0; i < NUM_SENSOR_TYPES; i++)
+		g_clear_pointer (&data->streams[i], sample_stream_set_free);
+
+	if (data->connection != NULL) {
+		g_dbus_connection_signal_unsubscribe (data->connection, data->display_signal_id);
+		g_dbus_connection_signal_unsubscribe (data->connection, data->sleep_signal_id);
+	}
+
+	g_clear_pointer (&data->emission_scheduler, emission_scheduler_free);
+	g_clear_pointer (&data->signal_templates, g_hash_table_unref);
+	invalidate_cached_properties (data, PROP_ALL);
+	g_clear_pointer (&data->state, sensor_state_free);
+	g_clear_pointer (&data->light_filter, change_filter_free);
+	g_clear_pointer (&data->compass_filter, change_filter_free);
+	g_clear_pointer (&data->pressure_filter, change_filter_free);
+	g_clear_pointer (&data->temperature_filter, change_filter_free);
+	g_clear_pointer (&data->humidity_filter, change_filter_free);
+	g_clear_pointer (&data->fusion, rotation_fusion_free);
+	g_clear_pointer (&data->tilt_compass, tilt_compass_free);
+	g_clear_object (&data->connection);
+	g_clear_object (&data->client);
+	g_clear_pointer (&data->loop, g_main_loop_unref);
+	g_free (data);
+}
+
+static guint
+get_env_uint (const char *name,
+	      guint       default_value)
+{
+	const char *value;
+	guint64 ret;
+	char *end;
+
+	value = g_getenv (name);
+	if (value == NULL || *value == '\0')
+		return default_value;
+
+	ret = g_ascii_strtoull (value, &end, 10);
+	if (*end != '\0' || ret > G_MAXUINT) {
+		g_warning ("Ignoring invalid value '%s' for %s", value, name);
+		return default_value;
+	}
+
+	return ret;
+}
+
+static gdouble
+get_env_double (const char *name,
+		gdouble     default_value)
+{
+	const char *value;
+	gdouble ret;
+	char *end;
+
+	value = g_getenv (name);
+	if (value == NULL || *value == '\0')
+		return default_value;
+
+	ret = g_ascii_strtod (value, &end);
+	if (*end != '\0' || !(ret >= 0)) {
+		g_warning ("Ignoring invalid value '%s' for %s", value, name);
+		return default_value;
+	}
+
+	return ret;
+}
+
+/* HADESS_SENSORFW_<SENSOR>_BUFFER_SIZE / _BUFFER_INTERVAL let sensord
+ * batch samples in its FIFO for latency-tolerant setups */
+static void
+setup_batching (repowerd::Sensorfw &sensor,
+		const char        *name,
+		guint              default_size,
+		guint              default_interval)
+{
+	char *size_env, *interval_env;
+	guint buffer_size, buffer_interval;
+
+	size_env = g_strdup_printf ("HADESS_SENSORFW_%s_BUFFER_SIZE", name);
+	interval_env = g_strdup_printf ("HADESS_SENSORFW_%s_BUFFER_INTERVAL", name);
+
+	buffer_size = get_env_uint (size_env, default_size);
+	buffer_interval = get_env_uint (interval_env, default_interval);
+
+	g_free (size_env);
+	g_free (interval_env);
+
+	if (buffer_size == 0)
+		return;
+
+	sensor.set_batching (buffer_size, buffer_interval);
+}
+
+template<typename Plugin>
+static std::shared_ptr<repowerd::Sensor<typename Plugin::Value>>
+create_sensor (std::shared_ptr<repowerd::Log> const &log,
+	       const char                         *batching_name,
+	       guint                               default_buffer_size = 0,
+	       guint                               default_buffer_interval = 0)
+{
 	try
 	{
-		data->compass_sensor = std::make_shared<repowerd::SensorfwCompassSensor>(log,
+		auto const sensor = std::make_shared<repowerd::SensorfwSensor<Plugin>>(log,
 			the_dbus_bus_address());
-		data->compass_avaliable = TRUE;
-		send_dbus_event(data, PROP_HAS_COMPASS);
+		setup_batching (*sensor, batching_name, default_buffer_size, default_buffer_interval);
+		return sensor;
 	}
 	catch (std::exception const &e)
 	{
-		log->log(log_tag, "Failed to create SensorfwCompassSensor: %s", e.what());
-		data->compass_avaliable = FALSE;
+		log->log(log_tag, "Failed to create sensorfw %s backend: %s", Plugin::name(), e.what());
+		return nullptr;
+	}
+}
+
+/* The sensor itself is started by its policy once it gets claimed */
+template<typename Value>
+static repowerd::HandlerRegistration
+register_sensor_handler (std::shared_ptr<repowerd::Sensor<Value>> const &sensor,
+			 typename repowerd::Sensor<Value>::Handler const &handler)
+{
+	if (!sensor)
+		return {};
+
+	return sensor->register_handler (handler);
+}
+
+template<typename Value>
+static void
+stop_sensor (std::shared_ptr<repowerd::Sensor<Value>> const &sensor)
+{
+	if (sensor)
+		sensor->disable_events ();
+}
+
+/* HADESS_SENSORFW_<SENSOR>_CHANGE_ABS, _CHANGE_REL, _HYSTERESIS and
+ * _DWELL (ms) override the significance filter defaults. The dwell
+ * time of @props is enforced by the emission scheduler */
+static ChangeFilter *
+create_change_filter (SensorData               *data,
+		      const char               *name,
+		      const ChangeFilterParams *defaults,
+		      guint                     props)
+{
+	ChangeFilterParams params = *defaults;
+	char *env;
+
+	env = g_strdup_printf ("HADESS_SENSORFW_%s_CHANGE_ABS", name);
+	params.abs_delta = get_env_double (env, params.abs_delta);
+	g_free (env);
+
+	env = g_strdup_printf ("HADESS_SENSORFW_%s_CHANGE_REL", name);
+	params.rel_delta = get_env_double (env, params.rel_delta);
+	g_free (env);
+
+	env = g_strdup_printf ("HADESS_SENSORFW_%s_HYSTERESIS", name);
+	params.hysteresis = get_env_double (env, params.hysteresis);
+	g_free (env);
+
+	env = g_strdup_printf ("HADESS_SENSORFW_%s_DWELL", name);
+	params.dwell_ms = get_env_uint (env, params.dwell_ms);
+	g_free (env);
+
+	env = g_strdup_printf ("HADESS_SENSORFW_%s_QUANTUM", name);
+	params.quantum = get_env_double (env, params.quantum);
+	g_free (env);
+
+	env = g_strdup_printf ("HADESS_SENSORFW_%s_LOG_BUCKETS", name);
+	params.log_buckets = get_env_uint (env, params.log_buckets);
+	g_free (env);
+
+	emission_scheduler_set_dwell (data->emission_scheduler, props, params.dwell_ms);
+	return change_filter_new (&params);
+}
+
+static void
+setup_change_filters (SensorData *data)
+{
+	/* 1 lux or 5%, whichever is larger, at full resolution */
+	static const ChangeFilterParams light_defaults = { 1.0, 0.05, 0.0, 0, FALSE, 0.0, 0 };
+	/* Whole degrees, and one more to turn back to stop the jitter */
+	static const ChangeFilterParams compass_defaults = { 1.0, 0.0, 1.0, 0, TRUE, 1.0, 0 };
+	/* About 10cm of altitude */
+	static const ChangeFilterParams pressure_defaults = { 0.012, 0.0, 0.0, 0, FALSE, 0.0, 0 };
+	/* sensord reports whole degrees and percent, so there is nothing to
+	 * quantize. Half a degree and two percent, with as much again to
+	 * turn back */
+	static const ChangeFilterParams temperature_defaults = { 0.5, 0.0, 0.5, 0, FALSE, 0.0, 0 };
+	static const ChangeFilterParams humidity_defaults = { 2.0, 0.0, 2.0, 0, FALSE, 0.0, 0 };
+
+	data->light_filter = create_change_filter (data, "LIGHT", &light_defaults,
+						   PROP_LIGHT_LEVEL);
+	data->compass_filter = create_change_filter (data, "COMPASS", &compass_defaults,
+						     PROP_COMPASS_HEADING);
+	data->pressure_filter = create_change_filter (data, "PRESSURE", &pressure_defaults,
+						      PROP_PRESSURE | PROP_ALTITUDE);
+	data->temperature_filter = create_change_filter (data, "TEMPERATURE", &temperature_defaults,
+							 PROP_TEMPERATURE);
+	data->humidity_filter = create_change_filter (data, "HUMIDITY", &humidity_defaults,
+						      PROP_RELATIVE_HUMIDITY);
+}
+
+static const struct {
+	guint       prop;
+	const char *env;
+	guint       default_hz;
+} emission_rate_caps[] = {
+	{ PROP_ACCELEROMETER_ORIENTATION, "HADESS_SENSORFW_MAX_RATE_ORIENTATION", 0 },
+	{ PROP_LIGHT_LEVEL, "HADESS_SENSORFW_MAX_RATE_LIGHT_LEVEL", 10 },
+	{ PROP_COMPASS_HEADING, "HADESS_SENSORFW_MAX_RATE_COMPASS_HEADING", 10 },
+	{ PROP_ROTATION_VECTOR, "HADESS_SENSORFW_MAX_RATE_ROTATION_VECTOR", 30 },
+	{ PROP_STEP_COUNT, "HADESS_SENSORFW_MAX_RATE_STEP_COUNT", 1 },
+	{ PROP_PROXIMITY_NEAR, "HADESS_SENSORFW_MAX_RATE_PROXIMITY", 0 },
+	{ PROP_PROXIMITY_VALUE, "HADESS_SENSORFW_MAX_RATE_PROXIMITY_VALUE", 10 },
+};
+
+/* HADESS_SENSORFW_EMIT_WINDOW (ms) and HADESS_SENSORFW_MAX_RATE_* (Hz,
+ * 0 for uncapped) bound the PropertiesChanged traffic.
+ * HADESS_SENSORFW_UNICAST_FANOUT addresses sensor readings to up to that
+ * many claimants instead of broadcasting them */
+static void
+setup_emission (SensorData *data)
+{
+	guint i;
+
+	data->unicast_fanout = get_env_uint ("HADESS_SENSORFW_UNICAST_FANOUT", 0);
+
+	data->emission_scheduler = emission_scheduler_new (get_env_uint ("HADESS_SENSORFW_EMIT_WINDOW", 16),
+							   flush_dbus_events,
+							   data);
+
+	for (i = 0; i < G_N_ELEMENTS (emission_rate_caps); i++) {
+		emission_scheduler_set_max_rate (data->emission_scheduler,
+						 emission_rate_caps[i].prop,
+						 get_env_uint (emission_rate_caps[i].env,
+							       emission_rate_caps[i].default_hz));
+	}
+}
+
+static const struct {
+	DriverType  driver_type;
+	const char *env;
+	guint       default_ms;
+} sample_intervals[] = {
+	{ DRIVER_TYPE_PRESSURE, "HADESS_SENSORFW_PRESSURE_INTERVAL", 1000 },
+	{ DRIVER_TYPE_TEMPERATURE, "HADESS_SENSORFW_TEMPERATURE_INTERVAL", 0 },
+	{ DRIVER_TYPE_HUMIDITY, "HADESS_SENSORFW_HUMIDITY_INTERVAL", 0 },
+};
+
+/* HADESS_SENSORFW_<SENSOR>_INTERVAL (ms) is the rate of sensors that
+ * don't need sensord's default one, unless a stream asks for more */
+static void
+setup_sample_intervals (SensorData *data)
+{
+	guint i;
+
+	for (i = 0; i < G_N_ELEMENTS (sample_intervals); i++) {
+		data->sample_interval[sample_intervals[i].driver_type] =
+			get_env_uint (sample_intervals[i].env, sample_intervals[i].default_ms);
+	}
+}
+
+/* HADESS_SENSORFW_STREAM_CAPACITY is the ring size, in samples */
+static void
+setup_streams (SensorData *data)
+{
+	guint i;
+
+	for (i = 0; i < NUM_SENSOR_TYPES; i++)
+		data->streams[i] = sample_stream_set_new ();
+	data->stream_capacity = MAX (get_env_uint ("HADESS_SENSORFW_STREAM_CAPACITY", 256), 1);
+}
+
+static gboolean
+allow_peer_mechanism_cb (GDBusAuthObserver *observer,
+			 const gchar       *mechanism,
+			 gpointer           user_data)
+{
+	/* Credentials are only known for EXTERNAL */
+	return g_strcmp0 (mechanism, "EXTERNAL") == 0;
+}
+
+static gboolean
+authorize_peer_cb (GDBusAuthObserver *observer,
+		   GIOStream         *stream,
+		   GCredentials      *credentials,
+		   gpointer           user_data)
+{
+	SensorData *data = (SensorData *) user_data;
+	uid_t uid;
+
+	if (credentials == NULL)
+		return FALSE;
+
+	uid = g_credentials_get_unix_user (credentials, NULL);
+	if (uid == (uid_t) -1)
+		return FALSE;
+
+	if (uid != 0 && uid != getuid () && uid != data->peer_uid) {
+		g_debug ("Refusing peer with uid %u", (guint) uid);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static void
+peer_closed_cb (GDBusConnection *connection,
+		gboolean         remote_peer_vanished,
+		GError          *error,
+		gpointer         user_data)
+{
+	SensorData *data = (SensorData *) user_data;
+	const char *name;
+
+	name = (const char *) g_object_get_data (G_OBJECT (connection), PEER_NAME_KEY);
+	g_debug ("Peer %s disconnected", name);
+
+	client_vanished_cb (connection, name, data);
+	g_hash_table_remove (data->peers, name);
+}
+
+static gboolean
+new_peer_cb (GDBusServer     *server,
+	     GDBusConnection *connection,
+	     gpointer         user_data)
+{
+	SensorData *data = (SensorData *) user_data;
+	char *name;
+
+	name = g_strdup_printf (":peer.%u", ++data->peer_serial);
+	g_debug ("Peer %s connected", name);
+
+	g_object_set_data_full (G_OBJECT (connection), PEER_NAME_KEY, g_strdup (name), g_free);
+	g_hash_table_insert (data->peers, name, g_object_ref (connection));
+	g_signal_connect (connection, "closed", G_CALLBACK (peer_closed_cb), data);
+	register_objects (data, connection);
+
+	return TRUE;
+}
+
+/* HADESS_SENSORFW_PEER_SOCKET is the path of a private socket serving
+ * the same objects without going through the bus daemon. Only root,
+ * our own user and HADESS_SENSORFW_PEER_UID may connect */
+static void
+setup_peer_server (SensorData *data)
+{
+	GDBusAuthObserver *observer;
+	const char *path;
+	char *escaped, *address, *guid;
+	GError *error = NULL;
+
+	data->peers = g_hash_table_new_full (g_str_hash, g_str_equal,
+					     g_free, g_object_unref);
+
+	path = g_getenv ("HADESS_SENSORFW_PEER_SOCKET");
+	if (path == NULL || *path == '\0')
+		return;
+
+	data->peer_uid = get_env_uint ("HADESS_SENSORFW_PEER_UID", 0);
+
+	/* Left behind by a previous run, it would make the bind fail */
+	if (unlink (path) < 0 && errno != ENOENT)
+		g_warning ("Could not remove %s: %s", path, g_strerror (errno));
+
+	escaped = g_dbus_address_escape_value (path);
+	address = g_strdup_printf ("unix:path=%s", escaped);
+	guid = g_dbus_generate_guid ();
+	observer = g_dbus_auth_observer_new ();
+	g_signal_connect (observer, "allow-mechanism",
+			  G_CALLBACK (allow_peer_mechanism_cb), data);
+	g_signal_connect (observer, "authorize-authenticated-peer",
+			  G_CALLBACK (authorize_peer_cb), data);
+
+	data->peer_server = g_dbus_server_new_sync (address,
+						    G_DBUS_SERVER_FLAGS_NONE,
+						    guid,
+						    observer,
+						    NULL,
+						    &error);
+	g_object_unref (observer);
+	g_free (guid);
+	g_free (address);
+	g_free (escaped);
+
+	if (data->peer_server == NULL) {
+		g_warning ("Could not listen on %s: %s", path, error->message);
+		g_error_free (error);
+		return;
+	}
+
+	g_signal_connect (data->peer_server, "new-connection",
+			  G_CALLBACK (new_peer_cb), data);
+	g_dbus_server_start (data->peer_server);
+	g_debug ("Accepting peers on %s", path);
+}
+
+/* HADESS_SENSORFW_ORIENTATION_RAW=0 uses sensord's orientation instead
+ * of the raw accelerometer. HADESS_SENSORFW_ORIENTATION_FILTER is the
+ * time constant (ms) of the gravity low-pass filter, and
+ * HADESS_SENSORFW_ORIENTATION_PORTRAIT / _LANDSCAPE / _SAME_AXIS the
+ * tilt (degrees) needed to rotate */
+static void
+setup_orientation (SensorData *data)
+{
+	static const OrientationThresholds defaults = ORIENTATION_THRESHOLDS_DEFAULT;
+
+	data->orientation_thresholds.portrait = get_env_uint ("HADESS_SENSORFW_ORIENTATION_PORTRAIT", defaults.portrait);
+	data->orientation_thresholds.landscape = get_env_uint ("HADESS_SENSORFW_ORIENTATION_LANDSCAPE", defaults.landscape);
+	data->orientation_thresholds.same_axis = get_env_uint ("HADESS_SENSORFW_ORIENTATION_SAME_AXIS", defaults.same_axis);
+	gravity_filter_init (&data->gravity_filter, get_env_uint ("HADESS_SENSORFW_ORIENTATION_FILTER", 100));
+	data->orientation = ORIENTATION_UNDEFINED;
+}
+
+/* HADESS_SENSORFW_PROXIMITY_NEAR is the raw value at or below which
+ * something is near, 0 to go by sensord. It is only far again once the
+ * value goes above it by HADESS_SENSORFW_PROXIMITY_HYSTERESIS */
+static void
+setup_proximity (SensorData *data)
+{
+	data->prox_near_threshold = get_env_uint ("HADESS_SENSORFW_PROXIMITY_NEAR", 0);
+	data->prox_hysteresis = get_env_uint ("HADESS_SENSORFW_PROXIMITY_HYSTERESIS", 0);
+}
+
+/* HADESS_SENSORFW_COMPASS_RAW=0 uses sensord's compass instead of the
+ * magnetometer. HADESS_SENSORFW_COMPASS_SMOOTHING is the weight of each
+ * new batch in the heading, HADESS_SENSORFW_COMPASS_STILL how much the
+ * field or gravity have to move (fraction of their length) for the
+ * heading to be computed again */
+static void
+setup_tilt_compass (SensorData *data)
+{
+	data->tilt_compass = tilt_compass_new (get_env_double ("HADESS_SENSORFW_COMPASS_SMOOTHING", 0.3),
+					       get_env_double ("HADESS_SENSORFW_COMPASS_STILL", 0.01));
+}
+
+/* HADESS_SENSORFW_FUSION_BETA is how hard the gyroscope attitude is
+ * pulled towards gravity, higher converges faster but lets more
+ * accelerometer noise through */
+static void
+setup_fusion (SensorData *data)
+{
+	data->fusion = rotation_fusion_new (get_env_double ("HADESS_SENSORFW_FUSION_BETA", 0.1));
+}
+
+/* sensord's compass only gives whole degrees, the tilt-compensated
+ * heading is good to a fraction of one */
+static void
+setup_tilt_compass_filter (SensorData *data)
+{
+	static const ChangeFilterParams tilt_compass_defaults = { 0.1, 0.0, 0.1, 0, TRUE, 0.1, 0 };
+
+	change_filter_free (data->compass_filter);
+	data->compass_filter = create_change_filter (data, "COMPASS", &tilt_compass_defaults,
+						     PROP_COMPASS_HEADING);
+}
+
+static void
+setup_sensors (SensorData *data)
+{
+	auto const log = std::make_shared<repowerd::ConsoleLog>();
+
+	data->proximity_sensor = create_sensor<repowerd::ProximityPlugin> (log, "PROXIMITY");
+	data->prox_avaliable = (data->proximity_sensor != nullptr);
+	if (data->prox_avaliable)
+		queue_dbus_event (data, PROP_HAS_PROXIMITY);
+
+	data->light_sensor = create_sensor<repowerd::LightPlugin> (log, "LIGHT");
+	data->light_avaliable = (data->light_sensor != nullptr);
+	if (data->light_avaliable)
+		queue_dbus_event (data, PROP_HAS_AMBIENT_LIGHT);
+
+	if (get_env_uint ("HADESS_SENSORFW_ORIENTATION_RAW", 1))
+		data->accelerometer_sensor = create_sensor<repowerd::AccelerometerPlugin> (log, "ACCELEROMETER");
+	if (data->accelerometer_sensor == nullptr)
+		data->orientation_sensor = create_sensor<repowerd::OrientationPlugin> (log, "ORIENTATION");
+	data->accel_avaliable = (data->accelerometer_sensor != nullptr ||
+				 data->orientation_sensor != nullptr);
+	if (data->accel_avaliable)
+		queue_dbus_event (data, PROP_HAS_ACCELEROMETER);
+
+	if (data->accelerometer_sensor != nullptr &&
+	    get_env_uint ("HADESS_SENSORFW_COMPASS_RAW", 1))
+		data->magnetometer_sensor = create_sensor<repowerd::MagnetometerPlugin> (log, "MAGNETOMETER");
+	if (data->magnetometer_sensor == nullptr)
+		data->compass_sensor = create_sensor<repowerd::CompassPlugin> (log, "COMPASS");
+	else
+		setup_tilt_compass_filter (data);
+	data->compass_avaliable = (data->compass_sensor != nullptr ||
+				   data->magnetometer_sensor != nullptr);
+	if (data->compass_avaliable)
+		queue_dbus_event (data, PROP_HAS_COMPASS);
+
+	/* Frames of about a rotation vector update, at its 30Hz rate cap */
+	data->gyroscope_sensor = create_sensor<repowerd::GyroscopePlugin> (log, "GYROSCOPE", 8, 33);
+	data->gyro_avaliable = (data->gyroscope_sensor != nullptr);
+	if (data->gyro_avaliable)
+		queue_dbus_event (data, PROP_HAS_GYROSCOPE);
+
+	/* Floors take seconds to climb, a reading every 10 is enough to
+	 * wake up for */
+	data->pressure_sensor = create_sensor<repowerd::PressurePlugin> (log, "PRESSURE", 10, 10000);
+	data->pressure_avaliable = (data->pressure_sensor != nullptr);
+	if (data->pressure_avaliable)
+		queue_dbus_event (data, PROP_HAS_PRESSURE);
+
+	data->temperature_sensor = create_sensor<repowerd::TemperaturePlugin> (log, "TEMPERATURE");
+	data->temperature_avaliable = (data->temperature_sensor != nullptr);
+	if (data->temperature_avaliable)
+		queue_dbus_event (data, PROP_HAS_TEMPERATURE);
+
+	data->humidity_sensor = create_sensor<repowerd::HumidityPlugin> (log, "HUMIDITY");
+	data->humidity_avaliable = (data->humidity_sensor != nullptr);
+	if (data->humidity_avaliable)
+		queue_dbus_event (data, PROP_HAS_HUMIDITY);
+
+	/* The hub counts on its own, batching only delays when we hear of it.
+	 * A batch, up to 100 steps or a minute of them, is a single
+	 * StepCount change and Steps signal */
+	data->step_counter_sensor = create_sensor<repowerd::StepCounterPlugin> (log, "STEP_COUNTER", 100, 60000);
+	data->step_counter_avaliable = (data->step_counter_sensor != nullptr);
+	if (data->step_counter_avaliable)
+		queue_dbus_event (data, PROP_HAS_STEP_COUNTER);
+
+	data->tap_sensor = create_sensor<repowerd::TapPlugin> (log, "TAP");
+	data->tap_avaliable = (data->tap_sensor != nullptr);
+	if (data->tap_avaliable)
+		queue_dbus_event (data, PROP_HAS_TAP);
+}
+
+static void
+publish_orientation (SensorData    *data,
+		     OrientationUp  orientation)
+{
+	if (sensor_state_set_orientation (data->state, orientation))
+		queue_dbus_event (data, PROP_ACCELEROMETER_ORIENTATION);
+}
+
+static void
+publish_heading (SensorData *data,
+		 gdouble     heading,
+		 gint64      time)
+{
+	sample_stream_set_push (data->streams[DRIVER_TYPE_COMPASS], time, &heading);
+	if (change_filter_accept (data->compass_filter, &heading) &&
+	    sensor_state_set_heading (data->state, heading))
+		queue_dbus_event (data, PROP_COMPASS_HEADING);
+}
+
+/* International barometric formula, relative to the reference */
+static gdouble
+pressure_to_altitude (gdouble pressure,
+		      gdouble reference)
+{
+	return 44330.0 * (1.0 - pow (pressure / reference, 1.0 / 5.255));
+}
+
+static const char *
+tap_direction_to_str (TapData::Direction direction)
+{
+	switch (direction) {
+	case TapData::X:
+		return "x";
+	case TapData::Y:
+		return "y";
+	case TapData::Z:
+		return "z";
+	case TapData::LeftRight:
+		return "left-right";
+	case TapData::RightLeft:
+		return "right-left";
+	case TapData::TopBottom:
+		return "top-bottom";
+	case TapData::BottomTop:
+		return "bottom-top";
+	case TapData::FaceBack:
+		return "face-back";
+	case TapData::BackFace:
+		return "back-face";
+	default:
+		g_assert_not_reached ();
 	}
 }
 
@@ -646,92 +2279,238 @@ int main (int argc, char **argv)
 	int ret = 0;
 
 	data = g_new0 (SensorData, 1);
-	data->previous_orientation = ORIENTATION_UNDEFINED;
-	data->uses_lux = TRUE;
+	data->state = sensor_state_new ();
+	data->clients = create_clients_hash_table ();
+	data->display_on = TRUE;
+	data->signal_templates = g_hash_table_new_full (g_int64_hash, g_int64_equal, g_free,
+							(GDestroyNotify) signal_template_free);
+
+	setup_emission (data);
+	setup_change_filters (data);
+	setup_streams (data);
+	setup_sample_intervals (data);
+	setup_orientation (data);
+	setup_proximity (data);
+	setup_fusion (data);
+	setup_tilt_compass (data);
+	setup_peer_server (data);
 
 	/* Set up D-Bus */
 	setup_dbus (data);
 
 	setup_sensors(data);
-	repowerd::HandlerRegistration prox_registration;
-	repowerd::HandlerRegistration light_registration;
-	repowerd::HandlerRegistration orientation_registration;
-	repowerd::HandlerRegistration compass_registration;
-	if (data->prox_avaliable == TRUE) {
-		prox_registration = data->proximity_sensor->register_proximity_handler(
-			[data](repowerd::ProximityState state) {
-				data->previous_prox_near = (state == repowerd::ProximityState::near);
-				send_dbus_event(data, PROP_PROXIMITY_NEAR);
-			});
-		data->proximity_sensor->enable_proximity_events();
-	}
-	if (data->light_avaliable == TRUE) {
-		light_registration = data->light_sensor->register_light_handler(
-			[data](double light) {
-				if (data->previous_level != light) {
-					data->previous_level = light;
-					send_dbus_event(data, PROP_LIGHT_LEVEL);
-				}
-			});
-		data->light_sensor->enable_light_events();
-	}
-	if (data->prox_avaliable == TRUE) {
-		orientation_registration = data->orientation_sensor->register_orientation_handler(
-			[data](repowerd::OrientationData value) {
-				OrientationUp orientation = data->previous_orientation;
-				switch (value)
-				{
-				case repowerd::OrientationData::LeftUp:
-					orientation = ORIENTATION_LEFT_UP;
-					break;
-				case repowerd::OrientationData::RightUp:
-					orientation = ORIENTATION_RIGHT_UP;
-					break;
-				case repowerd::OrientationData::BottomUp:
-					orientation = ORIENTATION_BOTTOM_UP;
-					break;
-				case repowerd::OrientationData::BottomDown:
-					orientation = ORIENTATION_NORMAL;
-					break;
-				case repowerd::OrientationData::FaceDown:
-					orientation = ORIENTATION_NORMAL;
-					break;
-				case repowerd::OrientationData::FaceUp:
-					orientation = ORIENTATION_NORMAL;
-					break;
-				default:
-					orientation = ORIENTATION_UNDEFINED;
-					break;
-				}
-				if (data->previous_orientation != orientation) {
-					data->previous_orientation = orientation;
-					send_dbus_event(data, PROP_ACCELEROMETER_ORIENTATION);
-				}
-			});
-		data->orientation_sensor->enable_orientation_events();
-	}
-	if (data->compass_avaliable == TRUE) {
-		compass_registration = data->compass_sensor->register_compass_handler(
-			[data](int heading) {
-				if (data->previous_heading != heading) {
-					data->previous_heading = heading;
-					send_dbus_event(data, PROP_COMPASS_HEADING);
-				}
-			});
-		data->compass_sensor->enable_compass_events();
-	}
+	auto const prox_registration = register_sensor_handler (data->proximity_sensor,
+		[data](repowerd::ProximityReading reading) {
+			gdouble sample;
+			int mask = 0;
+
+			if (data->prox_near_threshold == 0)
+				data->prox_near = (reading.state == repowerd::ProximityState::near);
+			else if (reading.value <= data->prox_near_threshold)
+				data->prox_near = TRUE;
+			else if (reading.value > data->prox_near_threshold + data->prox_hysteresis)
+				data->prox_near = FALSE;
+
+			sample = data->prox_near;
+			sample_stream_set_push (data->streams[DRIVER_TYPE_PROXIMITY], reading.timestamp, &sample);
+			if (sensor_state_set_prox_near (data->state, data->prox_near))
+				mask |= PROP_PROXIMITY_NEAR;
+			if (sensor_state_set_prox_value (data->state, reading.value))
+				mask |= PROP_PROXIMITY_VALUE;
+			if (mask != 0)
+				queue_dbus_event (data, mask);
+		});
+	auto const light_registration = register_sensor_handler (data->light_sensor,
+		[data](repowerd::TimedReading light) {
+			sample_stream_set_push (data->streams[DRIVER_TYPE_LIGHT], light.timestamp, &light.value);
+			if (change_filter_accept (data->light_filter, &light.value) &&
+			    sensor_state_set_level (data->state, light.value))
+				queue_dbus_event (data, PROP_LIGHT_LEVEL);
+		});
+	auto const orientation_registration = register_sensor_handler (data->orientation_sensor,
+		[data](repowerd::OrientationReading reading) {
+			OrientationUp orientation;
+			switch (reading.orientation)
+			{
+			case repowerd::OrientationData::LeftUp:
+				orientation = ORIENTATION_LEFT_UP;
+				break;
+			case repowerd::OrientationData::RightUp:
+				orientation = ORIENTATION_RIGHT_UP;
+				break;
+			case repowerd::OrientationData::BottomUp:
+				orientation = ORIENTATION_BOTTOM_UP;
+				break;
+			case repowerd::OrientationData::BottomDown:
+				orientation = ORIENTATION_NORMAL;
+				break;
+			case repowerd::OrientationData::FaceDown:
+			case repowerd::OrientationData::FaceUp:
+				/* Lying flat says nothing about the rotation, keep it */
+				return;
+			default:
+				orientation = ORIENTATION_UNDEFINED;
+				break;
+			}
+			publish_orientation (data, orientation);
+		});
+	auto const accelerometer_registration = register_sensor_handler (data->accelerometer_sensor,
+		[data](repowerd::XyzReading reading) {
+			/* mG to m/s² */
+			const gdouble scale = 9.80665 / 1000.0;
+			const gdouble raw[3] = { reading.x * scale, reading.y * scale, reading.z * scale };
+			const float sample[4] = { reading.x, reading.y, reading.z, 0 };
+			const float up[3] = { -reading.x, -reading.y, -reading.z };
+			const float *gravity;
+
+			sample_stream_set_push (data->streams[DRIVER_TYPE_ACCEL], reading.timestamp, raw);
+			rotation_fusion_set_gravity (data->fusion, up);
+			gravity = gravity_filter_push (&data->gravity_filter, sample, reading.timestamp);
+			if (data->magnetometer_sensor) {
+				const float filtered_up[3] = { -gravity[0], -gravity[1], -gravity[2] };
+				tilt_compass_set_gravity (data->tilt_compass, filtered_up);
+			}
+			data->orientation = orientation_calc (data->orientation,
+							      gravity[0], gravity[1], gravity[2],
+							      &data->orientation_thresholds);
+			publish_orientation (data, data->orientation);
+		});
+	auto const compass_registration = register_sensor_handler (data->compass_sensor,
+		[data](repowerd::TimedReading heading) {
+			publish_heading (data, heading.value, heading.timestamp);
+		});
+	auto const magnetometer_registration = register_sensor_handler (data->magnetometer_sensor,
+		[data](repowerd::MagneticFieldBatch batch) {
+			gdouble heading;
+
+			if (tilt_compass_push (data->tilt_compass,
+					       batch.x.data (), batch.y.data (), batch.z.data (),
+					       batch.x.size (), &heading))
+				publish_heading (data, heading, batch.timestamp);
+		});
+	auto const gyroscope_registration = register_sensor_handler (data->gyroscope_sensor,
+		[data](repowerd::AngularVelocityFrame frame) {
+			/* mdps to rad/s */
+			const float scale = G_PI / 180.0 / 1000.0;
+			guint n = frame.samples.size ();
+			float (*rates)[3];
+			guint64 *timestamps;
+			gdouble rotation[4];
+			guint i;
+
+			if (n == 0)
+				return;
+
+			rates = (float (*)[3]) g_new (float, 3 * n);
+			timestamps = g_new (guint64, n);
+			for (i = 0; i < n; i++) {
+				const repowerd::XyzReading &reading = frame.samples[i];
+				gdouble sample[3];
+
+				rates[i][0] = reading.x * scale;
+				rates[i][1] = reading.y * scale;
+				rates[i][2] = reading.z * scale;
+				timestamps[i] = reading.timestamp;
+
+				sample[0] = rates[i][0];
+				sample[1] = rates[i][1];
+				sample[2] = rates[i][2];
+				sample_stream_set_push (data->streams[DRIVER_TYPE_GYROSCOPE], reading.timestamp, sample);
+			}
+
+			/* One update, and at most one event, per frame */
+			rotation_fusion_update (data->fusion, rates, timestamps, n, rotation);
+			g_free (rates);
+			g_free (timestamps);
+			if (sensor_state_set_rotation (data->state, rotation))
+				queue_dbus_event (data, PROP_ROTATION_VECTOR);
+		});
+	auto const pressure_registration = register_sensor_handler (data->pressure_sensor,
+		[data](repowerd::TimedReading reading) {
+			gdouble pressure = reading.value;
+			gdouble reference;
+
+			sample_stream_set_push (data->streams[DRIVER_TYPE_PRESSURE], reading.timestamp, &pressure);
+			if (!change_filter_accept (data->pressure_filter, &pressure))
+				return;
+
+			/* Only worked out for the readings that get published */
+			reference = data->altitude_reference;
+			if (reference <= 0.0) {
+				reference = pressure;
+				data->altitude_reference = reference;
+			}
+			if (sensor_state_set_pressure (data->state, pressure,
+						       pressure_to_altitude (pressure, reference)))
+				queue_dbus_event (data, PROP_PRESSURE | PROP_ALTITUDE);
+		});
+	auto const temperature_registration = register_sensor_handler (data->temperature_sensor,
+		[data](repowerd::TimedReading temperature) {
+			sample_stream_set_push (data->streams[DRIVER_TYPE_TEMPERATURE], temperature.timestamp, &temperature.value);
+			if (change_filter_accept (data->temperature_filter, &temperature.value) &&
+			    sensor_state_set_temperature (data->state, temperature.value))
+				queue_dbus_event (data, PROP_TEMPERATURE);
+		});
+	auto const humidity_registration = register_sensor_handler (data->humidity_sensor,
+		[data](repowerd::TimedReading humidity) {
+			sample_stream_set_push (data->streams[DRIVER_TYPE_HUMIDITY], humidity.timestamp, &humidity.value);
+			if (change_filter_accept (data->humidity_filter, &humidity.value) &&
+			    sensor_state_set_humidity (data->state, humidity.value))
+				queue_dbus_event (data, PROP_RELATIVE_HUMIDITY);
+		});
+	auto const step_counter_registration = register_sensor_handler (data->step_counter_sensor,
+		[data](repowerd::StepCount steps) {
+			gdouble sample;
+			guint32 count, steps_taken;
+
+			/* Counted from the first reading, and carried over when
+			 * the hub starts over */
+			if (!data->step_primed) {
+				data->step_offset = -(gint64) steps.count;
+				data->step_primed = TRUE;
+			} else if (steps.count < data->step_raw) {
+				data->step_offset += data->step_raw;
+			}
+			data->step_raw = steps.count;
+			count = data->step_offset + steps.count;
+
+			sample = count;
+			sample_stream_set_push (data->streams[DRIVER_TYPE_STEP_COUNTER], steps.timestamp, &sample);
+
+			/* Not from the published count, which lags behind the
+			 * rate cap */
+			steps_taken = count - data->step_count;
+			data->step_count = count;
+			if (!sensor_state_set_step_count (data->state, count))
+				return;
+			queue_dbus_event (data, PROP_STEP_COUNT);
+			queue_dbus_signal (data, SCHEMA_SIGNAL_STEPS, DRIVER_TYPE_STEP_COUNTER,
+					   g_variant_new ("(tu)", (guint64) steps.timestamp, steps_taken));
+		});
+	auto const tap_registration = register_sensor_handler (data->tap_sensor,
+		[data](repowerd::TapEvent tap) {
+			queue_dbus_signal (data,
+					   tap.double_tap ? SCHEMA_SIGNAL_DOUBLE_TAP : SCHEMA_SIGNAL_TAP,
+					   DRIVER_TYPE_TAP,
+					   g_variant_new ("(ts)", (guint64) tap.timestamp,
+							  tap_direction_to_str (tap.direction)));
+		});
 	data->loop = g_main_loop_new (NULL, TRUE);
 	g_main_loop_run (data->loop);
 	ret = data->ret;
+	stop_sensor (data->proximity_sensor);
+	stop_sensor (data->light_sensor);
+	stop_sensor (data->orientation_sensor);
+	stop_sensor (data->accelerometer_sensor);
+	stop_sensor (data->compass_sensor);
+	stop_sensor (data->magnetometer_sensor);
+	stop_sensor (data->gyroscope_sensor);
+	stop_sensor (data->pressure_sensor);
+	stop_sensor (data->temperature_sensor);
+	stop_sensor (data->humidity_sensor);
+	stop_sensor (data->step_counter_sensor);
+	stop_sensor (data->tap_sensor);
 	free_sensor_data (data);
-	if (data->prox_avaliable == TRUE)
-		data->proximity_sensor->disable_proximity_events();
-	if (data->light_avaliable == TRUE)
-		data->light_sensor->disable_light_events();
-	if (data->accel_avaliable == TRUE)
-		data->orientation_sensor->disable_orientation_events();
-	if (data->compass_avaliable == TRUE)
-		data->compass_sensor->disable_compass_events();
 
 	return ret;
 }
@@ -16,6 +16,8 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <math.h>
+#include <string.h>
 #include <glib.h>
 
 #include "orientation.h"
@@ -48,3 +50,77 @@ string_to_orientation (const char *orientation)
         }
         return ORIENTATION_UNDEFINED;
 }
+
+#define RADIANS_TO_DEGREES 180.0/M_PI
+
+/* Gaps longer than that restart the filter from the current sample */
+#define GRAVITY_FILTER_MAX_GAP (G_USEC_PER_SEC)
+
+OrientationUp
+orientation_calc (OrientationUp                prev,
+                  double                       x,
+                  double                       y,
+                  double                       z,
+                  const OrientationThresholds *thresholds)
+{
+        OrientationUp ret = prev;
+        int portrait_rotation;
+        int landscape_rotation;
+
+        portrait_rotation  = round (atan2 (x, sqrt (y * y + z * z)) * RADIANS_TO_DEGREES);
+        landscape_rotation = round (atan2 (y, sqrt (x * x + z * z)) * RADIANS_TO_DEGREES);
+
+        /* Don't change portrait/landscape if the device is flat */
+        if (abs (portrait_rotation) > thresholds->portrait) {
+                ret = (portrait_rotation > 0) ? ORIENTATION_LEFT_UP : ORIENTATION_RIGHT_UP;
+
+                /* Some threshold to switching between portrait modes */
+                if (prev == ORIENTATION_LEFT_UP || prev == ORIENTATION_RIGHT_UP) {
+                        if (abs (portrait_rotation) < thresholds->same_axis)
+                                ret = prev;
+                }
+        } else if (abs (landscape_rotation) > thresholds->landscape) {
+                ret = (landscape_rotation > 0) ? ORIENTATION_BOTTOM_UP : ORIENTATION_NORMAL;
+
+                /* Some threshold to switching between landscape modes */
+                if (prev == ORIENTATION_BOTTOM_UP || prev == ORIENTATION_NORMAL) {
+                        if (abs (landscape_rotation) < thresholds->same_axis)
+                                ret = prev;
+                }
+        }
+
+        return ret;
+}
+
+void
+gravity_filter_init (GravityFilter *filter,
+                     guint          tau_ms)
+{
+        memset (filter, 0, sizeof (*filter));
+        filter->tau = (guint64) tau_ms * 1000;
+}
+
+const float *
+gravity_filter_push (GravityFilter *filter,
+                     const float    sample[4],
+                     guint64        timestamp)
+{
+        GravityVector v;
+        guint64 dt;
+        float alpha;
+
+        memcpy (&v, sample, sizeof (v));
+        dt = timestamp - filter->time;
+        filter->time = timestamp;
+
+        if (filter->tau == 0 || !filter->primed || dt > GRAVITY_FILTER_MAX_GAP) {
+                filter->gravity = v;
+                filter->primed = TRUE;
+                return (const float *) &filter->gravity;
+        }
+
+        alpha = (float) dt / (float) (filter->tau + dt);
+        filter->gravity += alpha * (v - filter->gravity);
+
+        return (const float *) &filter->gravity;
+}
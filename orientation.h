@@ -14,6 +14,10 @@
  *
  */
 
+#pragma once
+
+#include <glib.h>
+
 typedef enum {
         ORIENTATION_UNDEFINED,
         ORIENTATION_NORMAL,
@@ -26,3 +30,41 @@ typedef enum {
 
 const char    *orientation_to_string (OrientationUp o);
 OrientationUp  string_to_orientation (const char *orientation);
+
+/* Tilt, in degrees, needed to enter portrait or landscape, and to flip
+ * to the opposite side of the same axis */
+typedef struct {
+        int portrait;
+        int landscape;
+        int same_axis;
+} OrientationThresholds;
+
+#define ORIENTATION_THRESHOLDS_DEFAULT { 20, 35, 5 }
+
+/* x, y, z in any unit, gravity reading negative along the up axis */
+OrientationUp  orientation_calc (OrientationUp                prev,
+                                 double                       x,
+                                 double                       y,
+                                 double                       z,
+                                 const OrientationThresholds *thresholds);
+
+/* x, y, z and padding. As a GCC vector, operations on it are SIMD ones
+ * whatever the optimisation level. Only float aligned, it lives in
+ * g_new0() allocations */
+typedef float GravityVector __attribute__ ((vector_size (16), aligned (4)));
+
+/* First order low-pass filter extracting gravity from accelerometer
+ * readings, one vector operation per update */
+typedef struct {
+        GravityVector gravity;
+        guint64 tau;        /* time constant, usecs, 0 to not filter */
+        guint64 time;       /* of the last sample, usecs */
+        gboolean primed;
+} GravityFilter;
+
+void           gravity_filter_init (GravityFilter *filter,
+                                    guint          tau_ms);
+/* Returns the filtered gravity vector */
+const float   *gravity_filter_push (GravityFilter *filter,
+                                    const float    sample[4],
+                                    guint64        timestamp);
@@ -0,0 +1,179 @@
+/*
+ * Copyright (c) 2020 Erfan Abdi <erfangplus@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published by
+ * the Free Software Foundation.
+ *
+ */
+
+#include <math.h>
+
+#include <atomic>
+
+#include "rotation-fusion.h"
+
+/* Gaps longer than that are not integrated */
+#define ROTATION_FUSION_MAX_GAP (G_USEC_PER_SEC)
+
+struct _RotationFusion {
+	float    beta;
+	float    q[4];   /* w, x, y, z, only touched by the gyroscope thread */
+	guint64  time;
+	gboolean primed;
+
+	/* Odd while the accelerometer thread writes gravity, 0 until
+	 * it first did */
+	std::atomic<guint> gravity_sequence;
+	std::atomic<float> gravity[3];
+};
+
+RotationFusion *
+rotation_fusion_new (gdouble beta)
+{
+	RotationFusion *fusion;
+
+	fusion = g_new0 (RotationFusion, 1);
+	fusion->gravity_sequence = 0;
+	fusion->beta = beta;
+	fusion->q[0] = 1.0f;
+
+	return fusion;
+}
+
+void
+rotation_fusion_free (RotationFusion *fusion)
+{
+	if (fusion == NULL)
+		return;
+
+	g_free (fusion);
+}
+
+void
+rotation_fusion_set_gravity (RotationFusion *fusion,
+			     const float     gravity[3])
+{
+	guint sequence;
+	int i;
+
+	sequence = fusion->gravity_sequence.load (std::memory_order_relaxed);
+	fusion->gravity_sequence.store (sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence (std::memory_order_release);
+	for (i = 0; i < 3; i++)
+		fusion->gravity[i].store (gravity[i], std::memory_order_relaxed);
+	fusion->gravity_sequence.store (sequence + 2, std::memory_order_release);
+}
+
+/* FALSE if gravity was never set */
+static gboolean
+load_gravity (RotationFusion *fusion,
+	      float           gravity[3])
+{
+	guint before, after;
+	int i;
+
+	do {
+		before = fusion->gravity_sequence.load (std::memory_order_acquire);
+		for (i = 0; i < 3; i++)
+			gravity[i] = fusion->gravity[i].load (std::memory_order_relaxed);
+		std::atomic_thread_fence (std::memory_order_acquire);
+		after = fusion->gravity_sequence.load (std::memory_order_relaxed);
+	} while ((before & 1) || before != after);
+
+	return before != 0;
+}
+
+static void
+normalize (float *v,
+	   int    n)
+{
+	float norm = 0.0f;
+	int i;
+
+	for (i = 0; i < n; i++)
+		norm += v[i] * v[i];
+	if (norm == 0.0f)
+		return;
+
+	norm = 1.0f / sqrtf (norm);
+	for (i = 0; i < n; i++)
+		v[i] *= norm;
+}
+
+/* One Madgwick step, @a being the normalized gravity or NULL */
+static void
+integrate (RotationFusion *fusion,
+	   const float     rate[3],
+	   guint64         timestamp,
+	   const float    *a)
+{
+	float *q = fusion->q;
+	float gx = rate[0], gy = rate[1], gz = rate[2];
+	float q_dot[4];
+	guint64 dt;
+	float dt_s;
+	int i;
+
+	dt = timestamp - fusion->time;
+	fusion->time = timestamp;
+	if (!fusion->primed || dt > ROTATION_FUSION_MAX_GAP) {
+		fusion->primed = TRUE;
+		return;
+	}
+	dt_s = dt / (float) G_USEC_PER_SEC;
+
+	/* Rate of change of the quaternion from the gyroscope */
+	q_dot[0] = 0.5f * (-q[1] * gx - q[2] * gy - q[3] * gz);
+	q_dot[1] = 0.5f * (q[0] * gx + q[2] * gz - q[3] * gy);
+	q_dot[2] = 0.5f * (q[0] * gy - q[1] * gz + q[3] * gx);
+	q_dot[3] = 0.5f * (q[0] * gz + q[1] * gy - q[2] * gx);
+
+	/* Gradient descent step towards the measured gravity */
+	if (a != NULL) {
+		float s[4];
+		float _2q0 = 2.0f * q[0], _2q1 = 2.0f * q[1], _2q2 = 2.0f * q[2], _2q3 = 2.0f * q[3];
+		float _4q0 = 4.0f * q[0], _4q1 = 4.0f * q[1], _4q2 = 4.0f * q[2];
+		float _8q1 = 8.0f * q[1], _8q2 = 8.0f * q[2];
+		float q0q0 = q[0] * q[0], q1q1 = q[1] * q[1], q2q2 = q[2] * q[2], q3q3 = q[3] * q[3];
+
+		s[0] = _4q0 * q2q2 + _2q2 * a[0] + _4q0 * q1q1 - _2q1 * a[1];
+		s[1] = _4q1 * q3q3 - _2q3 * a[0] + 4.0f * q0q0 * q[1] - _2q0 * a[1] - _4q1 +
+		       _8q1 * q1q1 + _8q1 * q2q2 + _4q1 * a[2];
+		s[2] = 4.0f * q0q0 * q[2] + _2q0 * a[0] + _4q2 * q3q3 - _2q3 * a[1] - _4q2 +
+		       _8q2 * q1q1 + _8q2 * q2q2 + _4q2 * a[2];
+		s[3] = 4.0f * q1q1 * q[3] - _2q1 * a[0] + 4.0f * q2q2 * q[3] - _2q2 * a[1];
+		normalize (s, 4);
+
+		for (i = 0; i < 4; i++)
+			q_dot[i] -= fusion->beta * s[i];
+	}
+
+	for (i = 0; i < 4; i++)
+		q[i] += q_dot[i] * dt_s;
+	normalize (q, 4);
+}
+
+void
+rotation_fusion_update (RotationFusion *fusion,
+			const float     rates[][3],
+			const guint64  *timestamps,
+			guint           n,
+			gdouble         quaternion[4])
+{
+	float a[3];
+	gboolean has_gravity;
+	guint i;
+
+	/* Gravity moves far slower than a frame lasts */
+	has_gravity = load_gravity (fusion, a) &&
+		      (a[0] != 0.0f || a[1] != 0.0f || a[2] != 0.0f);
+	if (has_gravity)
+		normalize (a, 3);
+
+	for (i = 0; i < n; i++)
+		integrate (fusion, rates[i], timestamps[i], has_gravity ? a : NULL);
+
+	for (i = 0; i < 4; i++)
+		quaternion[i] = fusion->q[i];
+}
@@ -0,0 +1,42 @@
+/*
+ * Copyright (c) 2020 Erfan Abdi <erfangplus@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published by
+ * the Free Software Foundation.
+ *
+ */
+
+#pragma once
+
+#include <glib.h>
+
+/*
+ * Madgwick's IMU filter: integrates the gyroscope rates into an attitude
+ * quaternion and pulls it towards the gravity measured by the
+ * accelerometer, at a rate set by beta. Without gravity samples it
+ * integrates the gyroscope alone, and drifts.
+ *
+ * The accelerometer and gyroscope backends run on threads of their own,
+ * so gravity can be set from one thread while another one updates.
+ * Neither ever waits for the other.
+ */
+
+typedef struct _RotationFusion RotationFusion;
+
+RotationFusion *rotation_fusion_new         (gdouble         beta);
+void            rotation_fusion_free        (RotationFusion *fusion);
+
+/* Device frame, in any unit, pointing up */
+void            rotation_fusion_set_gravity (RotationFusion *fusion,
+					     const float     gravity[3]);
+
+/* Integrates a frame of @n samples, @rates in rad/s and @timestamps in
+ * monotonic usecs, against the gravity as it is when called. The
+ * attitude after the last sample is returned in @quaternion as w, x,
+ * y, z */
+void            rotation_fusion_update      (RotationFusion *fusion,
+					     const float     rates[][3],
+					     const guint64  *timestamps,
+					     guint           n,
+					     gdouble         quaternion[4]);
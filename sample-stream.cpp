@@ -0,0 +1,325 @@
+/*
+ * Copyright (c) 2020 Erfan Abdi <erfangplus@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published by
+ * the Free Software Foundation.
+ *
+ */
+
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+
+#include <atomic>
+
+#include "sample-stream.h"
+
+#ifndef F_SEAL_FUTURE_WRITE
+#define F_SEAL_FUTURE_WRITE 0x0010
+#endif
+
+struct _SampleStream {
+	gint              ref_count;
+	int               ring_fd;
+	int               event_fd;
+	gsize             size;
+	SampleRingHeader *ring;
+	guint             n_values;
+	guint             interval_ms;
+	gint64            next_time; /* of the next sample to keep, usecs */
+	/* Ours, the copies in the ring are only for the clients */
+	guint             capacity;
+	guint64           head;
+	/* The ring is only handed out when clients can't write to it */
+	gboolean          sealed;
+};
+
+/* Never changed once published, and holding a reference on each stream */
+typedef struct {
+	guint         n_streams;
+	SampleStream *streams[];
+} SampleStreamList;
+
+struct _SampleStreamSet {
+	/* Main loop side */
+	GHashTable *streams; /* key = client, value = SampleStream */
+	/* Handed over to the pushing thread, which owns current */
+	std::atomic<SampleStreamList *> pending;
+	SampleStreamList *current;
+};
+
+SampleStream *
+sample_stream_new (guint capacity,
+		   guint n_values,
+		   guint interval_ms)
+{
+	SampleStream *stream;
+	void *ring;
+
+	g_return_val_if_fail (capacity > 0, NULL);
+	g_return_val_if_fail (n_values > 0 && n_values <= SAMPLE_STREAM_MAX_VALUES, NULL);
+
+	stream = g_new0 (SampleStream, 1);
+	stream->ref_count = 1;
+	stream->event_fd = -1;
+	stream->n_values = n_values;
+	stream->interval_ms = interval_ms;
+	stream->capacity = capacity;
+	stream->size = sizeof (SampleRingHeader) + (gsize) capacity * sizeof (SampleRecord);
+
+	stream->ring_fd = memfd_create ("hadess-sensorfw-stream", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (stream->ring_fd < 0)
+		goto fail;
+
+	if (ftruncate (stream->ring_fd, stream->size) < 0)
+		goto fail;
+
+	ring = mmap (NULL, stream->size, PROT_READ | PROT_WRITE, MAP_SHARED, stream->ring_fd, 0);
+	if (ring == MAP_FAILED)
+		goto fail;
+	stream->ring = (SampleRingHeader *) ring;
+
+	/* Same as the state snapshot, only our mapping may write. memfds
+	 * can be reopened read-write through /proc whatever mode the fd was
+	 * passed with, so without F_SEAL_FUTURE_WRITE (Linux 5.1) nothing
+	 * keeps clients out and the ring is never handed out */
+	stream->sealed = fcntl (stream->ring_fd, F_ADD_SEALS,
+				F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_FUTURE_WRITE | F_SEAL_SEAL) == 0;
+	if (!stream->sealed)
+		g_warning ("Could not seal sample stream, it won't be shared: %s", g_strerror (errno));
+
+	stream->event_fd = eventfd (0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (stream->event_fd < 0)
+		goto fail;
+
+	stream->ring->magic = SAMPLE_STREAM_MAGIC;
+	stream->ring->version = SAMPLE_STREAM_VERSION;
+	stream->ring->capacity = capacity;
+	stream->ring->record_size = sizeof (SampleRecord);
+	stream->ring->n_values = n_values;
+
+	return stream;
+
+fail:
+	g_warning ("Could not set up sample stream: %s", g_strerror (errno));
+	sample_stream_free (stream);
+	return NULL;
+}
+
+static SampleStream *
+sample_stream_ref (SampleStream *stream)
+{
+	g_atomic_int_inc (&stream->ref_count);
+	return stream;
+}
+
+void
+sample_stream_free (SampleStream *stream)
+{
+	if (stream == NULL)
+		return;
+	if (!g_atomic_int_dec_and_test (&stream->ref_count))
+		return;
+
+	if (stream->ring != NULL)
+		munmap (stream->ring, stream->size);
+	if (stream->ring_fd >= 0)
+		close (stream->ring_fd);
+	if (stream->event_fd >= 0)
+		close (stream->event_fd);
+	g_free (stream);
+}
+
+guint
+sample_stream_get_interval (SampleStream *stream)
+{
+	return stream->interval_ms;
+}
+
+int
+sample_stream_dup_ring_fd (SampleStream *stream)
+{
+	char path[64];
+
+	if (!stream->sealed) {
+		errno = EPERM;
+		return -1;
+	}
+
+	g_snprintf (path, sizeof (path), "/proc/self/fd/%d", stream->ring_fd);
+	return open (path, O_RDONLY | O_CLOEXEC);
+}
+
+int
+sample_stream_dup_event_fd (SampleStream *stream)
+{
+	return fcntl (stream->event_fd, F_DUPFD_CLOEXEC, 0);
+}
+
+void
+sample_stream_push (SampleStream  *stream,
+		    gint64         time,
+		    const gdouble *values)
+{
+	SampleRingHeader *ring = stream->ring;
+	SampleRecord *record;
+	gint64 interval;
+	guint64 head;
+
+	/* The sensor runs at the fastest rate asked for, slower clients
+	 * only get every so many samples */
+	interval = (gint64) stream->interval_ms * 1000;
+	if (interval > 0) {
+		if (time < stream->next_time)
+			return;
+		stream->next_time += interval;
+		if (stream->next_time <= time)
+			stream->next_time = time + interval;
+	}
+
+	/* Never trust what's in the ring, it is the clients' copy */
+	head = stream->head++;
+	record = &ring->records[head % stream->capacity];
+
+	__atomic_store_n (&record->sequence, 2 * head + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence (__ATOMIC_RELEASE);
+
+	record->time = time;
+	memcpy (record->values, values, stream->n_values * sizeof (gdouble));
+
+	__atomic_store_n (&record->sequence, 2 * head + 2, __ATOMIC_RELEASE);
+	__atomic_store_n (&ring->head, head + 1, __ATOMIC_RELEASE);
+
+	/* Only fails once the counter would overflow, the
+	 * reader has been woken up plenty by then */
+	eventfd_write (stream->event_fd, 1);
+}
+
+static void
+stream_list_free (SampleStreamList *list)
+{
+	guint i;
+
+	if (list == NULL)
+		return;
+
+	for (i = 0; i < list->n_streams; i++)
+		sample_stream_free (list->streams[i]);
+	g_free (list);
+}
+
+/* Hands the streams as they are now over to the pushing thread. A list
+ * it did not pick up yet was never seen, and is simply replaced */
+static void
+publish_streams (SampleStreamSet *set)
+{
+	SampleStreamList *list;
+	GHashTableIter iter;
+	gpointer value;
+	guint i = 0;
+
+	list = (SampleStreamList *) g_malloc (sizeof (SampleStreamList) +
+					      g_hash_table_size (set->streams) * sizeof (SampleStream *));
+	g_hash_table_iter_init (&iter, set->streams);
+	while (g_hash_table_iter_next (&iter, NULL, &value))
+		list->streams[i++] = sample_stream_ref ((SampleStream *) value);
+	list->n_streams = i;
+
+	stream_list_free (set->pending.exchange (list, std::memory_order_acq_rel));
+}
+
+SampleStreamSet *
+sample_stream_set_new (void)
+{
+	SampleStreamSet *set;
+
+	set = g_new0 (SampleStreamSet, 1);
+	set->streams = g_hash_table_new_full (g_str_hash, g_str_equal,
+					      g_free, (GDestroyNotify) sample_stream_free);
+	set->pending = nullptr;
+
+	return set;
+}
+
+void
+sample_stream_set_free (SampleStreamSet *set)
+{
+	if (set == NULL)
+		return;
+
+	stream_list_free (set->pending.load (std::memory_order_acquire));
+	stream_list_free (set->current);
+	g_hash_table_unref (set->streams);
+	g_free (set);
+}
+
+void
+sample_stream_set_add (SampleStreamSet *set,
+		       const char      *client,
+		       SampleStream    *stream)
+{
+	g_hash_table_insert (set->streams, g_strdup (client), stream);
+	publish_streams (set);
+}
+
+gboolean
+sample_stream_set_remove (SampleStreamSet *set,
+			  const char      *client)
+{
+	if (!g_hash_table_remove (set->streams, client))
+		return FALSE;
+
+	publish_streams (set);
+	return TRUE;
+}
+
+guint
+sample_stream_set_size (SampleStreamSet *set)
+{
+	return g_hash_table_size (set->streams);
+}
+
+guint
+sample_stream_set_min_interval (SampleStreamSet *set)
+{
+	GHashTableIter iter;
+	gpointer value;
+	guint ret = 0;
+
+	g_hash_table_iter_init (&iter, set->streams);
+	while (g_hash_table_iter_next (&iter, NULL, &value)) {
+		guint interval = sample_stream_get_interval ((SampleStream *) value);
+
+		if (interval > 0 && (ret == 0 || interval < ret))
+			ret = interval;
+	}
+
+	return ret;
+}
+
+void
+sample_stream_set_push (SampleStreamSet *set,
+			gint64           time,
+			const gdouble   *values)
+{
+	SampleStreamList *list;
+	guint i;
+
+	/* A closed stream is let go of here, on the next sample */
+	if (set->pending.load (std::memory_order_relaxed) != NULL) {
+		list = set->pending.exchange (nullptr, std::memory_order_acquire);
+		stream_list_free (set->current);
+		set->current = list;
+	}
+
+	list = set->current;
+	if (list == NULL)
+		return;
+
+	for (i = 0; i < list->n_streams; i++)
+		sample_stream_push (list->streams[i], time, values);
+}
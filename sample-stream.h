@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2020 Erfan Abdi <erfangplus@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published by
+ * the Free Software Foundation.
+ *
+ */
+
+#pragma once
+
+#include <glib.h>
+
+/*
+ * Full-rate sample streams, kept off the bus. Every stream is a ring of
+ * timestamped records in a memfd that clients map read-only, plus an
+ * eventfd that is signalled after new records were written.
+ *
+ * There is a single writer per ring, which never waits for readers: slot
+ * i holds record n when its sequence is 2 * n + 2, and is odd while being
+ * written. A reader expecting record n loads the sequence, copies the
+ * record and loads the sequence again. If it went past 2 * n + 2 the
+ * reader was overrun and should restart from head - capacity.
+ */
+
+#define SAMPLE_STREAM_MAGIC      0x53585352 /* "RSXS" */
+#define SAMPLE_STREAM_VERSION    1
+#define SAMPLE_STREAM_MAX_VALUES 4
+
+/* Shared with clients */
+typedef struct {
+	guint64 sequence;
+	gint64  time; /* monotonic usecs */
+	gdouble values[SAMPLE_STREAM_MAX_VALUES];
+} SampleRecord;
+
+typedef struct {
+	guint32      magic;
+	guint32      version;
+	guint32      capacity;    /* in records */
+	guint32      record_size;
+	guint64      head;        /* number of records written so far */
+	guint32      n_values;    /* used in each record */
+	guint32      padding;
+	SampleRecord records[];
+} SampleRingHeader;
+
+typedef struct _SampleStream SampleStream;
+
+/* Samples closer than @interval_ms to the last one kept are skipped,
+ * 0 keeps them all */
+SampleStream *sample_stream_new          (guint          capacity,
+					  guint          n_values,
+					  guint          interval_ms);
+/* Drops a reference, the stream goes once the sample path let go too */
+void          sample_stream_free         (SampleStream  *stream);
+
+guint         sample_stream_get_interval (SampleStream  *stream);
+
+/* New descriptors for the client. The ring one is read-only, and
+ * refused (-1) when the kernel can't seal it against writes */
+int           sample_stream_dup_ring_fd  (SampleStream  *stream);
+int           sample_stream_dup_event_fd (SampleStream  *stream);
+
+void          sample_stream_push         (SampleStream  *stream,
+					  gint64         time,
+					  const gdouble *values);
+
+/*
+ * The streams of one sensor, by client. Streams come and go from the
+ * main loop, which hands the pushing thread, a single one per set, an
+ * immutable list of them; pushing takes no lock.
+ */
+typedef struct _SampleStreamSet SampleStreamSet;
+
+SampleStreamSet *sample_stream_set_new          (void);
+void             sample_stream_set_free         (SampleStreamSet *set);
+
+/* Takes ownership of @stream, replacing any previous one of @client */
+void             sample_stream_set_add          (SampleStreamSet *set,
+						 const char      *client,
+						 SampleStream    *stream);
+gboolean         sample_stream_set_remove       (SampleStreamSet *set,
+						 const char      *client);
+guint            sample_stream_set_size         (SampleStreamSet *set);
+
+/* The shortest interval asked for, 0 if none was */
+guint            sample_stream_set_min_interval (SampleStreamSet *set);
+
+void             sample_stream_set_push         (SampleStreamSet *set,
+						 gint64           time,
+						 const gdouble   *values);
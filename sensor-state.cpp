@@ -0,0 +1,308 @@
+/*
+ * Copyright (c) 2020 Erfan Abdi <erfangplus@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published by
+ * the Free Software Foundation.
+ *
+ */
+
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#include "sensor-state.h"
+
+#ifndef F_SEAL_FUTURE_WRITE
+#define F_SEAL_FUTURE_WRITE 0x0010
+#endif
+
+/* Sealed so that the page can be handed out: nobody can resize it, and
+ * only our own mapping stays writable. A memfd can be reopened read-write
+ * through /proc whatever mode its fd was passed with, so without
+ * F_SEAL_FUTURE_WRITE (Linux 5.1) the page is kept to ourselves */
+static SensorStatePage *
+map_shared_page (int *fd_out)
+{
+	void *page;
+	int fd;
+
+	*fd_out = -1;
+
+	fd = memfd_create ("hadess-sensorfw-state", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (fd < 0) {
+		g_warning ("Could not create shared sensor state: %s", g_strerror (errno));
+		goto anonymous;
+	}
+
+	if (ftruncate (fd, sizeof (SensorStatePage)) < 0)
+		goto fail;
+
+	page = mmap (NULL, sizeof (SensorStatePage), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (page == MAP_FAILED)
+		goto fail;
+
+	if (fcntl (fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_FUTURE_WRITE | F_SEAL_SEAL) < 0) {
+		munmap (page, sizeof (SensorStatePage));
+		goto fail;
+	}
+
+	*fd_out = fd;
+	return (SensorStatePage *) page;
+
+fail:
+	g_warning ("Could not set up shared sensor state: %s", g_strerror (errno));
+	close (fd);
+anonymous:
+	page = mmap (NULL, sizeof (SensorStatePage), PROT_READ | PROT_WRITE,
+		     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	g_assert (page != MAP_FAILED);
+	return (SensorStatePage *) page;
+}
+
+SensorState *
+sensor_state_new (void)
+{
+	SensorState *state;
+
+	state = new SensorState ();
+	state->cells.orientation = ORIENTATION_UNDEFINED;
+	state->cells.level = 0.0;
+	state->cells.heading = 0.0;
+	state->cells.prox_near = FALSE;
+	state->cells.orientation_time = 0;
+	state->cells.level_time = 0;
+	state->cells.heading_time = 0;
+	state->cells.prox_time = 0;
+	state->cells.rotation_sequence = 0;
+	state->cells.rotation[0] = 1.0;
+	state->cells.rotation[1] = 0.0;
+	state->cells.rotation[2] = 0.0;
+	state->cells.rotation[3] = 0.0;
+	state->cells.rotation_time = 0;
+	state->cells.pressure = 0.0;
+	state->cells.altitude = 0.0;
+	state->cells.pressure_time = 0;
+	state->cells.temperature = 0.0;
+	state->cells.temperature_time = 0;
+	state->cells.humidity = 0.0;
+	state->cells.humidity_time = 0;
+	state->cells.step_count = 0;
+	state->cells.step_time = 0;
+	state->cells.prox_value = 0;
+	state->cells.prox_value_time = 0;
+
+	state->sequence = 0;
+	memset (&state->snapshot, 0, sizeof (SensorSnapshot));
+	state->snapshot.orientation = ORIENTATION_UNDEFINED;
+	state->snapshot.uses_lux = TRUE;
+	state->snapshot.rotation[0] = 1.0;
+
+	state->page = map_shared_page (&state->fd);
+	memset (state->page, 0, sizeof (SensorStatePage));
+	state->page->magic = SENSOR_STATE_MAGIC;
+	state->page->version = SENSOR_STATE_VERSION;
+	state->page->size = sizeof (SensorSnapshot);
+	state->page->snapshot = state->snapshot;
+
+	return state;
+}
+
+void
+sensor_state_free (SensorState *state)
+{
+	munmap (state->page, sizeof (SensorStatePage));
+	if (state->fd >= 0)
+		close (state->fd);
+	delete state;
+}
+
+template<typename T, typename V>
+static gboolean
+set_cell (std::atomic<T>      &cell,
+	  std::atomic<gint64> &timestamp,
+	  V                    value)
+{
+	if (cell.exchange (value, std::memory_order_relaxed) == (T) value)
+		return FALSE;
+
+	timestamp.store (g_get_monotonic_time (), std::memory_order_relaxed);
+	return TRUE;
+}
+
+gboolean
+sensor_state_set_orientation (SensorState   *state,
+			      OrientationUp  orientation)
+{
+	return set_cell (state->cells.orientation, state->cells.orientation_time, (gint) orientation);
+}
+
+gboolean
+sensor_state_set_level (SensorState *state,
+			gdouble      level)
+{
+	return set_cell (state->cells.level, state->cells.level_time, level);
+}
+
+gboolean
+sensor_state_set_heading (SensorState *state,
+			  gdouble      heading)
+{
+	return set_cell (state->cells.heading, state->cells.heading_time, heading);
+}
+
+gboolean
+sensor_state_set_prox_near (SensorState *state,
+			    gboolean     near)
+{
+	return set_cell (state->cells.prox_near, state->cells.prox_time, near ? TRUE : FALSE);
+}
+
+gboolean
+sensor_state_set_prox_value (SensorState *state,
+			     guint32      value)
+{
+	return set_cell (state->cells.prox_value, state->cells.prox_value_time, value);
+}
+
+/* The altitude is derived from the pressure, it only changes with it */
+gboolean
+sensor_state_set_pressure (SensorState *state,
+			   gdouble      pressure,
+			   gdouble      altitude)
+{
+	state->cells.altitude.store (altitude, std::memory_order_relaxed);
+	return set_cell (state->cells.pressure, state->cells.pressure_time, pressure);
+}
+
+gboolean
+sensor_state_set_temperature (SensorState *state,
+			      gdouble      temperature)
+{
+	return set_cell (state->cells.temperature, state->cells.temperature_time, temperature);
+}
+
+gboolean
+sensor_state_set_humidity (SensorState *state,
+			   gdouble      humidity)
+{
+	return set_cell (state->cells.humidity, state->cells.humidity_time, humidity);
+}
+
+gboolean
+sensor_state_set_step_count (SensorState *state,
+			     guint32      step_count)
+{
+	return set_cell (state->cells.step_count, state->cells.step_time, step_count);
+}
+
+/* Only ever called from the gyroscope thread */
+gboolean
+sensor_state_set_rotation (SensorState   *state,
+			   const gdouble  rotation[4])
+{
+	SensorCells *cells = &state->cells;
+	guint sequence;
+	gboolean changed = FALSE;
+	int i;
+
+	for (i = 0; i < 4; i++)
+		changed |= cells->rotation[i].load (std::memory_order_relaxed) != rotation[i];
+	if (!changed)
+		return FALSE;
+
+	sequence = cells->rotation_sequence.load (std::memory_order_relaxed);
+	cells->rotation_sequence.store (sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence (std::memory_order_release);
+	for (i = 0; i < 4; i++)
+		cells->rotation[i].store (rotation[i], std::memory_order_relaxed);
+	cells->rotation_time.store (g_get_monotonic_time (), std::memory_order_relaxed);
+	cells->rotation_sequence.store (sequence + 2, std::memory_order_release);
+
+	return TRUE;
+}
+
+static void
+load_rotation (SensorCells    *cells,
+	       SensorSnapshot *snapshot)
+{
+	guint before, after;
+	int i;
+
+	do {
+		before = cells->rotation_sequence.load (std::memory_order_acquire);
+		for (i = 0; i < 4; i++)
+			snapshot->rotation[i] = cells->rotation[i].load (std::memory_order_relaxed);
+		snapshot->rotation_time = cells->rotation_time.load (std::memory_order_relaxed);
+		std::atomic_thread_fence (std::memory_order_acquire);
+		after = cells->rotation_sequence.load (std::memory_order_relaxed);
+	} while ((before & 1) || before != after);
+}
+
+void
+sensor_state_publish (SensorState *state)
+{
+	SensorCells *cells = &state->cells;
+	SensorSnapshot *snapshot = &state->snapshot;
+	guint32 sequence = state->sequence.load (std::memory_order_relaxed);
+
+	state->sequence.store (sequence + 1, std::memory_order_relaxed);
+	__atomic_store_n (&state->page->sequence, sequence + 1, __ATOMIC_RELAXED);
+	std::atomic_thread_fence (std::memory_order_release);
+
+	snapshot->orientation = cells->orientation.load (std::memory_order_relaxed);
+	snapshot->level = cells->level.load (std::memory_order_relaxed);
+	snapshot->heading = cells->heading.load (std::memory_order_relaxed);
+	snapshot->prox_near = cells->prox_near.load (std::memory_order_relaxed);
+	snapshot->orientation_time = cells->orientation_time.load (std::memory_order_relaxed);
+	snapshot->level_time = cells->level_time.load (std::memory_order_relaxed);
+	snapshot->heading_time = cells->heading_time.load (std::memory_order_relaxed);
+	snapshot->prox_time = cells->prox_time.load (std::memory_order_relaxed);
+	load_rotation (cells, snapshot);
+	snapshot->pressure = cells->pressure.load (std::memory_order_relaxed);
+	snapshot->altitude = cells->altitude.load (std::memory_order_relaxed);
+	snapshot->pressure_time = cells->pressure_time.load (std::memory_order_relaxed);
+	snapshot->temperature = cells->temperature.load (std::memory_order_relaxed);
+	snapshot->temperature_time = cells->temperature_time.load (std::memory_order_relaxed);
+	snapshot->humidity = cells->humidity.load (std::memory_order_relaxed);
+	snapshot->humidity_time = cells->humidity_time.load (std::memory_order_relaxed);
+	snapshot->step_count = cells->step_count.load (std::memory_order_relaxed);
+	snapshot->step_time = cells->step_time.load (std::memory_order_relaxed);
+	snapshot->prox_value = cells->prox_value.load (std::memory_order_relaxed);
+	snapshot->prox_value_time = cells->prox_value_time.load (std::memory_order_relaxed);
+	state->page->snapshot = *snapshot;
+
+	state->sequence.store (sequence + 2, std::memory_order_release);
+	__atomic_store_n (&state->page->sequence, sequence + 2, __ATOMIC_RELEASE);
+}
+
+void
+sensor_state_read (SensorState    *state,
+		   SensorSnapshot *snapshot)
+{
+	guint32 before, after;
+
+	do {
+		before = state->sequence.load (std::memory_order_acquire);
+		memcpy (snapshot, &state->snapshot, sizeof (*snapshot));
+		std::atomic_thread_fence (std::memory_order_acquire);
+		after = state->sequence.load (std::memory_order_relaxed);
+	} while ((before & 1) || before != after);
+}
+
+/* Reopening through /proc gives a read-only descriptor, unlike a dup()
+ * of ours. That alone doesn't stop a client from reopening it read-write,
+ * the write seal does */
+int
+sensor_state_dup_fd (SensorState *state)
+{
+	char path[64];
+
+	if (state->fd < 0)
+		return -1;
+
+	g_snprintf (path, sizeof (path), "/proc/self/fd/%d", state->fd);
+	return open (path, O_RDONLY | O_CLOEXEC);
+}
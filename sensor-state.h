@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2020 Erfan Abdi <erfangplus@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published by
+ * the Free Software Foundation.
+ *
+ */
+
+#pragma once
+
+#include <atomic>
+
+#include <glib.h>
+
+#include "orientation.h"
+
+/*
+ * Sensor threads store their latest reading in a lock-free cell. The main
+ * loop is the only publisher: it copies the cells into the snapshot under
+ * a seqlock before emitting, and property reads take a consistent copy of
+ * the snapshot without ever blocking the sample path.
+ *
+ * The snapshot and its sequence are private, a copy of both is written to
+ * a sealed memfd so that clients can map it read-only and follow the same
+ * protocol as sensor_state_read(): load the sequence, copy the snapshot,
+ * load the sequence again and retry if it was odd or has changed. Nothing
+ * the proxy does depends on what is in that page.
+ */
+
+/* Values as seen by D-Bus clients, timestamps are monotonic usecs */
+typedef struct {
+	gint32   orientation; /* OrientationUp */
+	gboolean uses_lux;
+	gdouble  level;
+	gdouble  heading;
+	gboolean prox_near;
+	gint64   orientation_time;
+	gint64   level_time;
+	gint64   heading_time;
+	gint64   prox_time;
+	gdouble  rotation[4]; /* w, x, y, z */
+	gint64   rotation_time;
+	gdouble  pressure;    /* hPa */
+	gdouble  altitude;    /* metres above the reference */
+	gint64   pressure_time;
+	gdouble  temperature; /* degrees Celsius */
+	gint64   temperature_time;
+	gdouble  humidity;    /* percent */
+	gint64   humidity_time;
+	guint32  step_count;
+	gint64   step_time;
+	guint32  prox_value;  /* raw, device specific */
+	gint64   prox_value_time;
+} SensorSnapshot;
+
+typedef struct {
+	std::atomic<gint>     orientation;
+	std::atomic<gdouble>  level;
+	std::atomic<gdouble>  heading;
+	std::atomic<gboolean> prox_near;
+	std::atomic<gint64>   orientation_time;
+	std::atomic<gint64>   level_time;
+	std::atomic<gint64>   heading_time;
+	std::atomic<gint64>   prox_time;
+	/* Four values written together, odd sequence while being written */
+	std::atomic<guint>    rotation_sequence;
+	std::atomic<gdouble>  rotation[4];
+	std::atomic<gint64>   rotation_time;
+	std::atomic<gdouble>  pressure;
+	std::atomic<gdouble>  altitude;
+	std::atomic<gint64>   pressure_time;
+	std::atomic<gdouble>  temperature;
+	std::atomic<gint64>   temperature_time;
+	std::atomic<gdouble>  humidity;
+	std::atomic<gint64>   humidity_time;
+	std::atomic<guint32>  step_count;
+	std::atomic<gint64>   step_time;
+	std::atomic<guint32>  prox_value;
+	std::atomic<gint64>   prox_value_time;
+} SensorCells;
+
+#define SENSOR_STATE_MAGIC   0x53585053 /* "SPXS" */
+#define SENSOR_STATE_VERSION 1
+
+/* Shared with clients, new fields only ever get appended to the snapshot */
+typedef struct {
+	guint32        magic;
+	guint32        version;
+	guint32        sequence; /* odd while the snapshot is being written */
+	guint32        size;     /* of the snapshot */
+	SensorSnapshot snapshot;
+} SensorStatePage;
+
+typedef struct {
+	SensorCells         cells;
+	std::atomic<guint32> sequence;
+	SensorSnapshot      snapshot;
+	int                 fd; /* -1 if the page can't be shared */
+	SensorStatePage    *page;
+} SensorState;
+
+SensorState *sensor_state_new              (void);
+void         sensor_state_free             (SensorState    *state);
+
+/* Called from the sensor threads, return whether the value changed */
+gboolean     sensor_state_set_orientation  (SensorState    *state,
+					    OrientationUp   orientation);
+gboolean     sensor_state_set_level        (SensorState    *state,
+					    gdouble         level);
+gboolean     sensor_state_set_heading      (SensorState    *state,
+					    gdouble         heading);
+gboolean     sensor_state_set_prox_near    (SensorState    *state,
+					    gboolean        near);
+gboolean     sensor_state_set_rotation     (SensorState    *state,
+					    const gdouble   rotation[4]);
+gboolean     sensor_state_set_pressure     (SensorState    *state,
+					    gdouble         pressure,
+					    gdouble         altitude);
+gboolean     sensor_state_set_temperature  (SensorState    *state,
+					    gdouble         temperature);
+gboolean     sensor_state_set_humidity     (SensorState    *state,
+					    gdouble         humidity);
+gboolean     sensor_state_set_step_count   (SensorState    *state,
+					    guint32         step_count);
+gboolean     sensor_state_set_prox_value   (SensorState    *state,
+					    guint32         value);
+
+/* Publisher (main loop) only */
+void         sensor_state_publish          (SensorState    *state);
+
+void         sensor_state_read             (SensorState    *state,
+					    SensorSnapshot *snapshot);
+
+/* A new read-only descriptor for the shared page, or -1 if the kernel
+ * can't seal it against writes */
+int          sensor_state_dup_fd           (SensorState    *state);
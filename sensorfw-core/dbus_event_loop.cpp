@@ -135,6 +135,20 @@ repowerd::HandlerRegistration repowerd::DBusEventLoop::register_signal_handler(
     char const* dbus_member,
     char const* dbus_path,
     DBusEventLoopSignalHandler const& handler)
+{
+    return register_signal_handler(
+        dbus_connection, dbus_sender, dbus_interface, dbus_member,
+        dbus_path, nullptr, handler);
+}
+
+repowerd::HandlerRegistration repowerd::DBusEventLoop::register_signal_handler(
+    GDBusConnection* dbus_connection,
+    char const* dbus_sender,
+    char const* dbus_interface,
+    char const* dbus_member,
+    char const* dbus_path,
+    char const* dbus_arg0,
+    DBusEventLoopSignalHandler const& handler)
 {
     struct SignalContext
     {
@@ -165,7 +179,7 @@ repowerd::HandlerRegistration repowerd::DBusEventLoop::register_signal_handler(
                 dbus_interface,
                 dbus_member,
                 dbus_path,
-                nullptr,
+                dbus_arg0,
                 G_DBUS_SIGNAL_FLAGS_NONE,
                 reinterpret_cast<GDBusSignalCallback>(&SignalContext::static_call),
                 new SignalContext{handler},
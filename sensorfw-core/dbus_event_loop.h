@@ -65,6 +65,15 @@ public:
         char const* dbus_member,
         char const* dbus_path,
         DBusEventLoopSignalHandler const& handler);
+
+    repowerd::HandlerRegistration register_signal_handler(
+        GDBusConnection* dbus_connection,
+        char const* dbus_sender,
+        char const* dbus_interface,
+        char const* dbus_member,
+        char const* dbus_path,
+        char const* dbus_arg0,
+        DBusEventLoopSignalHandler const& handler);
 };
 
 }
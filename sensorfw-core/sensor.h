@@ -25,25 +25,35 @@
 namespace repowerd
 {
 
-enum class ProximityState{near, far};
-using ProximityHandler = std::function<void(ProximityState)>;
+// Proxy-side state that decides how a sensor session should be run
+struct SensorPolicy
+{
+    bool claimed = false;    // at least one client wants readings
+    int interval = 0;        // requested sample interval in ms, 0 for the default
+    bool lowest_rate = false; // with no interval, the slowest rate sensord offers
+    bool display_on = true;
+    bool suspended = false;
+};
 
-class ProximitySensor
+template<typename Value>
+class Sensor
 {
 public:
-    virtual ~ProximitySensor() = default;
+    using Handler = std::function<void(Value)>;
+
+    virtual ~Sensor() = default;
+
+    virtual HandlerRegistration register_handler(Handler const& handler) = 0;
 
-    virtual HandlerRegistration register_proximity_handler(
-        ProximityHandler const& handler) = 0;
-    virtual ProximityState proximity_state() = 0;
+    virtual void enable_events() = 0;
+    virtual void disable_events() = 0;
 
-    virtual void enable_proximity_events() = 0;
-    virtual void disable_proximity_events() = 0;
+    virtual void set_policy(SensorPolicy const& policy) = 0;
 
 protected:
-    ProximitySensor() = default;
-    ProximitySensor (ProximitySensor const&) = default;
-    ProximitySensor& operator=(ProximitySensor const&) = default;
+    Sensor() = default;
+    Sensor (Sensor const&) = default;
+    Sensor& operator=(Sensor const&) = default;
 };
 
 }
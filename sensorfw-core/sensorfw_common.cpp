@@ -20,26 +20,32 @@
 
 #include <QObject>
 
+#include <algorithm>
+
 #include "socketreader.h"
 
 namespace
 {
 char const* const log_tag = "Sensorfw";
 
-auto const null_handler = [](double){};
 char const* const dbus_sensorfw_name = "com.nokia.SensorService";
 char const* const dbus_sensorfw_path = "/SensorManager";
 char const* const dbus_sensorfw_interface = "local.SensorManager";
+
+// SocketReader drops anything larger than this in one go
+unsigned int const max_buffer_size = 1000;
+
+// Sample interval for throttled sessions while the display is off
+int const idle_interval = 1000;
 }
 
 repowerd::Sensorfw::Sensorfw(
     std::shared_ptr<Log> const& log,
     std::string const& dbus_bus_address,
-    std::string const& name,
-    PluginType const& plugin)
+    SensorfwPlugin const& plugin)
     : log{log},
       dbus_connection{dbus_bus_address},
-      dbus_event_loop{name},
+      dbus_event_loop{plugin.name},
       m_socket(std::make_shared<SocketReader>()),
       m_plugin(plugin),
       m_pid(getpid())
@@ -54,10 +60,34 @@ repowerd::Sensorfw::Sensorfw(
     log->log(log_tag, "Got plugin_path %s", plugin_path());
 
     m_socket->initiateConnection(m_sessionid);
+
+    dbus_signal_handler_registration = dbus_event_loop.register_signal_handler(
+        dbus_connection,
+        "org.freedesktop.DBus",
+        "org.freedesktop.DBus",
+        "NameOwnerChanged",
+        "/org/freedesktop/DBus",
+        dbus_sensorfw_name,
+        [this] (
+            GDBusConnection* /*connection*/,
+            char const* /*sender*/,
+            char const* /*object_path*/,
+            char const* /*interface_name*/,
+            char const* /*signal_name*/,
+            GVariant* parameters)
+        {
+            char const* name;
+            char const* old_owner;
+            char const* new_owner;
+            g_variant_get(parameters, "(&s&s&s)", &name, &old_owner, &new_owner);
+            handle_sensorfw_owner_changed(new_owner);
+        });
 }
 
 repowerd::Sensorfw::~Sensorfw()
 {
+    dbus_signal_handler_registration = HandlerRegistration{};
+
     stop();
     release_sensor();
     m_socket->dropConnection();
@@ -65,35 +95,17 @@ repowerd::Sensorfw::~Sensorfw()
 
 const char* repowerd::Sensorfw::plugin_string() const
 {
-    switch (m_plugin) {
-        case PluginType::LIGHT: return "alssensor";
-        case PluginType::PROXIMITY: return "proximitysensor";
-        case PluginType::ORIENTATION: return "orientationsensor";
-        case PluginType::COMPASS: return "compasssensor";
-    }
-
-    return "";
+    return m_plugin.name;
 }
 
 const char* repowerd::Sensorfw::plugin_interface() const
 {
-    switch (m_plugin) {
-        case PluginType::LIGHT: return "local.ALSSensor";
-        case PluginType::PROXIMITY: return "local.ProximitySensor";
-        case PluginType::ORIENTATION: return "local.OrientationSensor";
-        case PluginType::COMPASS: return "local.CompassSensor";
-    }
-
-    return "";
+    return m_plugin.interface;
 }
 
 const char* repowerd::Sensorfw::plugin_path() const
 {
-    char *new_str;
-    if (asprintf(&new_str,"%s/%s", dbus_sensorfw_path, plugin_string()) == -1)
-        return "";
-
-    return new_str;
+    return m_plugin.path;
 }
 
 bool repowerd::Sensorfw::load_plugin()
@@ -186,6 +198,36 @@ bool repowerd::Sensorfw::release_sensor()
 }
 
 void repowerd::Sensorfw::start()
+{
+    if (m_enabled)
+        return;
+
+    m_enabled = true;
+    start_session();
+}
+
+void repowerd::Sensorfw::stop()
+{
+    if (!m_enabled)
+        return;
+
+    m_enabled = false;
+
+    if (!call_plugin_method("stop", g_variant_new("(i)", m_sessionid)))
+        log->log(log_tag, "failed to stop SensorfwSensor");
+
+    stop_read_loop();
+}
+
+void repowerd::Sensorfw::start_session()
+{
+    start_read_loop();
+
+    if (!call_plugin_method("start", g_variant_new("(i)", m_sessionid)))
+        log->log(log_tag, "failed to start SensorfwSensor");
+}
+
+void repowerd::Sensorfw::start_read_loop()
 {
     if (m_running)
         return;
@@ -197,38 +239,170 @@ void repowerd::Sensorfw::start()
             if (m_socket->socket()->waitForReadyRead(10))
                 data_recived_impl();
         }
-        m_running = false;
         log->log(log_tag, "Eventloop stopped");
     });
+}
 
-    int constexpr timeout_default = 100;
-    auto const result =  g_dbus_connection_call_sync(
-            dbus_connection,
-            dbus_sensorfw_name,
-            plugin_path(),
-            plugin_interface(),
-            "start",
-            g_variant_new("(i)", m_sessionid),
-            NULL,
-            G_DBUS_CALL_FLAGS_NONE,
-            timeout_default,
-            NULL,
-            NULL);
+void repowerd::Sensorfw::stop_read_loop()
+{
+    if (!m_running)
+        return;
 
-    if (!result)
+    m_running = false;
+
+    read_loop.join();
+    read_loop = std::thread();
+}
+
+void repowerd::Sensorfw::handle_sensorfw_owner_changed(char const* new_owner)
+{
+    if (!new_owner || !*new_owner)
     {
-        log->log(log_tag, "failed to start SensorfwSensor");
+        // The data socket is gone with sensord, don't spin on it until
+        // sensord comes back
+        log->log(log_tag, "sensord vanished, pausing %s", plugin_string());
+        stop_read_loop();
+        m_socket->dropConnection();
         return;
     }
-    g_variant_unref(result);
+
+    log->log(log_tag, "sensord (re)appeared as %s, rebuilding %s session",
+             new_owner, plugin_string());
+    rebuild_session();
 }
 
-void repowerd::Sensorfw::stop()
+void repowerd::Sensorfw::rebuild_session()
 {
-    if (!m_running)
+    stop_read_loop();
+    m_socket->dropConnection();
+    m_longest_interval = -1;
+
+    if (!load_plugin())
+    {
+        log->log(log_tag, "failed to reload plugin %s", plugin_string());
         return;
+    }
 
-    m_running = false;
+    request_sensor();
+    m_socket->initiateConnection(m_sessionid);
+
+    if (m_interval > 0)
+        set_interval(m_interval);
+    if (m_standby_override)
+        set_standby_override(true);
+    if (m_downsampling)
+        set_downsampling(true);
+    if (m_buffer_size > 0)
+    {
+        set_buffer_size(m_buffer_size);
+        set_buffer_interval(m_buffer_interval);
+    }
+    if (m_enabled)
+        start_session();
+}
+
+void repowerd::Sensorfw::set_interval(int interval)
+{
+    m_interval = interval;
+    if (!call_plugin_method("setInterval", g_variant_new("(ii)", m_sessionid, interval)))
+        log->log(log_tag, "failed to set interval %i", interval);
+}
+
+void repowerd::Sensorfw::set_buffer_size(unsigned int size)
+{
+    if (!call_plugin_method("setBufferSize", g_variant_new("(iu)", m_sessionid, size)))
+        log->log(log_tag, "failed to set buffer size %u", size);
+}
+
+void repowerd::Sensorfw::set_buffer_interval(unsigned int interval)
+{
+    if (!call_plugin_method("setBufferInterval", g_variant_new("(iu)", m_sessionid, interval)))
+        log->log(log_tag, "failed to set buffer interval %u", interval);
+}
+
+void repowerd::Sensorfw::set_standby_override(bool enabled)
+{
+    m_standby_override = enabled;
+    if (!call_plugin_method("setStandbyOverride", g_variant_new("(ib)", m_sessionid, enabled)))
+        log->log(log_tag, "failed to set standby override %i", enabled);
+}
+
+void repowerd::Sensorfw::set_downsampling(bool enabled)
+{
+    m_downsampling = enabled;
+    if (!call_plugin_method("setDownsampling", g_variant_new("(ib)", m_sessionid, enabled)))
+        log->log(log_tag, "failed to set downsampling %i", enabled);
+}
+
+void repowerd::Sensorfw::apply_policy(SensorPolicy const& policy)
+{
+    bool const standby = !policy.display_on || policy.suspended;
+    bool run = policy.claimed;
+    bool standby_override = false;
+    int interval = policy.interval;
+
+    if (interval == 0 && policy.lowest_rate)
+        interval = longest_interval();
+
+    bool downsampling = interval > 0;
+
+    switch (m_plugin.standby)
+    {
+    case StandbyPolicy::stop:
+        run = run && !standby;
+        break;
+    case StandbyPolicy::throttle:
+        standby_override = true;
+        if (standby)
+        {
+            interval = std::max(interval, idle_interval);
+            downsampling = true;
+        }
+        break;
+    case StandbyPolicy::keep:
+        standby_override = true;
+        break;
+    }
+
+    if (!run)
+    {
+        stop();
+        return;
+    }
+
+    if (standby_override != m_standby_override)
+        set_standby_override(standby_override);
+    if (downsampling != m_downsampling)
+        set_downsampling(downsampling);
+    // An interval of 0 drops our request and lets sensord pick the rate
+    if (interval != m_interval)
+        set_interval(interval);
+
+    start();
+}
+
+void repowerd::Sensorfw::set_batching(unsigned int buffer_size, unsigned int buffer_interval)
+{
+    if (buffer_size > max_buffer_size)
+        buffer_size = max_buffer_size;
+
+    dbus_event_loop.enqueue(
+        [this, buffer_size, buffer_interval]
+        {
+            m_buffer_size = buffer_size;
+            m_buffer_interval = buffer_interval;
+            set_buffer_size(buffer_size);
+            set_buffer_interval(buffer_size > 0 ? buffer_interval : 0);
+            log->log(log_tag, "Batching for %s set to %u samples / %u ms",
+                     plugin_string(), buffer_size, buffer_interval);
+        }).get();
+}
+
+// 0 if sensord doesn't tell, which leaves the rate to it
+int repowerd::Sensorfw::longest_interval()
+{
+    if (m_longest_interval >= 0)
+        return m_longest_interval;
 
     int constexpr timeout_default = 100;
     auto const result =  g_dbus_connection_call_sync(
@@ -236,34 +410,44 @@ void repowerd::Sensorfw::stop()
             dbus_sensorfw_name,
             plugin_path(),
             plugin_interface(),
-            "stop",
-            g_variant_new("(i)", m_sessionid),
+            "getAvailableIntervals",
             NULL,
+            G_VARIANT_TYPE("(a(ddd))"),
             G_DBUS_CALL_FLAGS_NONE,
             timeout_default,
             NULL,
             NULL);
 
+    m_longest_interval = 0;
     if (!result)
     {
-        log->log(log_tag, "failed to stop SensorfwSensor");
-    } else {
-        g_variant_unref(result);
+        log->log(log_tag, "failed to get the intervals of %s", plugin_string());
+        return m_longest_interval;
     }
 
-    read_loop.join();
-    read_loop = std::thread();
+    GVariantIter* ranges;
+    double min, max, resolution;
+    g_variant_get(result, "(a(ddd))", &ranges);
+    while (g_variant_iter_next(ranges, "(ddd)", &min, &max, &resolution))
+        m_longest_interval = std::max(m_longest_interval, static_cast<int>(max));
+    g_variant_iter_free(ranges);
+    g_variant_unref(result);
+
+    log->log(log_tag, "Slowest interval of %s is %i ms", plugin_string(), m_longest_interval);
+
+    return m_longest_interval;
 }
 
-void repowerd::Sensorfw::set_interval(int interval) {
+bool repowerd::Sensorfw::call_plugin_method(const char* method, GVariant* parameters)
+{
     int constexpr timeout_default = 100;
     auto const result =  g_dbus_connection_call_sync(
             dbus_connection,
             dbus_sensorfw_name,
             plugin_path(),
             plugin_interface(),
-            "setInterval",
-            g_variant_new("(ii)", m_sessionid, interval),
+            method,
+            parameters,
             NULL,
             G_DBUS_CALL_FLAGS_NONE,
             timeout_default,
@@ -271,9 +455,8 @@ void repowerd::Sensorfw::set_interval(int interval) {
             NULL);
 
     if (!result)
-    {
-        log->log(log_tag, "set_interval() failed to releaseSensor");
-        return;
-    }
+        return false;
+
     g_variant_unref(result);
+    return true;
 }
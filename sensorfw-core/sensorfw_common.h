@@ -16,12 +16,14 @@
  * Authored by: Marius Gripsgard <marius@ubports.com>
  */
 
+#include <atomic>
 #include <memory>
 #include <string>
 #include <thread>
 
 #include "dbus_connection_handle.h"
 #include "dbus_event_loop.h"
+#include "sensor.h"
 
 #include "log.h"
 
@@ -29,30 +31,55 @@
 
 class SocketReader;
 namespace repowerd {
+
+// What happens to a claimed session while the display is off or the
+// system is suspending
+enum class StandbyPolicy
+{
+    stop,       // stop the session, nobody needs the readings
+    throttle,   // keep running at the idle interval, downsampled by sensord
+    keep        // keep running at the requested rate
+};
+
+// Filled in from the traits in sensorfw_plugins.h, all strings are static
+struct SensorfwPlugin
+{
+    char const* name;
+    char const* interface;
+    char const* path;
+    StandbyPolicy standby;
+};
+
 class Sensorfw {
 public:
-    enum PluginType
-    {
-        LIGHT,
-        PROXIMITY,
-        ORIENTATION,
-        COMPASS
-    };
-
     Sensorfw(
         std::shared_ptr<Log> const& log,
         std::string const& dbus_bus_address,
-        std::string const& name,
-        PluginType const& plugin);
+        SensorfwPlugin const& plugin);
     virtual ~Sensorfw();
 
+    /*
+     * Let sensord collect up to buffer_size samples (or buffer_interval ms
+     * worth of them) before waking us up. A buffer_size of 0 disables
+     * batching and every sample is delivered as soon as it is read.
+     */
+    void set_batching(unsigned int buffer_size, unsigned int buffer_interval);
+
 protected:
     virtual void data_recived_impl() = 0;
 
     void set_interval(int interval = 10);
+    void set_buffer_size(unsigned int size);
+    void set_buffer_interval(unsigned int interval);
+    void set_standby_override(bool enabled);
+    void set_downsampling(bool enabled);
     void start();
     void stop();
 
+    // Derives start state, interval, standby override and downsampling
+    // from the proxy state and pushes whatever changed to sensord
+    void apply_policy(SensorPolicy const& policy);
+
     std::shared_ptr<Log> const log;
     DBusConnectionHandle dbus_connection;
     DBusEventLoop dbus_event_loop;
@@ -63,15 +90,34 @@ private:
     bool release_sensor();
     bool load_plugin();
 
+    void handle_sensorfw_owner_changed(char const* new_owner);
+    void rebuild_session();
+    void start_session();
+    void start_read_loop();
+    void stop_read_loop();
+
     const char* plugin_string() const;
     const char* plugin_interface() const;
     const char* plugin_path() const;
+    bool call_plugin_method(const char* method, GVariant* parameters);
+    int longest_interval();
 
     std::thread read_loop;
     HandlerRegistration dbus_signal_handler_registration;
-    PluginType m_plugin;
+    SensorfwPlugin const m_plugin;
     pid_t m_pid;
     int m_sessionid;
-    bool m_running = false;
+    std::atomic<bool> m_running{false};
+
+    // Session state to replay when sensord restarts
+    bool m_enabled = false;
+    int m_interval = 0;
+    unsigned int m_buffer_size = 0;
+    unsigned int m_buffer_interval = 0;
+    bool m_standby_override = false;
+    bool m_downsampling = false;
+
+    // From sensord's available intervals, -1 until asked
+    int m_longest_interval = -1;
 };
 }
@@ -0,0 +1,350 @@
+/*
+ * Copyright © 2020 UBports foundation
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authored by: Marius Gripsgard <marius@ubports.com>
+ */
+
+#pragma once
+
+#include "sensorfw_common.h"
+#include "socketreader.h"
+
+#include <vector>
+
+/*
+ * One traits struct per sensord plugin. Each one provides:
+ *
+ *  - name(), interface(), path(): the plugin name passed to the
+ *    SensorManager and the D-Bus interface/object of the plugin
+ *  - standby(): how a claimed session is run while the display is off
+ *  - Sample: the wire type sensord writes to the data socket
+ *  - Value: what the backend hands to its handler
+ *  - batched(): whether the handler gets one Value per sample, or one
+ *    per socket read
+ *  - decode(): maps one Sample, or a whole read when batched, to a Value
+ *  - read_error_value(): whether a failed socket read should still be
+ *    reported, and as what
+ *
+ * SensorfwSensor<Plugin> instantiates a backend from it.
+ */
+
+namespace repowerd
+{
+
+enum class ProximityState{near, far};
+
+struct ProximityReading
+{
+    quint64 timestamp;    // monotonic, usecs
+    ProximityState state; // as decided by sensord
+    unsigned value;       // raw, device specific
+};
+
+// Units are given by the plugin
+struct TimedReading
+{
+    quint64 timestamp; // monotonic, usecs
+    double value;
+};
+
+// Units are those of the plugin's Sample
+struct XyzReading
+{
+    quint64 timestamp; // monotonic, usecs
+    float x, y, z;
+};
+
+enum OrientationData
+{
+    Undefined = 0, /**< Orientation is unknown. */
+    LeftUp,        /**< Device left side is up */
+    RightUp,       /**< Device right side is up */
+    BottomUp,      /**< Device bottom is up */
+    BottomDown,    /**< Device bottom is down */
+    FaceDown,      /**< Device face is down */
+    FaceUp         /**< Device face is up */
+};
+
+struct OrientationReading
+{
+    quint64 timestamp; // monotonic, usecs
+    OrientationData orientation;
+};
+
+struct LightPlugin
+{
+    using Sample = TimedUnsigned;
+    using Value = TimedReading;
+
+    static constexpr char const* name() { return "alssensor"; }
+    static constexpr char const* interface() { return "local.ALSSensor"; }
+    static constexpr char const* path() { return "/SensorManager/alssensor"; }
+    static constexpr StandbyPolicy standby() { return StandbyPolicy::stop; }
+    static constexpr bool batched() { return false; }
+
+    static Value decode(Sample const& sample) { return {sample.timestamp_, double(sample.value_)}; }
+    static bool read_error_value(Value&) { return false; }
+};
+
+struct ProximityPlugin
+{
+    using Sample = ProximityData;
+    using Value = ProximityReading;
+
+    static constexpr char const* name() { return "proximitysensor"; }
+    static constexpr char const* interface() { return "local.ProximitySensor"; }
+    static constexpr char const* path() { return "/SensorManager/proximitysensor"; }
+    static constexpr StandbyPolicy standby() { return StandbyPolicy::keep; }
+    static constexpr bool batched() { return false; }
+
+    static Value decode(Sample const& sample)
+    {
+        return {sample.timestamp_,
+                sample.withinProximity_ ? ProximityState::near : ProximityState::far,
+                sample.value_};
+    }
+    // A failed read says nothing about what is in front of the sensor,
+    // reporting far would un-blank the screen mid-call
+    static bool read_error_value(Value&) { return false; }
+};
+
+struct OrientationPlugin
+{
+    using Sample = PoseData;
+    using Value = OrientationReading;
+
+    static constexpr char const* name() { return "orientationsensor"; }
+    static constexpr char const* interface() { return "local.OrientationSensor"; }
+    static constexpr char const* path() { return "/SensorManager/orientationsensor"; }
+    static constexpr StandbyPolicy standby() { return StandbyPolicy::stop; }
+    static constexpr bool batched() { return false; }
+
+    static Value decode(Sample const& sample)
+    {
+        return {sample.timestamp_, static_cast<OrientationData>(sample.orientation_)};
+    }
+    static bool read_error_value(Value&) { return false; }
+};
+
+struct AccelerometerPlugin
+{
+    using Sample = AccelerationData;
+    using Value = XyzReading;
+
+    static constexpr char const* name() { return "accelerometersensor"; }
+    static constexpr char const* interface() { return "local.AccelerometerSensor"; }
+    static constexpr char const* path() { return "/SensorManager/accelerometersensor"; }
+    static constexpr StandbyPolicy standby() { return StandbyPolicy::stop; }
+    static constexpr bool batched() { return false; }
+
+    static Value decode(Sample const& sample)
+    {
+        return {sample.timestamp_,
+                static_cast<float>(sample.x_),
+                static_cast<float>(sample.y_),
+                static_cast<float>(sample.z_)};
+    }
+    static bool read_error_value(Value&) { return false; }
+};
+
+// A whole socket read, the fusion integrates it in one go
+struct AngularVelocityFrame
+{
+    std::vector<XyzReading> samples;
+};
+
+struct GyroscopePlugin
+{
+    using Sample = AngularVelocityData;
+    using Value = AngularVelocityFrame;
+
+    static constexpr char const* name() { return "gyroscopesensor"; }
+    static constexpr char const* interface() { return "local.GyroscopeSensor"; }
+    static constexpr char const* path() { return "/SensorManager/gyroscopesensor"; }
+    static constexpr StandbyPolicy standby() { return StandbyPolicy::stop; }
+    static constexpr bool batched() { return true; }
+
+    static Value decode(Sample const* samples, int n)
+    {
+        Value value;
+
+        value.samples.reserve(n);
+        for (int i = 0; i < n; ++i)
+        {
+            value.samples.push_back({samples[i].timestamp_,
+                                     static_cast<float>(samples[i].x_),
+                                     static_cast<float>(samples[i].y_),
+                                     static_cast<float>(samples[i].z_)});
+        }
+        return value;
+    }
+    static bool read_error_value(Value&) { return false; }
+};
+
+struct PressurePlugin
+{
+    using Sample = TimedUnsigned;
+    using Value = TimedReading;
+
+    static constexpr char const* name() { return "pressuresensor"; }
+    static constexpr char const* interface() { return "local.PressureSensor"; }
+    static constexpr char const* path() { return "/SensorManager/pressuresensor"; }
+    static constexpr StandbyPolicy standby() { return StandbyPolicy::keep; }
+    static constexpr bool batched() { return false; }
+
+    // Pa to hPa
+    static Value decode(Sample const& sample) { return {sample.timestamp_, sample.value_ / 100.0}; }
+    static bool read_error_value(Value&) { return false; }
+};
+
+struct TemperaturePlugin
+{
+    // sensord sends a plain 32-bit value, read it signed or frost wraps around
+    using Sample = TimedInt;
+    using Value = TimedReading;
+
+    static constexpr char const* name() { return "temperaturesensor"; }
+    static constexpr char const* interface() { return "local.TemperatureSensor"; }
+    static constexpr char const* path() { return "/SensorManager/temperaturesensor"; }
+    static constexpr StandbyPolicy standby() { return StandbyPolicy::keep; }
+    static constexpr bool batched() { return false; }
+
+    // Degrees Celsius
+    static Value decode(Sample const& sample) { return {sample.timestamp_, double(sample.value_)}; }
+    static bool read_error_value(Value&) { return false; }
+};
+
+struct HumidityPlugin
+{
+    using Sample = TimedUnsigned;
+    using Value = TimedReading;
+
+    static constexpr char const* name() { return "humiditysensor"; }
+    static constexpr char const* interface() { return "local.HumiditySensor"; }
+    static constexpr char const* path() { return "/SensorManager/humiditysensor"; }
+    static constexpr StandbyPolicy standby() { return StandbyPolicy::keep; }
+    static constexpr bool batched() { return false; }
+
+    // Percent of relative humidity
+    static Value decode(Sample const& sample) { return {sample.timestamp_, double(sample.value_)}; }
+    static bool read_error_value(Value&) { return false; }
+};
+
+struct StepCount
+{
+    quint32 count;     // since the hub started counting
+    quint64 timestamp; // of the last sample, monotonic usecs
+};
+
+// Batched so that a buffered read is one update, the counts are
+// cumulative and only the last one matters
+struct StepCounterPlugin
+{
+    using Sample = TimedUnsigned;
+    using Value = StepCount;
+
+    static constexpr char const* name() { return "stepcountersensor"; }
+    static constexpr char const* interface() { return "local.StepCounterSensor"; }
+    static constexpr char const* path() { return "/SensorManager/stepcountersensor"; }
+    static constexpr StandbyPolicy standby() { return StandbyPolicy::keep; }
+    static constexpr bool batched() { return true; }
+
+    static Value decode(Sample const* samples, int n)
+    {
+        return {samples[n - 1].value_, samples[n - 1].timestamp_};
+    }
+    static bool read_error_value(Value&) { return false; }
+};
+
+struct TapEvent
+{
+    quint64 timestamp; // monotonic, usecs
+    TapData::Direction direction;
+    bool double_tap;
+};
+
+struct TapPlugin
+{
+    using Sample = TapData;
+    using Value = TapEvent;
+
+    static constexpr char const* name() { return "tapsensor"; }
+    static constexpr char const* interface() { return "local.TapSensor"; }
+    static constexpr char const* path() { return "/SensorManager/tapsensor"; }
+    // Tap-to-wake has to work with the display off
+    static constexpr StandbyPolicy standby() { return StandbyPolicy::keep; }
+    static constexpr bool batched() { return false; }
+
+    static Value decode(Sample const& sample)
+    {
+        return {sample.timestamp_, sample.direction_, sample.type_ == TapData::DoubleTap};
+    }
+    static bool read_error_value(Value&) { return false; }
+};
+
+// A whole socket read, laid out per axis
+struct MagneticFieldBatch
+{
+    std::vector<float> x, y, z; // nT
+    quint64 timestamp;          // of the last sample, monotonic usecs
+};
+
+struct MagnetometerPlugin
+{
+    using Sample = CalibratedMagneticFieldData;
+    using Value = MagneticFieldBatch;
+
+    static constexpr char const* name() { return "magnetometersensor"; }
+    static constexpr char const* interface() { return "local.MagnetometerSensor"; }
+    static constexpr char const* path() { return "/SensorManager/magnetometersensor"; }
+    static constexpr StandbyPolicy standby() { return StandbyPolicy::throttle; }
+    static constexpr bool batched() { return true; }
+
+    static Value decode(Sample const* samples, int n)
+    {
+        Value value;
+
+        value.x.resize(n);
+        value.y.resize(n);
+        value.z.resize(n);
+        for (int i = 0; i < n; ++i)
+        {
+            value.x[i] = samples[i].x_;
+            value.y[i] = samples[i].y_;
+            value.z[i] = samples[i].z_;
+        }
+        value.timestamp = n > 0 ? samples[n - 1].timestamp_ : 0;
+
+        return value;
+    }
+    static bool read_error_value(Value&) { return false; }
+};
+
+struct CompassPlugin
+{
+    using Sample = CompassData;
+    using Value = TimedReading;
+
+    static constexpr char const* name() { return "compasssensor"; }
+    static constexpr char const* interface() { return "local.CompassSensor"; }
+    static constexpr char const* path() { return "/SensorManager/compasssensor"; }
+    static constexpr StandbyPolicy standby() { return StandbyPolicy::throttle; }
+    static constexpr bool batched() { return false; }
+
+    static Value decode(Sample const& sample) { return {sample.timestamp_, double(sample.degrees_)}; }
+    static bool read_error_value(Value&) { return false; }
+};
+
+}
@@ -0,0 +1,114 @@
+/*
+ * Copyright © 2020 UBports foundation
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authored by: Marius Gripsgard <marius@ubports.com>
+ */
+
+#pragma once
+
+#include "sensor.h"
+#include "sensorfw_common.h"
+#include "sensorfw_plugins.h"
+#include "event_loop_handler_registration.h"
+
+#include <type_traits>
+
+namespace repowerd
+{
+
+template<typename Plugin>
+class SensorfwSensor : public Sensor<typename Plugin::Value>, public Sensorfw
+{
+public:
+    using Value = typename Plugin::Value;
+    using Handler = typename Sensor<Value>::Handler;
+
+    SensorfwSensor(std::shared_ptr<Log> const& log,
+                   std::string const& dbus_bus_address)
+        : Sensorfw(log, dbus_bus_address,
+                   SensorfwPlugin{Plugin::name(), Plugin::interface(), Plugin::path(),
+                                  Plugin::standby()}),
+          handler{null_handler}
+    {
+    }
+
+    HandlerRegistration register_handler(Handler const& handler) override
+    {
+        return EventLoopHandlerRegistration{
+            dbus_event_loop,
+            [this, &handler]{ this->handler = handler; },
+            [this]{ this->handler = null_handler; }};
+    }
+
+    void enable_events() override
+    {
+        dbus_event_loop.enqueue(
+            [this]
+            {
+                start();
+            }).get();
+    }
+
+    void disable_events() override
+    {
+        dbus_event_loop.enqueue(
+            [this]
+            {
+                stop();
+            }).get();
+    }
+
+    void set_policy(SensorPolicy const& policy) override
+    {
+        dbus_event_loop.enqueue(
+            [this, policy]
+            {
+                apply_policy(policy);
+            });
+    }
+
+private:
+    static void null_handler(Value) {}
+
+    void data_recived_impl() override
+    {
+        QVector<typename Plugin::Sample> values;
+        if (!m_socket->read(values))
+        {
+            Value value{};
+            if (Plugin::read_error_value(value))
+                handler(value);
+            return;
+        }
+
+        deliver(values, std::integral_constant<bool, Plugin::batched()>{});
+    }
+
+    void deliver(QVector<typename Plugin::Sample> const& values, std::false_type)
+    {
+        for (auto const& value : values)
+            handler(Plugin::decode(value));
+    }
+
+    void deliver(QVector<typename Plugin::Sample> const& values, std::true_type)
+    {
+        if (!values.isEmpty())
+            handler(Plugin::decode(values.constData(), values.size()));
+    }
+
+    Handler handler;
+};
+
+}
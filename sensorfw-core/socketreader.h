@@ -62,6 +62,27 @@ public:
     unsigned value_; /**< Measurement value. */
 };
 
+/**
+ * Same layout as TimedUnsigned, for measurements that can go below zero.
+ */
+class TimedInt : public TimedData {
+public:
+    /**
+     * Default constructor.
+     */
+    TimedInt() : TimedData(0), value_(0) {}
+
+    /**
+     * Constructor.
+     *
+     * @param timestamp timestamp as monotonic time (microsec).
+     * @param value value of the measurement.
+     */
+    TimedInt(const quint64& timestamp, int value) : TimedData(timestamp), value_(value) {}
+
+    int value_; /**< Measurement value. */
+};
+
 class ProximityData : public TimedUnsigned
 {
 public:
@@ -190,6 +211,127 @@ public:
     int level_;   /**< Magnetometer calibration level. Higher value means better calibration. */
 };
 
+/**
+ * Class for vector type measurement data (timestamp, x, y, z).
+ */
+class TimedXyzData : public TimedData
+{
+public:
+    /**
+     * Default constructor.
+     */
+    TimedXyzData() : TimedData(0), x_(0), y_(0), z_(0) {}
+
+    /**
+     * Constructor.
+     *
+     * @param timestamp timestamp as monotonic time (microsec).
+     * @param x X coordinate.
+     * @param y Y coordinate.
+     * @param z Z coordinate.
+     */
+    TimedXyzData(const quint64& timestamp, int x, int y, int z) : TimedData(timestamp), x_(x), y_(y), z_(z) {}
+
+    int x_; /**< X value */
+    int y_; /**< Y value */
+    int z_; /**< Z value */
+};
+
+/**
+ * Datatype for device acceleration, in mG.
+ */
+typedef TimedXyzData AccelerationData;
+
+/**
+ * Datatype for angular velocity, in mdps.
+ */
+typedef TimedXyzData AngularVelocityData;
+
+/**
+ * Class for calibrated magnetometer measurements, in nT.
+ */
+class CalibratedMagneticFieldData : public TimedData
+{
+public:
+    /**
+     * Default constructor.
+     */
+    CalibratedMagneticFieldData() : TimedData(0), x_(0), y_(0), z_(0), rx_(0), ry_(0), rz_(0), level_(0) {}
+
+    /**
+     * Constructor.
+     *
+     * @param timestamp timestamp as monotonic time (microsec).
+     * @param x X coordinate.
+     * @param y Y coordinate.
+     * @param z Z coordinate.
+     * @param rx raw X coordinate.
+     * @param ry raw Y coordinate.
+     * @param rz raw Z coordinate.
+     * @param level Magnetometer calibration level.
+     */
+    CalibratedMagneticFieldData(const quint64& timestamp, int x, int y, int z, int rx, int ry, int rz, int level) :
+        TimedData(timestamp), x_(x), y_(y), z_(z), rx_(rx), ry_(ry), rz_(rz), level_(level) {}
+
+    int x_;     /**< X coordinate value */
+    int y_;     /**< Y coordinate value */
+    int z_;     /**< Z coordinate value */
+    int rx_;    /**< raw X coordinate value */
+    int ry_;    /**< raw Y coordinate value */
+    int rz_;    /**< raw Z coordinate value */
+    int level_; /**< Magnetometer calibration level. Higher value means better calibration. */
+};
+
+/**
+ * Class for tap events.
+ */
+class TapData : public TimedData
+{
+public:
+    /**
+     * Axis or direction of the tap.
+     */
+    enum Direction
+    {
+        X = 0,     /**< Along X axis */
+        Y,         /**< Along Y axis */
+        Z,         /**< Along Z axis */
+        LeftRight, /**< Left to right */
+        RightLeft, /**< Right to left */
+        TopBottom, /**< Top to bottom */
+        BottomTop, /**< Bottom to top */
+        FaceBack,  /**< Face to back */
+        BackFace   /**< Back to face */
+    };
+
+    /**
+     * Type of the tap.
+     */
+    enum Type
+    {
+        DoubleTap = 0, /**< Double tap */
+        SingleTap      /**< Single tap */
+    };
+
+    /**
+     * Default constructor.
+     */
+    TapData() : TimedData(0), direction_(X), type_(SingleTap) {}
+
+    /**
+     * Constructor.
+     *
+     * @param timestamp timestamp as monotonic time (microsec).
+     * @param direction direction of the tap.
+     * @param type type of the tap.
+     */
+    TapData(const quint64& timestamp, Direction direction, Type type) :
+        TimedData(timestamp), direction_(direction), type_(type) {}
+
+    Direction direction_; /**< Direction of the tap */
+    Type type_;           /**< Type of the tap */
+};
+
 /**
  * @brief Helper class for reading socket datachannel from sensord
  *
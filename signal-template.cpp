@@ -0,0 +1,152 @@
+/*
+ * Copyright (c) 2020 Erfan Abdi <erfangplus@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published by
+ * the Free Software Foundation.
+ *
+ */
+
+#include <string.h>
+
+#include "signal-template.h"
+
+#define MAX_SLOTS 16
+
+typedef struct {
+	SchemaProperty property;
+	gsize          offset;
+	char           type;
+} TemplateSlot;
+
+struct _SignalTemplate {
+	GDBusMessage *message;
+	guint8       *body;
+	gsize         body_size;
+	guint         n_slots;
+	TemplateSlot  slots[MAX_SLOTS];
+};
+
+/* Children of a serialized GVariant point into the parent's data,
+ * which is what gives us the offsets of the values to patch */
+static void
+find_slots (SignalTemplate *tmpl,
+	    GVariant       *body,
+	    const guint8   *base)
+{
+	const char *iface_name;
+	SchemaInterface iface;
+	GVariant *props;
+	gsize i, n;
+
+	g_variant_get_child (body, 0, "&s", &iface_name);
+	iface = schema_lookup_interface (iface_name);
+	props = g_variant_get_child_value (body, 1);
+	n = g_variant_n_children (props);
+
+	for (i = 0; i < n && tmpl->n_slots < MAX_SLOTS; i++) {
+		GVariant *entry, *boxed, *value;
+		SchemaProperty property;
+		const char *key;
+		char type = 0;
+
+		entry = g_variant_get_child_value (props, i);
+		g_variant_get_child (entry, 0, "&s", &key);
+		property = schema_lookup_property (iface, key);
+		boxed = g_variant_get_child_value (entry, 1);
+		value = g_variant_get_variant (boxed);
+
+		/* Only properties of the schema can be given a value */
+		if (property == SCHEMA_PROPERTY_INVALID)
+			;
+		else if (g_variant_is_of_type (value, G_VARIANT_TYPE_BOOLEAN))
+			type = 'b';
+		else if (g_variant_is_of_type (value, G_VARIANT_TYPE_DOUBLE))
+			type = 'd';
+		else if (g_variant_is_of_type (value, G_VARIANT_TYPE_UINT32))
+			type = 'u';
+
+		if (type != 0) {
+			TemplateSlot *slot = &tmpl->slots[tmpl->n_slots++];
+
+			slot->property = property;
+			slot->offset = (const guint8 *) g_variant_get_data (value) - base;
+			slot->type = type;
+		}
+
+		g_variant_unref (value);
+		g_variant_unref (boxed);
+		g_variant_unref (entry);
+	}
+
+	g_variant_unref (props);
+}
+
+SignalTemplate *
+signal_template_new (const char *object_path,
+		     GVariant   *body)
+{
+	SignalTemplate *tmpl;
+	const guint8 *data;
+
+	g_variant_ref_sink (body);
+	g_return_val_if_fail (g_variant_is_of_type (body, G_VARIANT_TYPE ("(sa{sv}as)")), NULL);
+
+	tmpl = g_new0 (SignalTemplate, 1);
+	tmpl->message = g_dbus_message_new_signal (object_path,
+						   "org.freedesktop.DBus.Properties",
+						   "PropertiesChanged");
+
+	data = (const guint8 *) g_variant_get_data (body);
+	tmpl->body_size = g_variant_get_size (body);
+	tmpl->body = (guint8 *) g_malloc (tmpl->body_size);
+	memcpy (tmpl->body, data, tmpl->body_size);
+	find_slots (tmpl, body, data);
+
+	g_variant_unref (body);
+
+	return tmpl;
+}
+
+void
+signal_template_free (SignalTemplate *tmpl)
+{
+	if (tmpl == NULL)
+		return;
+
+	g_object_unref (tmpl->message);
+	g_free (tmpl->body);
+	g_free (tmpl);
+}
+
+GDBusMessage *
+signal_template_instantiate (SignalTemplate            *tmpl,
+			     const SignalTemplateValue *values)
+{
+	GDBusMessage *message;
+	guint8 *body;
+	guint i;
+
+	body = (guint8 *) g_malloc (tmpl->body_size);
+	memcpy (body, tmpl->body, tmpl->body_size);
+
+	for (i = 0; i < tmpl->n_slots; i++) {
+		const TemplateSlot *slot = &tmpl->slots[i];
+		const SignalTemplateValue *value = &values[slot->property];
+
+		if (slot->type == 'b')
+			body[slot->offset] = value->b ? 1 : 0;
+		else if (slot->type == 'u')
+			memcpy (body + slot->offset, &value->u, sizeof (guint32));
+		else
+			memcpy (body + slot->offset, &value->d, sizeof (gdouble));
+	}
+
+	message = g_dbus_message_copy (tmpl->message, NULL);
+	g_dbus_message_set_body (message,
+				 g_variant_new_from_data (G_VARIANT_TYPE ("(sa{sv}as)"),
+							  body, tmpl->body_size,
+							  TRUE, g_free, body));
+
+	return message;
+}
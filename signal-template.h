@@ -0,0 +1,40 @@
+/*
+ * Copyright (c) 2020 Erfan Abdi <erfangplus@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published by
+ * the Free Software Foundation.
+ *
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+
+#include "dbus-schema.h"
+
+/*
+ * A PropertiesChanged signal built once. The "(sa{sv}as)" body is kept
+ * in its GVariant serialized form together with the offsets of every
+ * boolean, uint32 and double value in it; instantiating the template
+ * copies those bytes and patches the values in place instead of going
+ * through the variant builders again. String values are part of the
+ * template. GDBus still marshals the message when it is sent.
+ */
+
+typedef struct _SignalTemplate SignalTemplate;
+
+/* Only the member matching the property type is used */
+typedef struct {
+	gboolean b;
+	gdouble  d;
+	guint32  u;
+} SignalTemplateValue;
+
+SignalTemplate *signal_template_new         (const char                *object_path,
+					     GVariant                  *body);
+void            signal_template_free        (SignalTemplate            *tmpl);
+
+/* @values has SCHEMA_N_PROPERTIES entries, indexed by SchemaProperty */
+GDBusMessage   *signal_template_instantiate (SignalTemplate            *tmpl,
+					     const SignalTemplateValue *values);
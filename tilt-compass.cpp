@@ -0,0 +1,266 @@
+/*
+ * Copyright (c) 2020 Erfan Abdi <erfangplus@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published by
+ * the Free Software Foundation.
+ *
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include <atomic>
+
+#include "tilt-compass.h"
+
+#define RADIANS_TO_DEGREES 180.0/M_PI
+
+/* How close the smoothed heading has to get to the last batch, as a
+ * unit vector, to stop easing towards it. About 0.05 degrees */
+#define CONVERGED 1e-3f
+
+/* Batches are worked on four samples at a time. GCC vector extensions
+ * map to SIMD instructions, NEON or SSE, whatever the optimisation level */
+typedef float v4sf __attribute__ ((vector_size (16)));
+typedef gint32 v4si __attribute__ ((vector_size (16)));
+
+struct _TiltCompass {
+	float    smoothing;
+	float    still_threshold;
+
+	/* Odd while the accelerometer thread writes up, 0 until it
+	 * first did */
+	std::atomic<guint> up_sequence;
+	std::atomic<float> up[3];
+
+	/* Only touched by the magnetometer thread */
+	gboolean primed;
+	float    last_field[3];
+	float    last_up[3];
+	float    north;      /* smoothed heading, as a unit vector */
+	float    east;
+	float    batch_north; /* heading of the last projected batch */
+	float    batch_east;
+};
+
+TiltCompass *
+tilt_compass_new (gdouble smoothing,
+		  gdouble still_threshold)
+{
+	TiltCompass *compass;
+
+	compass = g_new0 (TiltCompass, 1);
+	compass->up_sequence = 0;
+	compass->smoothing = CLAMP (smoothing, 0.0, 1.0);
+	compass->still_threshold = still_threshold;
+
+	return compass;
+}
+
+void
+tilt_compass_free (TiltCompass *compass)
+{
+	if (compass == NULL)
+		return;
+
+	g_free (compass);
+}
+
+void
+tilt_compass_set_gravity (TiltCompass *compass,
+			  const float  up[3])
+{
+	guint sequence;
+	int i;
+
+	sequence = compass->up_sequence.load (std::memory_order_relaxed);
+	compass->up_sequence.store (sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence (std::memory_order_release);
+	for (i = 0; i < 3; i++)
+		compass->up[i].store (up[i], std::memory_order_relaxed);
+	compass->up_sequence.store (sequence + 2, std::memory_order_release);
+}
+
+/* FALSE if gravity was never set */
+static gboolean
+load_up (TiltCompass *compass,
+	 float        up[3])
+{
+	guint before, after;
+	int i;
+
+	do {
+		before = compass->up_sequence.load (std::memory_order_acquire);
+		for (i = 0; i < 3; i++)
+			up[i] = compass->up[i].load (std::memory_order_relaxed);
+		std::atomic_thread_fence (std::memory_order_acquire);
+		after = compass->up_sequence.load (std::memory_order_relaxed);
+	} while ((before & 1) || before != after);
+
+	return before != 0;
+}
+
+static float
+distance_squared (const float a[3],
+		  const float b[3])
+{
+	float dx = a[0] - b[0], dy = a[1] - b[1], dz = a[2] - b[2];
+
+	return dx * dx + dy * dy + dz * dz;
+}
+
+static float
+length_squared (const float v[3])
+{
+	return v[0] * v[0] + v[1] * v[1] + v[2] * v[2];
+}
+
+static gboolean
+moved (const float now[3],
+       const float before[3],
+       float       threshold)
+{
+	return distance_squared (now, before) >
+	       threshold * threshold * length_squared (before);
+}
+
+/* The @n first values, zero padded */
+static v4sf
+load4 (const float *p,
+       guint        n)
+{
+	v4sf v = { 0.0f, 0.0f, 0.0f, 0.0f };
+
+	memcpy (&v, p, MIN (n, 4) * sizeof (float));
+	return v;
+}
+
+static float
+sum4 (v4sf v)
+{
+	return v[0] + v[1] + v[2] + v[3];
+}
+
+/* 1 / sqrt (v), two Newton steps from the bit-level estimate are well
+ * below a thousandth of a degree. Lanes at 0 give 0 */
+static v4sf
+rsqrt4 (v4sf v)
+{
+	v4sf half = v * 0.5f;
+	v4sf r;
+
+	r = (v4sf) (0x5f3759df - ((v4si) v >> 1));
+	r = r * (1.5f - half * r * r);
+	r = r * (1.5f - half * r * r);
+
+	return (v4sf) ((v4si) r & (v > 0.0f));
+}
+
+gboolean
+tilt_compass_push (TiltCompass *compass,
+		   const float *x,
+		   const float *y,
+		   const float *z,
+		   guint        n,
+		   gdouble     *heading)
+{
+	float up[3], mean[3];
+	float sum_north, sum_east;
+	float norm;
+	v4sf acc_x = { 0 }, acc_y = { 0 }, acc_z = { 0 };
+	v4sf acc_north = { 0 }, acc_east = { 0 };
+	v4sf u0, u1, u2;
+	guint i;
+
+	if (n == 0)
+		return FALSE;
+
+	if (!load_up (compass, up))
+		return FALSE;
+
+	norm = sqrtf (length_squared (up));
+	if (norm == 0.0f)
+		return FALSE;
+	up[0] /= norm;
+	up[1] /= norm;
+	up[2] /= norm;
+
+	/* Cheap path: a still device keeps its heading */
+	for (i = 0; i < n; i += 4) {
+		acc_x += load4 (x + i, n - i);
+		acc_y += load4 (y + i, n - i);
+		acc_z += load4 (z + i, n - i);
+	}
+	mean[0] = sum4 (acc_x) / n;
+	mean[1] = sum4 (acc_y) / n;
+	mean[2] = sum4 (acc_z) / n;
+	if (compass->primed &&
+	    !moved (mean, compass->last_field, compass->still_threshold) &&
+	    !moved (up, compass->last_up, compass->still_threshold)) {
+		/* The smoothed heading still has to catch up with the
+		 * last batch after a turn */
+		if (fabsf (compass->north - compass->batch_north) < CONVERGED &&
+		    fabsf (compass->east - compass->batch_east) < CONVERGED)
+			return FALSE;
+		sum_north = compass->batch_north;
+		sum_east = compass->batch_east;
+		goto smooth;
+	}
+
+	/* East is field x up, North is up x East. Only their components
+	 * along the device y axis are needed for the heading of its top.
+	 * Padding samples are all 0, and so is their East */
+	u0 = (v4sf) { up[0], up[0], up[0], up[0] };
+	u1 = (v4sf) { up[1], up[1], up[1], up[1] };
+	u2 = (v4sf) { up[2], up[2], up[2], up[2] };
+	for (i = 0; i < n; i += 4) {
+		v4sf vx = load4 (x + i, n - i);
+		v4sf vy = load4 (y + i, n - i);
+		v4sf vz = load4 (z + i, n - i);
+		v4sf ex = vy * u2 - vz * u1;
+		v4sf ey = vz * u0 - vx * u2;
+		v4sf ez = vx * u1 - vy * u0;
+		v4sf ny = u2 * ex - u0 * ez;
+		v4sf inv_len = rsqrt4 (ex * ex + ey * ey + ez * ez);
+
+		/* Dividing by |East| makes (ny, ey) a unit vector, North
+		 * having the same length */
+		acc_north += ny * inv_len;
+		acc_east += ey * inv_len;
+	}
+	sum_north = sum4 (acc_north);
+	sum_east = sum4 (acc_east);
+
+	if (sum_north == 0.0f && sum_east == 0.0f)
+		return FALSE;
+
+	norm = sqrtf (sum_north * sum_north + sum_east * sum_east);
+	sum_north /= norm;
+	sum_east /= norm;
+
+	compass->batch_north = sum_north;
+	compass->batch_east = sum_east;
+	compass->last_field[0] = mean[0];
+	compass->last_field[1] = mean[1];
+	compass->last_field[2] = mean[2];
+	compass->last_up[0] = up[0];
+	compass->last_up[1] = up[1];
+	compass->last_up[2] = up[2];
+
+smooth:
+	if (!compass->primed) {
+		compass->north = sum_north;
+		compass->east = sum_east;
+		compass->primed = TRUE;
+	} else {
+		compass->north += compass->smoothing * (sum_north - compass->north);
+		compass->east += compass->smoothing * (sum_east - compass->east);
+	}
+
+	*heading = atan2 (compass->east, compass->north) * RADIANS_TO_DEGREES;
+	if (*heading < 0)
+		*heading += 360.0;
+
+	return TRUE;
+}
@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) 2020 Erfan Abdi <erfangplus@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published by
+ * the Free Software Foundation.
+ *
+ */
+
+#pragma once
+
+#include <glib.h>
+
+/*
+ * Heading from the magnetometer, compensated for the tilt measured by the
+ * accelerometer. Each batch of magnetometer samples is projected on the
+ * horizontal plane and averaged as unit vectors, then smoothed over time
+ * the same way, so that 359 and 1 degrees average to 0 and not 180.
+ *
+ * When neither the field nor gravity moved by more than the still
+ * threshold since the last projected batch, the projection is skipped:
+ * the smoothed heading keeps easing towards that batch's, and once it
+ * got there the batch is dropped.
+ */
+
+typedef struct _TiltCompass TiltCompass;
+
+/* @smoothing is the weight of a new batch, 1 to not smooth.
+ * @still_threshold is relative to the length of the vectors */
+TiltCompass *tilt_compass_new         (gdouble      smoothing,
+				       gdouble      still_threshold);
+void         tilt_compass_free        (TiltCompass *compass);
+
+/* Device frame, in any unit, pointing up. From any thread, neither it
+ * nor tilt_compass_push() ever waits for the other */
+void         tilt_compass_set_gravity (TiltCompass *compass,
+				       const float  up[3]);
+
+/* Returns TRUE and the heading in degrees clockwise from magnetic North,
+ * in [0, 360), if it should be updated */
+gboolean     tilt_compass_push        (TiltCompass *compass,
+				       const float *x,
+				       const float *y,
+				       const float *z,
+				       guint        n,
+				       gdouble     *heading);